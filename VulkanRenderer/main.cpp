@@ -27,6 +27,16 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader/tiny_obj_loader.h>
 #include <unordered_map>
+#include <functional>
+#include <thread>
+#include <string>
+#include <sstream>
+#include <cstdio>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <new>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/hash.hpp>
 
@@ -34,7 +44,12 @@ const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 const std::string MODEL_PATH = "models/viking_room.obj";
 const std::string TEXTURE_PATH = "textures/viking_room.png";
-const int MAX_FRAMES_IN_FLIGHT = 2;
+// upper bound for "FramePacingConfig::framesInFlight", per-frame resources are created for this many
+const int MAX_FRAMES_IN_FLIGHT = 3;
+// slots in the bindless texture table, shaders index it with the instance's texture index
+const uint32_t MAX_BINDLESS_TEXTURES = 1024;
+// upper bound for how many secondary command buffers the draws are split into
+const uint32_t MAX_RECORD_SLICES = 64;
 
 struct Vertex
 {
@@ -84,10 +99,130 @@ namespace std {
     };
 }
 
-struct UniformBufferObject {
-    alignas(16) glm::mat4 model;
-    alignas(16) glm::mat4 view;
-    alignas(16) glm::mat4 proj;
+/// <summary>
+/// Descriptor set 0, changes once per frame. View and projection are combined on the CPU once instead of per vertex.
+/// </summary>
+struct CameraUniforms {
+    alignas(16) glm::mat4 viewProj;
+};
+
+/// <summary>
+/// Constants for a single draw, sub-allocated from the uniform ring and bound with a dynamic offset.
+/// </summary>
+struct DrawUniforms {
+    // multiplied with the texture color, tells the draws "--instances-per-draw" splits the instances into apart
+    alignas(16) glm::vec4 tint;
+};
+
+/// <summary>
+/// What GPU-driven draw generation needs every frame besides the camera, sub-allocated from the uniform ring.
+/// </summary>
+struct InstanceUniforms {
+    // shared by every instance, their offsets are rotated by it too
+    alignas(16) glm::mat4 rotation;
+};
+
+/// <summary>
+/// Linear allocator for uniform data over one persistently mapped buffer. Each frame in flight owns a fixed slice,
+/// which is reset when the frame starts, and every allocation is aligned to minUniformBufferOffsetAlignment so its
+/// offset can be used as a dynamic offset directly.
+/// </summary>
+struct UniformRing {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    uint8_t* mapped = nullptr;
+    VkDeviceSize alignment = 256;
+    // bytes each frame in flight can allocate
+    VkDeviceSize frameSize = 64 * 1024;
+    // end of the current frame's slice, and where the next allocation goes
+    VkDeviceSize frameEnd = 0;
+    VkDeviceSize head = 0;
+};
+
+/// <summary>
+/// Per-instance vertex data, read once per instance from vertex binding 1.
+/// </summary>
+struct InstanceData
+{
+    glm::mat4 model;
+    // slot of the instance's texture in the bindless texture table
+    uint32_t textureIndex;
+
+    static VkVertexInputBindingDescription getBindingDescription()
+    {
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = 1;
+        bindingDescription.stride = sizeof(InstanceData);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+        return bindingDescription;
+    }
+
+    // a mat4 attribute takes up four locations, one per column
+    static std::array<VkVertexInputAttributeDescription, 5> getAttributeDescriptions()
+    {
+        std::array<VkVertexInputAttributeDescription, 5> attributeDescriptions{};
+        for (uint32_t column = 0; column < 4; column++)
+        {
+            attributeDescriptions[column].binding = 1;
+            attributeDescriptions[column].location = 3 + column;
+            attributeDescriptions[column].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+            attributeDescriptions[column].offset = offsetof(InstanceData, model) + sizeof(glm::vec4) * column;
+        }
+
+        attributeDescriptions[4].binding = 1;
+        attributeDescriptions[4].location = 7;
+        attributeDescriptions[4].format = VK_FORMAT_R32_UINT;
+        attributeDescriptions[4].offset = offsetof(InstanceData, textureIndex);
+        return attributeDescriptions;
+    }
+};
+
+// cull.comp reads instances as plain words and copies the visible ones to where the draws read them
+static_assert(sizeof(InstanceData) == 17 * sizeof(uint32_t), "cull.comp expects InstanceData to be 17 tightly packed words");
+
+/// <summary>
+/// Push constants of the occlusion culling shader, cull.comp.
+/// </summary>
+struct CullConstants {
+    // bounding sphere of the model in model space, xyz is the center and w the radius
+    glm::vec4 bounds;
+    // size of the depth pyramid's first level
+    glm::vec2 hiZSize;
+    uint32_t instanceCount;
+    // 0 for the early phase, 1 for the late one
+    uint32_t late;
+    // instances each half of the culled instance buffer holds, the late phase's instances start there
+    uint32_t capacity;
+};
+
+/// <summary>
+/// Push constants of the depth pyramid shader, hiz.comp. One dispatch per level.
+/// </summary>
+struct HiZConstants {
+    glm::ivec2 sourceSize;
+    glm::ivec2 destinationSize;
+};
+
+/// <summary>
+/// Push constants of the GPU-driven draw generation shader, drawgen.comp.
+/// </summary>
+struct DrawGenerationConstants {
+    // bounding sphere of the model in model space, xyz is the center and w the radius
+    glm::vec4 bounds;
+    uint32_t instanceCount;
+    uint32_t indexCount;
+    uint32_t textureIndex;
+};
+
+/// <summary>
+/// One point on a scripted camera path. Between keyframes everything is interpolated linearly.
+/// </summary>
+struct CameraKeyframe {
+    float time;
+    glm::vec3 eye;
+    glm::vec3 target;
+    // rotation of the model around z, in degrees
+    float objectAngle;
 };
 
 const std::vector<const char*> validationLayers =
@@ -115,6 +250,8 @@ struct SwapChainSupportDetails {
 struct QueueFamilyIndices {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentationFamily;
+    // optional, a family that can transfer but not draw. Uploads fall back to the graphics queue without it.
+    std::optional<uint32_t> transferFamily;
 
     bool isComplete()
     {
@@ -122,1948 +259,8706 @@ struct QueueFamilyIndices {
     }
 };
 
-#ifdef NDEBUG
-const bool enableValidationLayers = false;
-#else
-const bool enableValidationLayers = true;
-#endif
+/// <summary>
+/// Records transfers and layout transitions into a single command buffer so a whole batch of uploads
+/// costs one submit instead of a submit + vkQueueWaitIdle per operation.
+/// </summary>
+struct UploadContext {
+    // graphics half of the batch: ownership acquires, mipmap blits, depth transitions
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    // transfer half of the batch, same as "commandBuffer" when there is no dedicated transfer family
+    VkCommandBuffer transferCommandBuffer = VK_NULL_HANDLE;
+    uint32_t graphicsFamily = 0;
+    uint32_t transferFamily = 0;
+    bool dedicatedTransferQueue = false;
+    bool recording = false;
+    bool transferRecorded = false;
+    // opened by a lone helper call outside of an explicit batch, flushed by "endSingleTimeCommands"
+    bool implicitBatch = false;
+    // graphics timeline value the last batch signals, its command buffers can be reused once the GPU got there
+    uint64_t batchValue = 0;
+    // set when nobody waited on the last batch on the CPU, the next frame's submit waits for this value instead
+    uint64_t frameWaitValue = 0;
+    // a streamed batch whose graphics half hasn't been submitted yet, see "pollStreamedUploads"
+    bool streamPending = false;
+    // transfer timeline value the copies of the streamed batch signal, 0 if there are none
+    uint64_t streamedTransferValue = 0;
+    // staging buffers of the batch being recorded, handed to the deletion queue when it is submitted
+    std::vector<std::pair<VkBuffer, VkDeviceMemory>> stagingBuffers;
+
+    // how many times we submitted upload work / blocked on it, reported after startup
+    uint32_t submitCount = 0;
+    uint32_t waitCount = 0;
+};
 
 /// <summary>
-/// Used to call "VkCreateDebugUtilMessengerEXT". Function address needs to be loaded at runtime since it is an extension. This function uses the same arguments as the actual Vulkan function.
+/// Where the model texture is with --stream-textures, which uploads it while frames are already rendering.
 /// </summary>
-/// <param name="instance"></param>
-/// <param name="pCreateInfo"></param>
-/// <param name="pAllocator"></param>
-/// <param name="pDebugMessenger"></param>
-/// <returns>Will return false if function address couldn't be found.</returns>
-VkResult CreateDebugUtilsMessengerEXT(
-    VkInstance instance,
-    const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo,
-    const VkAllocationCallbacks* pAllocator,
-    VkDebugUtilsMessengerEXT* pDebugMessenger)
-{
-    auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
-    if (func != nullptr)
-    {
-        return func(instance, pCreateInfo, pAllocator, pDebugMessenger);
-    }
-    else
-    {
-        return VK_ERROR_EXTENSION_NOT_PRESENT;
-    }
-}
- 
+enum class TextureStreamState {
+    Off,     // uploaded at startup with everything else
+    Pending, // instances sample the placeholder, the upload starts once the startup uploads are done
+    Copying, // the copies are on the transfer queue
+    Done
+};
+
 /// <summary>
-/// Used to call "VkDestroyDebugUtilMessengerEXT". Function address needs to be loaded at runtime since it is an extension. This function uses the same arguments as the actual Vulkan function.
+/// Which present mode "chooseSwapSurfacePresentMode" goes for. Anything the surface doesn't support falls back to FIFO.
 /// </summary>
-/// <param name="instance"></param>
-/// <param name="debugMessenger"></param>
-/// <param name="pAllocator"></param>
-void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger, const VkAllocationCallbacks* pAllocator)
-{
-    auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
-    if (func != nullptr)
-    {
-        func(instance, debugMessenger, pAllocator);
-    }
-    else
-    {
-        throw std::runtime_error("could not find \"vkDestroyDebugUtilsMessengerEXT\" function address.");
-    }
-}
+enum class PresentModePolicy {
+    Mailbox,     // newest frame replaces the queued one, no tearing
+    Fifo,        // classic vsync, the display pulls one queued frame per refresh
+    FifoRelaxed, // vsync, but late frames are shown right away and may tear
+    Immediate    // no waiting on the display at all, tears
+};
 
-class HelloTriangleApplication {
-public:
+/// <summary>
+/// How many frames get queued up between the CPU, the GPU and the display. Fewer swapchain images and
+/// frames in flight trade throughput for lower input-to-display latency.
+/// </summary>
+struct FramePacingConfig {
+    // 0 means minImageCount + 1, otherwise clamped to what the surface supports
+    uint32_t swapchainImageCount = 0;
+    // how many frames the CPU may record ahead of the GPU, 1 to MAX_FRAMES_IN_FLIGHT
+    uint32_t framesInFlight = 2;
+    PresentModePolicy presentMode = PresentModePolicy::Mailbox;
+    // CPU side frame limiter in frames per second, 0 to disable
+    double frameRateLimit = 0.0;
+};
 
-    /// <summary>
-    /// Entry point of application.
-    /// </summary>
-    void run() {
-        initWindow();
-        initVulkan();
-        mainLoop();
-        cleanup();
-    }
+/// <summary>
+/// Rendering without a window, surface or swapchain, for throughput runs on machines without a display (lavapipe for example).
+/// </summary>
+struct HeadlessConfig {
+    bool enabled = false;
+    uint32_t width = WIDTH;
+    uint32_t height = HEIGHT;
+    // how many frames to render before exiting
+    uint32_t frameCount = 1000;
+    // if set, every frame is copied back and written into this directory as a .ppm
+    std::string dumpDirectory;
+};
 
-private:
-    GLFWwindow* window;
-    VkInstance instance;
-    VkDebugUtilsMessengerEXT debugMessenger;
-    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-    VkDevice device;
-    VkQueue graphicsQueue;
-    VkQueue presentationQueue;
-    VkSurfaceKHR surface;
-    VkSwapchainKHR swapChain;
-    std::vector<VkImage> swapChainImages;
-    VkFormat swapChainImageFormat;
-    VkExtent2D swapChainExtent;
-    std::vector<VkImageView> swapChainImageViews;
-    VkDescriptorSetLayout descriptorSetLayout;
-    VkPipelineLayout pipelineLayout;
-    VkRenderPass renderPass;
-    VkPipeline graphicsPipeline;
-    std::vector<VkFramebuffer> swapChainFramebuffers;
-    VkCommandPool commandPool;
-    std::vector<VkCommandBuffer> commandBuffers;
-    std::vector<VkSemaphore> imageAvailableSemaphores;
-    std::vector<VkSemaphore> renderFinishedSemaphores;
-    std::vector<VkFence> inFlightFences;
-    uint32_t currentFrame = 0;
-    bool framebufferResized = false;
-    std::vector<Vertex> vertices;
-    std::vector<uint32_t> indices;
-    VkBuffer vertexBuffer;
-    VkDeviceMemory vertexBufferMemory;
-    VkBuffer indexBuffer;
-    VkDeviceMemory indexBufferMemory;
-
-    // UBOs for MVP matrices for each object
-    std::vector<VkBuffer> firstUniformBuffers;
-    std::vector<VkDeviceMemory> firstUniformBuffersMemory;
-    std::vector<void*> firstUniformBuffersMapped;
-
-    std::vector<VkBuffer> secondUniformBuffers;
-    std::vector<VkDeviceMemory> secondUniformBuffersMemory;
-    std::vector<void*> secondUniformBuffersMapped;
-
-    VkDescriptorPool descriptorPool;
-    std::vector<VkDescriptorSet> descriptorSets;
-    uint32_t mipLevels;
-    VkImage textureImage;
-    VkDeviceMemory textureImageMemory;
-    VkImageView textureImageView;
-    VkSampler textureSampler;
-    VkImage depthImage;
-    VkDeviceMemory depthImageMemory;
-    VkImageView depthImageView;
+/// <summary>
+/// Benchmark runs advance the simulation by a fixed timestep per frame instead of by wall clock time,
+/// so two runs with the same settings render exactly the same frames.
+/// </summary>
+struct BenchmarkConfig {
+    bool enabled = false;
+    // frames that are rendered but not measured, lets clocks, caches and the driver settle
+    uint32_t warmupFrames = 100;
+    uint32_t frameCount = 1000;
+    double timestep = 1.0 / 60.0;
+    // keyframe file, the default orbit is used if empty
+    std::string cameraPath;
+    // .json gets a full report, anything else gets a CSV row appended
+    std::string outputPath;
+    // name for this run in the output, the build being tested for example
+    std::string label = "run";
+};
 
-    /// <summary>
-    /// Just a utility function to fill out the descriptor struct.
-    /// </summary>
-    /// <param name="createInfo"> - Pass by reference</param>
-    void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo)
+/// <summary>
+/// Counting heap allocations made by drawFrame, to keep the steady state render loop allocation free.
+/// </summary>
+struct AllocationTrackingConfig {
+    bool enabled = false;
+    // fail the run as soon as a frame after the warm-up allocates
+    bool assertNoFrameAllocations = false;
+    // the first frames fill caches and reserve storage, they aren't tracked
+    uint32_t warmupFrames = 10;
+};
+
+/// <summary>
+/// Everything that can be set from the command line.
+/// </summary>
+struct AppOptions {
+    FramePacingConfig pacing;
+    HeadlessConfig headless;
+    BenchmarkConfig benchmark;
+    AllocationTrackingConfig allocations;
+    // copies of the model to draw, the default two keep their original placement, more are laid out in a grid
+    uint32_t instanceCount = 2;
+    // where to write the Chrome trace on exit, nothing is written if empty (profiling builds only)
+    std::string tracePath;
+    // time descriptor set writes with and without update templates, then exit
+    bool descriptorBenchmark = false;
+    // instances per draw call, 0 draws them all at once
+    uint32_t instancesPerDraw = 0;
+    // threads recording draws into secondary command buffers, the main thread included. 0 records inline into the primary
+    uint32_t recordThreads = 0;
+    // time recording with 1 to N threads, then exit
+    bool recordBenchmark = false;
+    // threads the job system runs on, the main thread included. 0 uses one per core
+    uint32_t jobThreads = 0;
+    // lock each job thread to its own core
+    bool pinJobThreads = false;
+    // time a transform update on 1 to N job threads, then exit
+    bool jobBenchmark = false;
+    // reuse recorded command buffers until something they depend on changes
+    bool cacheCommands = false;
+    // MSAA samples per pixel, 1 turns it off. Lowered to what the device supports
+    uint32_t msaaSamples = 1;
+    // lay down depth in a pass of its own first, so the main pass only shades visible fragments
+    bool depthPrepass = false;
+    // two-phase occlusion culling of instances against a depth pyramid, with indirect draws
+    bool occlusionCulling = false;
+    // test instance bounds against the view frustum on the CPU and only submit the visible ones
+    bool frustumCulling = false;
+    // time the frustum culler over 10k to 1M boxes, then exit
+    bool cullBenchmark = false;
+    // a compute shader culls the instances and writes their transforms and draws, drawn with one indirect count draw
+    bool gpuDriven = false;
+    // start rendering with a placeholder texture and upload the model texture while frames render
+    bool streamTextures = false;
+};
+
+/// <summary>
+/// Running totals for how long it takes from sampling the simulation for a frame until that frame is handed to
+/// the presentation engine, and until the GPU has finished rendering it.
+/// </summary>
+struct FrameLatencyStats {
+    uint64_t frameCount = 0;
+    double presentSumMs = 0.0;
+    double presentMaxMs = 0.0;
+    uint64_t gpuFrameCount = 0;
+    double gpuSumMs = 0.0;
+    double gpuMaxMs = 0.0;
+    // CPU time spent writing instance transforms, and how many were written
+    double instanceUpdateSumNs = 0.0;
+    uint64_t instanceUpdateCount = 0;
+    // CPU time spent recording command buffers, how many were recorded and how many came from the command cache instead
+    double commandRecordSumNs = 0.0;
+    uint64_t commandRecordCount = 0;
+    uint64_t commandCacheHits = 0;
+    // fragment shader invocations of all frames that had pipeline statistics, and how many frames that was
+    uint64_t fragmentInvocations = 0;
+    uint64_t statisticsFrameCount = 0;
+    // instances occlusion culling tested and how many of them each phase drew, over "cullingFrameCount" frames
+    uint64_t cullingFrameCount = 0;
+    uint64_t culledTestedInstances = 0;
+    uint64_t earlyDrawnInstances = 0;
+    uint64_t lateDrawnInstances = 0;
+    // CPU frustum culling: instances tested, how many were visible, and the time spent culling
+    uint64_t frustumTestedInstances = 0;
+    uint64_t frustumVisibleInstances = 0;
+    double frustumCullSumNs = 0.0;
+    // draws GPU-driven rendering generated, over "generatedDrawFrameCount" frames
+    uint64_t generatedDrawFrameCount = 0;
+    uint64_t generatedDraws = 0;
+};
+
+/// <summary>
+/// Timings of one measured benchmark frame. "gpuMs" stays negative if the GPU can't write timestamps.
+/// </summary>
+struct BenchmarkSample {
+    // time between the starts of this frame and the one before it
+    double frameMs = 0.0;
+    // time spent in drawFrame, not counting waiting for the GPU to free up the frame slot
+    double cpuMs = 0.0;
+    double gpuMs = -1.0;
+};
+
+/// <summary>
+/// Mean, percentiles (nearest rank) and maximum of a set of frame times.
+/// </summary>
+struct FrameTimeSummary {
+    size_t count = 0;
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+};
+
+/// <summary>
+/// A timeline semaphore that every submit to one queue signals with the next value. Asking whether GPU work
+/// has finished is then just comparing against the value it signals, no fence per submit needed.
+/// </summary>
+struct GpuTimeline {
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    // last value handed out to a submit
+    uint64_t lastSignaled = 0;
+    // highest value we've seen the GPU reach, saves a driver call when asking about older points
+    uint64_t lastCompleted = 0;
+};
+
+/// <summary>
+/// Destroys something once the graphics timeline has reached "timelineValue".
+/// </summary>
+struct DeferredDeletion {
+    uint64_t timelineValue;
+    std::function<void()> destroy;
+};
+
+/// <summary>
+/// Vulkan objects waiting for the GPU to be done with them. Each one is tagged with a graphics timeline value and
+/// destroyed by "collect" once the timeline has reached it, so nothing has to wait for the device to go idle.
+/// </summary>
+class DeletionQueue {
+public:
+    void init(VkDevice device, const VkAllocationCallbacks* allocator, const GpuTimeline* timeline)
     {
-        createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-        createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-        createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-        createInfo.pfnUserCallback = debugCallback;
-        createInfo.pUserData = nullptr;
+        this->device = device;
+        this->allocator = allocator;
+        this->timeline = timeline;
     }
 
-    /// <summary>
-    /// Gets called whenever there is a validation message. Function signature is determined by Vulkan.
-    /// </summary>
-    /// <param name="messageSeverity"></param>
-    /// <param name="messageType"></param>
-    /// <param name="pCallbackData"></param>
-    /// <param name="pUserData"></param>
-    /// <returns></returns>
-    static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
-        VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
-        VkDebugUtilsMessageTypeFlagsEXT messageType,
-        const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData,
-        void* pUserData)
+    void push(uint64_t timelineValue, std::function<void()> destroy)
     {
-        std::cerr << "validation layer: " << pCallbackData->pMessage << "\n\n" << std::endl;
-        return VK_FALSE;
+        deletions.push_back({ timelineValue, std::move(destroy) });
     }
 
     /// <summary>
-    /// Gets all of the required extensions for GLFW to operate with Vulkan.
+    /// Destroys "handle" with "Destroy" (vkDestroyBuffer, vkFreeMemory, ...) once the frame being built right now,
+    /// which may still record it, is done on the GPU.
     /// </summary>
-    /// <returns> A vector of all of the necessary extensions as char* strings</returns>
-    std::vector<const char*> getRequiredExtensions()
+    template<auto Destroy, typename T>
+    void retire(T handle)
     {
-        uint32_t glfwExtensionCount = 0;
-        const char** glfwExtensions;
-        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-        std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
-
-        if (enableValidationLayers)
-        {
-            extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
-        }
+        if (handle == VK_NULL_HANDLE)
+            return;
 
-        return extensions;
+        VkDevice queueDevice = device;
+        const VkAllocationCallbacks* queueAllocator = allocator;
+        push(timeline->lastSignaled + 1, [queueDevice, queueAllocator, handle]() {
+            Destroy(queueDevice, handle, queueAllocator);
+        });
     }
 
     /// <summary>
-    /// Iterates through the available surface formats and picks one.
+    /// Runs every destruction whose timeline value is at most "completedValue".
     /// </summary>
-    /// <param name="availableFormats"></param>
-    /// <returns></returns>
-    VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats)
+    void collect(uint64_t completedValue)
     {
-        for (const auto& format : availableFormats)
+        size_t kept = 0;
+        for (size_t i = 0; i < deletions.size(); i++)
         {
-            if (format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR && format.format == VK_FORMAT_B8G8R8A8_SRGB)
+            if (deletions[i].timelineValue <= completedValue)
             {
-                return format;
+                deletions[i].destroy();
+            }
+            else
+            {
+                deletions[kept++] = std::move(deletions[i]);
             }
         }
-
-        return availableFormats[0];
+        deletions.resize(kept);
     }
 
     /// <summary>
-    /// Iterates through the available present modes and picks one.
+    /// Destroys everything still queued. Only for when the device is idle.
     /// </summary>
-    /// <param name="availablePresentModes"></param>
-    /// <returns></returns>
-    VkPresentModeKHR chooseSwapSurfacePresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes)
+    void flush()
     {
-        for (const auto& presentMode : availablePresentModes)
+        collect(UINT64_MAX);
+    }
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    const VkAllocationCallbacks* allocator = nullptr;
+    const GpuTimeline* timeline = nullptr;
+    std::vector<DeferredDeletion> deletions;
+};
+
+/// <summary>
+/// Owns a Vulkan object and retires it to a DeletionQueue when reset, replaced or destroyed, so an object in use
+/// by frames in flight can be swapped out at any time. Move-only. "Destroy" is the function that destroys it, it
+/// can't be picked by the handle type since 32-bit builds define every non-dispatchable handle as uint64_t.
+/// </summary>
+template<typename T, auto Destroy>
+class VulkanHandle {
+public:
+    VulkanHandle() = default;
+    VulkanHandle(DeletionQueue& queue, T handle) : queue(&queue), handle(handle) {}
+    VulkanHandle(const VulkanHandle&) = delete;
+    VulkanHandle& operator=(const VulkanHandle&) = delete;
+
+    VulkanHandle(VulkanHandle&& other) noexcept : queue(other.queue), handle(other.release()) {}
+
+    VulkanHandle& operator=(VulkanHandle&& other) noexcept
+    {
+        if (this != &other)
         {
-            if (presentMode == VK_PRESENT_MODE_MAILBOX_KHR)
-            {
-                return presentMode;
-            }
+            reset();
+            queue = other.queue;
+            handle = other.release();
         }
-
-        return VK_PRESENT_MODE_FIFO_KHR;
+        return *this;
     }
 
-    /// <summary>
-    /// Picks an appropriate swapChain extent based on surface capabilities.
-    /// </summary>
-    /// <param name="capabilities"></param>
-    /// <returns></returns>
-    VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities)
+    ~VulkanHandle() { reset(); }
+
+    T get() const { return handle; }
+
+    void reset()
     {
-        // have to do this odd parenthese syntax to avoid a member/macro conflict inherent in STL:
-        // https://stackoverflow.com/questions/1394132/macro-and-member-function-conflict
-        if (capabilities.currentExtent.width != (std::numeric_limits<uint32_t>::max)()) 
+        if (handle != VK_NULL_HANDLE)
         {
-            return capabilities.currentExtent;
-        }
-        else
-        {
-            int width, height;
-            glfwGetFramebufferSize(window, &width, &height);
-                
-            VkExtent2D actualExtent = {
-                static_cast<uint32_t>(width),
-                static_cast<uint32_t>(height)
-            };
-
-            actualExtent.width = std::clamp(actualExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
-            actualExtent.height = std::clamp(actualExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
-
-            return actualExtent;
+            queue->retire<Destroy>(handle);
+            handle = VK_NULL_HANDLE;
         }
     }
 
-    /// <summary>
-    /// Gets all of the available validation layers that are supported and checks to make sure the one(s) we've requested (in global const "validationLayers") are supported.
-    /// </summary>
-    /// <returns>Will return false if a requested validation layer is not supported.</returns>
-    bool checkValidationLayerSupport()
+    T release()
     {
-        uint32_t layerCount;
-        vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+        T result = handle;
+        handle = VK_NULL_HANDLE;
+        return result;
+    }
 
-        std::vector<VkLayerProperties> availableLayers(layerCount);
-        vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+private:
+    DeletionQueue* queue = nullptr;
+    T handle = VK_NULL_HANDLE;
+};
 
-        /// loop through each validation layer that we have specified that we want to use,
-        /// for each of those check if it exists in the available layers
-        /// if it doesn't, then stop and return false because we'd be getting an error when we try to use it
-        /// otherwise if all goes well, return true
-        for (auto& validationLayer : validationLayers)
-        {
-            bool layerFound = false;
-            for (auto& availableLayer : availableLayers)
-            {
-                if (strcmp(validationLayer, availableLayer.layerName) == 0)
-                {
-                    layerFound = true;
-                    break;
-                }
-            }
+/// <summary>
+/// What "RenderGraph::compile" came up with, printed at startup.
+/// </summary>
+struct RenderGraphStats {
+    uint32_t passCount = 0;
+    uint32_t culledPassCount = 0;
+    // barriers recorded per frame, and how many vkCmdPipelineBarrier2 calls they're batched into
+    uint32_t barrierCount = 0;
+    uint32_t barrierBatchCount = 0;
+    // memory backing the transient images, and how much it would take if none of them shared memory
+    VkDeviceSize transientBytes = 0;
+    VkDeviceSize unaliasedTransientBytes = 0;
+    // part of "transientBytes" that's lazily allocated, tile based GPUs never back it with actual memory
+    VkDeviceSize lazyBytes = 0;
+    // estimate of the attachment memory traffic per frame: attachment loads and stores, and resolve writes
+    VkDeviceSize attachmentTrafficBytes = 0;
+
+    VkDeviceSize aliasingSavedBytes() const
+    {
+        // alignment padding between images that can't share memory can make the block bigger than their sum
+        return unaliasedTransientBytes > transientBytes ? unaliasedTransientBytes - transientBytes : 0;
+    }
+};
 
-            if (!layerFound)
-            {
-                return false;
-            }
-        }
+/// <summary>
+/// The frame as a list of passes that declare which images and buffers they read and write. "compile" culls the
+/// passes nothing the frame outputs depends on, works out the barriers between the rest (one vkCmdPipelineBarrier2
+/// batch in front of each pass) and the load and store ops of their attachments, and places transient images
+/// whose lifetimes don't overlap in the same memory. Imported resources belong to someone else and are bound
+/// every frame with "bindImage" and "bindBuffer" before the passes are executed.
+/// </summary>
+class RenderGraph {
+public:
+    static const uint32_t NO_RESOURCE = UINT32_MAX;
 
-        return true;
+    void init(VkDevice device, VkPhysicalDevice physicalDevice, const VkAllocationCallbacks* allocator, DeletionQueue& deletionQueue)
+    {
+        this->device = device;
+        this->physicalDevice = physicalDevice;
+        this->allocator = allocator;
+        this->deletionQueue = &deletionQueue;
     }
 
     /// <summary>
-    /// Initializes GLFW and creates a window. Sotres window in private class member "window"
+    /// Declares an image owned outside the graph. Whatever it holds is discarded once "initialStages" of earlier
+    /// work are done with it, and the last pass using it leaves it in "finalLayout" (UNDEFINED keeps the layout that
+    /// pass used). Passes only survive culling if they contribute to an "output".
     /// </summary>
-    void initWindow() {
-        glfwInit();
-
-        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
-        
-        window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
-        glfwSetWindowUserPointer(window, this);
-        glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+    uint32_t importImage(const char* name, VkFormat format, VkPipelineStageFlags2 initialStages, VkImageLayout finalLayout, bool output)
+    {
+        Resource resource;
+        resource.name = name;
+        resource.isImage = true;
+        resource.imported = true;
+        resource.output = output;
+        resource.format = format;
+        resource.aspect = aspectForFormat(format);
+        resource.initialStages = initialStages;
+        resource.finalLayout = finalLayout;
+        resources.push_back(std::move(resource));
+        return static_cast<uint32_t>(resources.size() - 1);
     }
 
-    static void framebufferResizeCallback(GLFWwindow* window, int width, int height)
+    /// <summary>
+    /// Declares a buffer owned outside the graph. If a pass writes it, the writes are made visible to "finalAccess"
+    /// in "finalStages" at the end of the frame. The first pass using it waits for "initialStages" of earlier work,
+    /// for buffers the frame before used.
+    /// </summary>
+    uint32_t importBuffer(const char* name, VkPipelineStageFlags2 finalStages, VkAccessFlags2 finalAccess, bool output,
+        VkPipelineStageFlags2 initialStages = VK_PIPELINE_STAGE_2_NONE)
     {
-        auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
-        app->framebufferResized = true;
-
-        app->drawFrame();
-        app->drawFrame();
+        Resource resource;
+        resource.name = name;
+        resource.imported = true;
+        resource.output = output;
+        resource.initialStages = initialStages;
+        resource.finalStages = finalStages;
+        resource.finalAccess = finalAccess;
+        resources.push_back(std::move(resource));
+        return static_cast<uint32_t>(resources.size() - 1);
     }
 
     /// <summary>
-    /// Uses all of the "find____" and "choose____" utility functions to create a swapchain with the proper settings
-    /// based on our hardware's capabilities.
+    /// Declares a swapchain sized image that only lives within the frame. The graph creates it, with the usage its
+    /// passes need, and it may share memory with other transient images. Attachments that are never loaded or
+    /// stored get lazily allocated memory if the device has it.
     /// </summary>
-    void createSwapChain()
+    uint32_t createImage(const char* name, VkFormat format, VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT)
     {
-        SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
-
-        VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
-        VkPresentModeKHR presentMode = chooseSwapSurfacePresentMode(swapChainSupport.presentModes);
-        VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
-
-        uint32_t imageCount = swapChainSupport.capabilities.maxImageCount + 1;
-
-        if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount)
-        {
-            imageCount = swapChainSupport.capabilities.maxImageCount;
-        }
-
-        VkSwapchainCreateInfoKHR createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-        createInfo.surface = surface;
-        createInfo.minImageCount = imageCount;
-        createInfo.imageFormat = surfaceFormat.format;
-        createInfo.imageColorSpace = surfaceFormat.colorSpace;
-        createInfo.imageExtent = extent;
-        createInfo.imageArrayLayers = 1;
-        createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        Resource resource;
+        resource.name = name;
+        resource.isImage = true;
+        resource.format = format;
+        resource.aspect = aspectForFormat(format);
+        resource.samples = samples;
+        resources.push_back(std::move(resource));
+        return static_cast<uint32_t>(resources.size() - 1);
+    }
 
-        QueueFamilyIndices queueFamilies = findQueueFamilies(physicalDevice);
-        uint32_t familyIndices[] = { queueFamilies.graphicsFamily.value(),  queueFamilies.presentationFamily.value() };
+    /// <summary>
+    /// Adds a pass, executed in the order passes were added. "record" records its commands, inside dynamic
+    /// rendering if it has attachments.
+    /// </summary>
+    uint32_t addPass(const char* name, std::function<void(VkCommandBuffer)> record)
+    {
+        Pass pass;
+        pass.name = name;
+        pass.record = std::move(record);
+        passes.push_back(std::move(pass));
+        return static_cast<uint32_t>(passes.size() - 1);
+    }
 
-        if (queueFamilies.graphicsFamily != queueFamilies.presentationFamily)
-        {
-            createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
-            createInfo.queueFamilyIndexCount = 2;
-            createInfo.pQueueFamilyIndices = familyIndices;
-        }
-        else
+    /// <summary>
+    /// Renders into "image". Unless it's cleared, what earlier passes rendered into it is kept. A multisampled
+    /// "image" can be resolved into the single sampled "resolveTarget" at the end of the pass.
+    /// </summary>
+    void addColorAttachment(uint32_t pass, uint32_t image, bool clear, VkClearColorValue clearValue = {}, uint32_t resolveTarget = NO_RESOURCE)
+    {
+        Attachment attachment;
+        attachment.resource = image;
+        attachment.clear = clear;
+        attachment.clearValue.color = clearValue;
+        attachment.resolveTarget = resolveTarget;
+        passes[pass].colorAttachments.push_back(attachment);
+
+        addAccess(pass, image, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+            clear ? VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT : VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true, !clear);
+        if (resolveTarget != NO_RESOURCE)
         {
-            createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-            createInfo.queueFamilyIndexCount = 0;
-            createInfo.pQueueFamilyIndices = nullptr;
+            addAccess(pass, resolveTarget, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true, false);
         }
+    }
 
-        createInfo.preTransform = swapChainSupport.capabilities.currentTransform; //this is specify no transformation
-        createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-        createInfo.presentMode = presentMode;
-        createInfo.clipped = VK_TRUE;
-        createInfo.oldSwapchain = VK_NULL_HANDLE;
+    void setDepthAttachment(uint32_t pass, uint32_t image, bool clear, VkClearDepthStencilValue clearValue = {}, bool readOnly = false)
+    {
+        Attachment& attachment = passes[pass].depthAttachment;
+        attachment.resource = image;
+        attachment.clear = clear;
+        attachment.readOnly = readOnly;
+        attachment.clearValue.depthStencil = clearValue;
 
-        if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain))
+        if (readOnly)
         {
-            throw std::runtime_error("Failed to create swapchain");
+            addAccess(pass, image, VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, false, true);
+            return;
         }
 
-        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
-        swapChainImages.resize(imageCount);
-        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
-
-        swapChainImageFormat = surfaceFormat.format;
-        swapChainExtent = extent;
+        // depth testing reads the attachment either way, a clear only means nothing from before the pass is needed
+        addAccess(pass, image, VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true, !clear);
     }
 
-    void createImageViews()
+    /// <summary>
+    /// The pass reads "resource". "layout" is ignored for buffers.
+    /// </summary>
+    void read(uint32_t pass, uint32_t resource, VkPipelineStageFlags2 stages, VkAccessFlags2 access, VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED)
     {
-        swapChainImageViews.resize(swapChainImages.size());
-        for (int i = 0; i < swapChainImageViews.size(); i++)
-        {
-            swapChainImageViews[i] = createImageView(swapChainImages[i], swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
-        }                                                           
+        addAccess(pass, resource, stages, access, layout, false, true);
     }
 
     /// <summary>
-    /// Calls "vkCreateInstance", stores instance in private member "instance". Checks for validation layer support before doing so.
+    /// The pass overwrites all of "resource". A pass that only updates part of it has to declare a read as well.
     /// </summary>
-    void createInstance() {
-        if (enableValidationLayers && !checkValidationLayerSupport())
-        {
-            throw std::runtime_error("Validation layer(s) requested, but not available.");
-        }
+    void write(uint32_t pass, uint32_t resource, VkPipelineStageFlags2 stages, VkAccessFlags2 access, VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED)
+    {
+        addAccess(pass, resource, stages, access, layout, true, false);
+    }
 
-        VkApplicationInfo appInfo{};
-        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-        appInfo.pApplicationName = "Hello Triangle";
-        appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.pEngineName = "No engine";
-        appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+    /// <summary>
+    /// Flags "vkCmdBeginRendering" gets for the pass, for passes that switch between inline and secondary command buffers.
+    /// </summary>
+    void setRenderingFlags(uint32_t pass, VkRenderingFlags flags)
+    {
+        passes[pass].renderingFlags = flags;
+    }
 
-        VkInstanceCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-        createInfo.pApplicationInfo = &appInfo;
+    /// <summary>
+    /// Turns the declared passes into what "executePass" records, and (re-)creates the transient images at "extent".
+    /// Transient images from an earlier compile are retired, frames in flight may still be using them.
+    /// </summary>
+    void compile(VkExtent2D extent)
+    {
+        this->extent = extent;
+        stats = RenderGraphStats{};
 
-        VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
-        if (enableValidationLayers)
-        {
-            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
-            createInfo.ppEnabledLayerNames = validationLayers.data();
+        cullPasses();
+        chooseAttachmentOps();
+        createTransientImages();
+        buildBarriers();
+    }
 
-            populateDebugMessengerCreateInfo(debugCreateInfo);
-            createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)&debugCreateInfo;
-        }
-        else
-        {
-            createInfo.enabledLayerCount = 0;
-            createInfo.pNext = nullptr;
-        }
+    void bindImage(uint32_t resource, VkImage image, VkImageView view)
+    {
+        resources[resource].image = image;
+        resources[resource].view = view;
+    }
 
-        auto extensions = getRequiredExtensions();
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
-        createInfo.ppEnabledExtensionNames = extensions.data();
+    void bindBuffer(uint32_t resource, VkBuffer buffer)
+    {
+        resources[resource].buffer = buffer;
+    }
 
-        if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create instance!");
-        }
+    /// <summary>
+    /// View of a transient image, for passes that sample it. Changes with every "compile".
+    /// </summary>
+    VkImageView imageView(uint32_t resource) const
+    {
+        return resources[resource].view;
     }
 
     /// <summary>
-    /// Enumerates through all avilable extensions.
+    /// Number of passes left after culling, "executePass" takes an index below this.
     /// </summary>
-    void checkVulkanExtensions()
+    uint32_t passCount() const
     {
-        uint32_t extensionCount = 0;
-        vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
-        std::vector<VkExtensionProperties> extensions(extensionCount);
-        vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensions.data());
+        return static_cast<uint32_t>(compiledPasses.size());
+    }
 
-        std::cout << "Available Vulkan extensions:" << std::endl;
+    const char* passName(uint32_t index) const
+    {
+        return passes[compiledPasses[index].pass].name.c_str();
+    }
 
-        for (const auto& extension : extensions)
-        {
-            std::cout << "\t" << extension.extensionName << " | " << extension.specVersion << std::endl;
-        }
+    const RenderGraphStats& getStats() const
+    {
+        return stats;
     }
 
     /// <summary>
-    /// Will attempt to find the index of each of the queue families that are present as members in "QueueFamilyIndices".
+    /// Records the barriers in front of a pass, then the pass itself. Doesn't allocate, so it's fine every frame.
     /// </summary>
-    /// <param name="device"></param>
-    /// <returns></returns>
-    QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device)
+    void executePass(VkCommandBuffer commandBuffer, uint32_t index)
     {
-        QueueFamilyIndices indices;
-        uint32_t queueFamilyCount = 0;
-        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
-        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+        CompiledPass& compiled = compiledPasses[index];
+        const Pass& pass = passes[compiled.pass];
+        recordBarriers(commandBuffer, compiled.barriers);
 
-        int i = 0;
-        for (const auto& queueFamily : queueFamilies)
+        bool rendering = !pass.colorAttachments.empty() || pass.depthAttachment.resource != NO_RESOURCE;
+        if (rendering)
         {
-            if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+            for (size_t i = 0; i < pass.colorAttachments.size(); i++)
             {
-                indices.graphicsFamily = i;
+                compiled.colorAttachments[i].imageView = resources[pass.colorAttachments[i].resource].view;
+                if (pass.colorAttachments[i].resolveTarget != NO_RESOURCE)
+                {
+                    compiled.colorAttachments[i].resolveImageView = resources[pass.colorAttachments[i].resolveTarget].view;
+                }
             }
 
-            VkBool32 presentSupport = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
-            if (presentSupport)
+            VkRenderingInfo renderingInfo{};
+            renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+            renderingInfo.flags = pass.renderingFlags;
+            renderingInfo.renderArea.offset = { 0, 0 };
+            renderingInfo.renderArea.extent = extent;
+            renderingInfo.layerCount = 1;
+            renderingInfo.colorAttachmentCount = static_cast<uint32_t>(compiled.colorAttachments.size());
+            renderingInfo.pColorAttachments = compiled.colorAttachments.data();
+            if (pass.depthAttachment.resource != NO_RESOURCE)
             {
-                indices.presentationFamily = i;
+                compiled.depthAttachment.imageView = resources[pass.depthAttachment.resource].view;
+                renderingInfo.pDepthAttachment = &compiled.depthAttachment;
             }
+            vkCmdBeginRendering(commandBuffer, &renderingInfo);
+        }
 
-            if (indices.isComplete())
-                break;
+        pass.record(commandBuffer);
 
-            i++;
+        if (rendering)
+        {
+            vkCmdEndRendering(commandBuffer);
         }
-
-        return indices;
     }
 
     /// <summary>
-    /// Fills out a "SwapChainSupportDetails" struct
+    /// Records the barriers after the last pass, which hand imported resources over in their final layouts and access.
     /// </summary>
-    /// <param name="device"></param>
-    /// <returns></returns>
-    SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device)
+    void executeFinalBarriers(VkCommandBuffer commandBuffer)
     {
-        SwapChainSupportDetails details;
-        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
-
-        uint32_t formatCount;
-        vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
-        if (formatCount != 0)
-        {
-            details.formats.resize(formatCount);
-            vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, details.formats.data());
-        }
-
-        uint32_t presentModeCount = 0;
-        vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, nullptr);
-        if (presentModeCount != 0)
-        {
-            details.presentModes.resize(presentModeCount);
-            vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, details.presentModes.data());
-        }
-        
-        return details;
+        recordBarriers(commandBuffer, finalBarriers);
     }
 
     /// <summary>
-    /// Enumerates through all available extension on given physical device, and checks to see if all of the requested extensions (in the const global vector) are present.
+    /// Retires the transient images and their memory.
     /// </summary>
-    /// <param name="physicalDevice"></param>
-    /// <returns></returns>
-    bool checkDeviceExtensionSupport(VkPhysicalDevice device)
+    void destroy()
     {
-        uint32_t extensionsCount = 0;
-        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionsCount, nullptr);
-        std::vector<VkExtensionProperties> availableExtensions(extensionsCount);
-        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionsCount, availableExtensions.data());
+        releaseTransientImages();
+    }
 
-        std::set<std::string>requiredExtensions(physicalDeviceExtensions.begin(), physicalDeviceExtensions.end());
+private:
+    struct Resource {
+        std::string name;
+        bool isImage = false;
+        bool imported = false;
+        bool output = false;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkImageAspectFlags aspect = 0;
+        VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+        VkPipelineStageFlags2 initialStages = VK_PIPELINE_STAGE_2_NONE;
+        VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags2 finalStages = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 finalAccess = VK_ACCESS_2_NONE;
+        // bound every frame for imported resources, set by "compile" for transient images
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VulkanHandle<VkImage, vkDestroyImage> ownedImage;
+        VulkanHandle<VkImageView, vkDestroyImageView> ownedView;
+        // first and last pass (in execution order) using it, and the stages and writes of all passes using it
+        uint32_t firstUse = NO_RESOURCE;
+        uint32_t lastUse = 0;
+        VkPipelineStageFlags2 usedStages = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+        // only ever an attachment that's neither loaded nor stored, its contents never have to leave the GPU's tile memory
+        bool memoryless = false;
+        // where a transient image sits in the memory block of its memory type
+        VkMemoryRequirements memoryRequirements{};
+        uint32_t memoryType = 0;
+        VkDeviceSize memoryOffset = 0;
+    };
 
-        // We have all the available extensions, and we have the required ones, so if we loop through all of the available ones and erase them from the vector of requestedExtensions
-        // then we can just check to see if the vector has anything left. If it's empty, that means we're good to go.
-        for (const auto& extension : availableExtensions)
+    struct Access {
+        uint32_t resource;
+        VkPipelineStageFlags2 stages;
+        VkAccessFlags2 access;
+        VkImageLayout layout;
+        bool write;
+        // false if the pass overwrites all of it, whatever was there before doesn't matter then
+        bool readsContents;
+    };
+
+    struct Attachment {
+        uint32_t resource = NO_RESOURCE;
+        uint32_t resolveTarget = NO_RESOURCE;
+        bool clear = false;
+        // depth tested against but never written, it stays in a read-only layout and isn't stored
+        bool readOnly = false;
+        VkClearValue clearValue{};
+    };
+
+    struct Pass {
+        std::string name;
+        std::function<void(VkCommandBuffer)> record;
+        // one per resource, using a resource twice merges the two
+        std::vector<Access> accesses;
+        std::vector<Attachment> colorAttachments;
+        Attachment depthAttachment;
+        VkRenderingFlags renderingFlags = 0;
+    };
+
+    // ranges of "imageBarriers" and "bufferBarriers" recorded by one vkCmdPipelineBarrier2
+    struct BarrierBatch {
+        uint32_t firstImageBarrier = 0;
+        uint32_t imageBarrierCount = 0;
+        uint32_t firstBufferBarrier = 0;
+        uint32_t bufferBarrierCount = 0;
+    };
+
+    struct CompiledPass {
+        uint32_t pass;
+        BarrierBatch barriers;
+        // image views are filled in when the pass is executed
+        std::vector<VkRenderingAttachmentInfo> colorAttachments;
+        VkRenderingAttachmentInfo depthAttachment{};
+    };
+
+    // what compiling knows about a resource at some point in the frame
+    struct ResourceState {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        // last write, or layout transition, and the stages that have read it since
+        VkPipelineStageFlags2 writeStages = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+        VkPipelineStageFlags2 readStages = VK_PIPELINE_STAGE_2_NONE;
+        // stages and access the last write has already been made visible to
+        VkPipelineStageFlags2 visibleStages = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 visibleAccess = VK_ACCESS_2_NONE;
+        // whether a pass this frame has written it yet
+        bool written = false;
+    };
+
+    static const VkAccessFlags2 WRITE_ACCESS = VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+        VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT |
+        VK_ACCESS_2_HOST_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+    static VkImageAspectFlags aspectForFormat(VkFormat format)
+    {
+        switch (format)
         {
-            requiredExtensions.erase(extension.extensionName);
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT;
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        default:
+            return VK_IMAGE_ASPECT_COLOR_BIT;
         }
-
-        return requiredExtensions.empty(); // If list is empty, they were all checked off.
     }
 
-    /// <summary>
-    /// Verifies a device is suitable for our program.
-    /// </summary>
-    /// <param name="device"></param>
-    /// <returns></returns>
-    bool isDeviceSuitable(VkPhysicalDevice device)
+    static VkImageUsageFlags usageForAccess(const Access& access)
     {
-        QueueFamilyIndices indices = findQueueFamilies(device);
-        bool extensionsSupported = checkDeviceExtensionSupport(device);
+        switch (access.layout)
+        {
+        case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+            return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+            return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        case VK_IMAGE_LAYOUT_GENERAL:
+            return VK_IMAGE_USAGE_STORAGE_BIT;
+        case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+            return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+            return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+            return (access.access & VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT) ? VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT : VK_IMAGE_USAGE_SAMPLED_BIT;
+        default:
+            return VK_IMAGE_USAGE_SAMPLED_BIT;
+        }
+    }
 
-        bool swapChainAcceptable = false;
-        if (extensionsSupported)
+    void addAccess(uint32_t pass, uint32_t resource, VkPipelineStageFlags2 stages, VkAccessFlags2 access, VkImageLayout layout, bool write, bool readsContents)
+    {
+        if (!resources[resource].isImage)
         {
-            SwapChainSupportDetails details = querySwapChainSupport(device);
-            swapChainAcceptable = !details.formats.empty() && !details.presentModes.empty();
+            layout = VK_IMAGE_LAYOUT_UNDEFINED;
         }
 
-        VkPhysicalDeviceFeatures supportedFeatures;
-        vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
+        for (Access& existing : passes[pass].accesses)
+        {
+            if (existing.resource != resource)
+                continue;
+
+            if (existing.layout != layout)
+            {
+                throw std::runtime_error("Render graph pass \"" + passes[pass].name + "\" uses \"" + resources[resource].name + "\" in two layouts.");
+            }
+            existing.stages |= stages;
+            existing.access |= access;
+            existing.write = existing.write || write;
+            existing.readsContents = existing.readsContents || readsContents;
+            return;
+        }
 
-        return indices.isComplete() && extensionsSupported && swapChainAcceptable && supportedFeatures.samplerAnisotropy;
+        passes[pass].accesses.push_back({ resource, stages, access, layout, write, readsContents });
     }
 
     /// <summary>
-    /// enumerates through physical devices available and picks one to use as the physical device.
+    /// Walks the passes backwards keeping track of which resources' current contents are still needed, starting
+    /// with the outputs. A pass that writes none of those is culled.
     /// </summary>
-    void pickPhysicalDevice()
+    void cullPasses()
     {
-        uint32_t deviceCount = 0;
-        vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
-        if (deviceCount == 0)
+        std::vector<bool> needed(resources.size());
+        for (size_t i = 0; i < resources.size(); i++)
         {
-            throw std::runtime_error("No Vulkan Physical Devices found.");
+            needed[i] = resources[i].output;
         }
-        std::vector<VkPhysicalDevice> devices(deviceCount);
-        vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
 
-        for (auto& device : devices)
+        std::vector<uint32_t> livePasses;
+        for (uint32_t pass = static_cast<uint32_t>(passes.size()); pass-- > 0;)
         {
-            if (isDeviceSuitable(device))
+            bool contributes = false;
+            for (const Access& access : passes[pass].accesses)
             {
-                physicalDevice = device;
-                break;
+                contributes = contributes || (access.write && needed[access.resource]);
+            }
+            if (!contributes)
+                continue;
+
+            livePasses.push_back(pass);
+            // what a pass overwrites isn't needed from earlier passes, what it reads is
+            for (const Access& access : passes[pass].accesses)
+            {
+                if (access.write && !access.readsContents)
+                    needed[access.resource] = false;
+            }
+            for (const Access& access : passes[pass].accesses)
+            {
+                if (access.readsContents)
+                    needed[access.resource] = true;
             }
         }
 
-        if (physicalDevice == VK_NULL_HANDLE)
+        compiledPasses.clear();
+        for (size_t i = livePasses.size(); i-- > 0;)
         {
-            throw std::runtime_error("No suitable physical devices found.");
+            CompiledPass compiled{};
+            compiled.pass = livePasses[i];
+            compiledPasses.push_back(compiled);
         }
+
+        stats.passCount = static_cast<uint32_t>(passes.size());
+        stats.culledPassCount = static_cast<uint32_t>(passes.size() - compiledPasses.size());
     }
 
     /// <summary>
-    /// Creates a logical device with queue families created based off of the "QueueFamilyIndices" struct. Hooks up validation laers in create info struct here as well.
+    /// Creates the transient images live passes use and places them in one memory block per memory type, biggest
+    /// first, each at the lowest offset where it doesn't overlap an image whose lifetime overlaps its own.
     /// </summary>
-    void createLogicalDevice()
+    void createTransientImages()
     {
-        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+        releaseTransientImages();
 
-        std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-        std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentationFamily.value() };
+        std::vector<uint32_t> transients;
+        for (uint32_t r = 0; r < resources.size(); r++)
+        {
+            Resource& resource = resources[r];
+            resource.firstUse = NO_RESOURCE;
+            resource.lastUse = 0;
+            resource.usedStages = VK_PIPELINE_STAGE_2_NONE;
+            resource.writeAccess = VK_ACCESS_2_NONE;
+
+            VkImageUsageFlags usage = 0;
+            for (uint32_t i = 0; i < compiledPasses.size(); i++)
+            {
+                for (const Access& access : passes[compiledPasses[i].pass].accesses)
+                {
+                    if (access.resource != r)
+                        continue;
+
+                    resource.firstUse = (std::min)(resource.firstUse, i);
+                    resource.lastUse = i;
+                    resource.usedStages |= access.stages;
+                    resource.writeAccess |= access.access & WRITE_ACCESS;
+                    usage |= usageForAccess(access);
+                }
+            }
 
-        float queuePriority = 1.0f;
+            // only culled passes use it
+            if (resource.imported || resource.firstUse == NO_RESOURCE)
+                continue;
 
-        for (uint32_t queueFamily : uniqueQueueFamilies)
-        {
-            VkDeviceQueueCreateInfo queueCreateInfo{};
-            queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-            queueCreateInfo.queueFamilyIndex = queueFamily;
-            queueCreateInfo.queueCount = 1;
-            queueCreateInfo.pQueuePriorities = &queuePriority;
-            queueCreateInfos.push_back(queueCreateInfo);
+            if (resource.memoryless)
+            {
+                usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+            }
+
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.extent = { extent.width, extent.height, 1 };
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.format = resource.format;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            imageInfo.usage = usage;
+            imageInfo.samples = resource.samples;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+            VkImage image;
+            if (vkCreateImage(device, &imageInfo, allocator, &image) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Unable to create render graph image \"" + resource.name + "\".");
+            }
+            resource.ownedImage = VulkanHandle<VkImage, vkDestroyImage>(*deletionQueue, image);
+            resource.image = image;
+            vkGetImageMemoryRequirements(device, image, &resource.memoryRequirements);
+            resource.memoryType = findMemoryType(resource.memoryRequirements.memoryTypeBits, resource.memoryless);
+            transients.push_back(r);
         }
 
-        VkPhysicalDeviceFeatures deviceFeatures{};
-        deviceFeatures.samplerAnisotropy = VK_TRUE;
+        std::sort(transients.begin(), transients.end(), [this](uint32_t a, uint32_t b) {
+            return resources[a].memoryRequirements.size > resources[b].memoryRequirements.size;
+        });
 
-        VkDeviceCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-        createInfo.pQueueCreateInfos = queueCreateInfos.data();
-        createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+        std::vector<VkDeviceSize> blockSizes(memoryProperties.memoryTypeCount);
 
-        createInfo.pEnabledFeatures = &deviceFeatures;
+        for (size_t i = 0; i < transients.size(); i++)
+        {
+            Resource& resource = resources[transients[i]];
+            VkDeviceSize alignment = resource.memoryRequirements.alignment;
+            VkDeviceSize size = resource.memoryRequirements.size;
+
+            // move past every conflicting image in the way until none is, offsets only grow so this ends
+            VkDeviceSize offset = 0;
+            bool moved = true;
+            while (moved)
+            {
+                moved = false;
+                for (size_t j = 0; j < i; j++)
+                {
+                    const Resource& placed = resources[transients[j]];
+                    if (placed.memoryType != resource.memoryType || !lifetimesOverlap(placed, resource))
+                        continue;
+
+                    VkDeviceSize placedEnd = placed.memoryOffset + placed.memoryRequirements.size;
+                    if (offset < placedEnd && placed.memoryOffset < offset + size)
+                    {
+                        offset = (placedEnd + alignment - 1) / alignment * alignment;
+                        moved = true;
+                    }
+                }
+            }
 
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(physicalDeviceExtensions.size());
-        createInfo.ppEnabledExtensionNames = physicalDeviceExtensions.data();
+            resource.memoryOffset = offset;
+            blockSizes[resource.memoryType] = (std::max)(blockSizes[resource.memoryType], offset + size);
+            stats.unaliasedTransientBytes += size;
+        }
 
-        if (enableValidationLayers)
+        std::vector<VkDeviceMemory> blocks(memoryProperties.memoryTypeCount, VK_NULL_HANDLE);
+        for (uint32_t type = 0; type < memoryProperties.memoryTypeCount; type++)
         {
-            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
-            createInfo.ppEnabledLayerNames = validationLayers.data();
+            if (blockSizes[type] == 0)
+                continue;
+
+            VkMemoryAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            allocInfo.allocationSize = blockSizes[type];
+            allocInfo.memoryTypeIndex = type;
+
+            if (vkAllocateMemory(device, &allocInfo, allocator, &blocks[type]) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Unable to allocate render graph memory.");
+            }
+            memoryBlocks.emplace_back(*deletionQueue, blocks[type]);
+            stats.transientBytes += blockSizes[type];
+            if (memoryProperties.memoryTypes[type].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
+            {
+                stats.lazyBytes += blockSizes[type];
+            }
         }
+
+        for (uint32_t r : transients)
         {
-            createInfo.enabledLayerCount = 0;
+            Resource& resource = resources[r];
+            vkBindImageMemory(device, resource.image, blocks[resource.memoryType], resource.memoryOffset);
+
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = resource.image;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = resource.format;
+            // views for attachments and sampling only see depth, the stencil of combined formats goes unused
+            viewInfo.subresourceRange.aspectMask = (resource.aspect & VK_IMAGE_ASPECT_DEPTH_BIT) ? static_cast<VkImageAspectFlags>(VK_IMAGE_ASPECT_DEPTH_BIT) : static_cast<VkImageAspectFlags>(resource.aspect);
+            viewInfo.subresourceRange.levelCount = 1;
+            viewInfo.subresourceRange.layerCount = 1;
+
+            VkImageView view;
+            if (vkCreateImageView(device, &viewInfo, allocator, &view) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Unable to create render graph image view \"" + resource.name + "\".");
+            }
+            resource.ownedView = VulkanHandle<VkImageView, vkDestroyImageView>(*deletionQueue, view);
+            resource.view = view;
         }
+    }
 
-        if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS)
+    void releaseTransientImages()
+    {
+        for (Resource& resource : resources)
         {
-            throw std::runtime_error("Logical device creation failed.");
-        }
+            if (resource.imported)
+                continue;
 
-        vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
-        vkGetDeviceQueue(device, indices.presentationFamily.value(), 0, &presentationQueue);
+            resource.ownedView.reset();
+            resource.ownedImage.reset();
+            resource.image = VK_NULL_HANDLE;
+            resource.view = VK_NULL_HANDLE;
+        }
+        memoryBlocks.clear();
     }
 
     /// <summary>
-    /// Uses "glfwCreateSurface" to create a VkSurfaceKHR. Populates private member "surface".
+    /// Device local memory type for a transient image, lazily allocated if it's "memoryless" and the device has that.
     /// </summary>
-    void createSurface()
+    uint32_t findMemoryType(uint32_t typeFilter, bool memoryless)
     {
-        if (glfwCreateWindowSurface(instance, window, nullptr, &surface))
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount && memoryless; i++)
         {
-            throw std::runtime_error("Failed to create window surface.");
+            if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT))
+            {
+                return i;
+            }
         }
-    }
-
-    VkShaderModule createShaderModule(const std::vector<char>& code) {
-        VkShaderModuleCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        createInfo.codeSize = code.size();
-        createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
 
-        VkShaderModule shaderModule;
-        if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create shader module!");
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+        {
+            if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+            {
+                return i;
+            }
         }
 
-        return shaderModule;
+        throw std::runtime_error("No device local memory for render graph images.");
+    }
+
+    static bool lifetimesOverlap(const Resource& a, const Resource& b)
+    {
+        return a.firstUse <= b.lastUse && b.firstUse <= a.lastUse;
+    }
+
+    static bool memoryOverlaps(const Resource& a, const Resource& b)
+    {
+        return a.memoryType == b.memoryType &&
+            a.memoryOffset < b.memoryOffset + b.memoryRequirements.size && b.memoryOffset < a.memoryOffset + a.memoryRequirements.size;
     }
 
     /// <summary>
-    /// Creates the vkPipelineLayout object. isn't dependent on too much outside information, it's mostly just pipeline configuration in here.
+    /// Simulates the frame resource by resource to find the barriers each live pass needs.
     /// </summary>
-    void createGraphicsPipeline()
+    void buildBarriers()
     {
-        auto vertShaderCode = readFile("./shaders/vert.spv");
-        auto fragShaderCode = readFile("./shaders/frag.spv");
+        imageBarriers.clear();
+        imageBarrierResources.clear();
+        bufferBarriers.clear();
+        bufferBarrierResources.clear();
 
-        VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-        VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+        std::vector<ResourceState> states(resources.size());
+        for (size_t r = 0; r < resources.size(); r++)
+        {
+            const Resource& resource = resources[r];
+            if (resource.imported)
+            {
+                states[r].writeStages = resource.initialStages;
+            }
+            else if (resource.image != VK_NULL_HANDLE)
+            {
+                // a transient image's first use waits for everything that used its memory before, earlier in the
+                // frame or in the frame before on this queue
+                for (const Resource& other : resources)
+                {
+                    if (!other.imported && other.image != VK_NULL_HANDLE && memoryOverlaps(resource, other))
+                    {
+                        states[r].writeStages |= other.usedStages;
+                        states[r].writeAccess |= other.writeAccess;
+                    }
+                }
+            }
+        }
 
-        VkPipelineShaderStageCreateInfo vertCreateInfo{};
-        vertCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        vertCreateInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-        vertCreateInfo.module = vertShaderModule;
-        vertCreateInfo.pName = "main";
+        for (uint32_t i = 0; i < compiledPasses.size(); i++)
+        {
+            CompiledPass& compiled = compiledPasses[i];
+            const Pass& pass = passes[compiled.pass];
 
-        VkPipelineShaderStageCreateInfo fragCreateInfo{};
-        fragCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        fragCreateInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-        fragCreateInfo.module = fragShaderModule;
-        fragCreateInfo.pName = "main";
+            compiled.barriers = beginBatch();
+            for (const Access& access : pass.accesses)
+            {
+                addBarrier(access, states[access.resource]);
+            }
+            endBatch(compiled.barriers);
 
-        VkPipelineShaderStageCreateInfo shaderStages[] = { vertCreateInfo, fragCreateInfo };
+            for (const Access& access : pass.accesses)
+            {
+                states[access.resource].written = states[access.resource].written || access.write;
+            }
+        }
 
-        auto bindingDescription = Vertex::getBindingDescription();
-        auto attributeDescriptions = Vertex::getAttributeDescriptions();
+        finalBarriers = beginBatch();
+        for (uint32_t r = 0; r < resources.size(); r++)
+        {
+            const Resource& resource = resources[r];
+            const ResourceState& state = states[r];
+            if (resource.isImage && resource.imported && resource.finalLayout != VK_IMAGE_LAYOUT_UNDEFINED && resource.finalLayout != state.layout)
+            {
+                pushBarrier(r, state.writeStages | state.readStages, state.writeAccess, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, state.layout, resource.finalLayout);
+            }
+            else if (!resource.isImage && resource.finalAccess != VK_ACCESS_2_NONE && state.written)
+            {
+                pushBarrier(r, state.writeStages, state.writeAccess, resource.finalStages, resource.finalAccess, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_UNDEFINED);
+            }
+        }
+        endBatch(finalBarriers);
+    }
 
-        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputInfo.vertexBindingDescriptionCount = 1;
-        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+    /// <summary>
+    /// Picks the load and store ops of every live pass's attachments, marks the transient images that never need
+    /// memory, and estimates the attachment traffic that results.
+    /// </summary>
+    void chooseAttachmentOps()
+    {
+        std::vector<bool> written(resources.size());
+        std::vector<bool> needsMemory(resources.size());
+        for (uint32_t i = 0; i < compiledPasses.size(); i++)
+        {
+            CompiledPass& compiled = compiledPasses[i];
+            const Pass& pass = passes[compiled.pass];
 
-        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-        inputAssembly.primitiveRestartEnable = VK_FALSE;
+            compiled.colorAttachments.clear();
+            for (const Attachment& attachment : pass.colorAttachments)
+            {
+                compiled.colorAttachments.push_back(renderingAttachment(attachment, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, i, written, needsMemory));
+            }
+            if (pass.depthAttachment.resource != NO_RESOURCE)
+            {
+                VkImageLayout layout = pass.depthAttachment.readOnly ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+                compiled.depthAttachment = renderingAttachment(pass.depthAttachment, layout, i, written, needsMemory);
+            }
 
-        /* 
-        * This is unecessary per below comment
-        * Leaving here in case I want to use it.
-        VkViewport viewport{};
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = (float)swapChainExtent.width;
-        viewport.height = (float)swapChainExtent.height;
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-        */
+            for (const Access& access : pass.accesses)
+            {
+                written[access.resource] = written[access.resource] || access.write;
 
-        VkPipelineViewportStateCreateInfo viewportState{};
-        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-        viewportState.viewportCount = 1;
-        viewportState.scissorCount = 1;
-        // The pointers to the viewport and scissor are left null here because
-        // having them as a dynamic state means that we are required to define the viewport(s) and scissor(s) at draw-time.
+                bool attachment = access.resource == pass.depthAttachment.resource;
+                for (const Attachment& color : pass.colorAttachments)
+                {
+                    attachment = attachment || access.resource == color.resource;
+                }
+                // sampled, copied, or the target of a resolve
+                if (!attachment)
+                    needsMemory[access.resource] = true;
+            }
+        }
 
-        VkPipelineRasterizationStateCreateInfo rasterizer{};
-        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-        rasterizer.depthClampEnable = VK_FALSE;
-        rasterizer.rasterizerDiscardEnable = VK_FALSE;
-        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-        rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-        rasterizer.depthBiasEnable = VK_FALSE;
-        rasterizer.lineWidth = 1.0f;
+        for (size_t r = 0; r < resources.size(); r++)
+        {
+            resources[r].memoryless = !resources[r].imported && !needsMemory[r];
+        }
+    }
 
-        VkPipelineMultisampleStateCreateInfo multisampling{};
-        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-        multisampling.sampleShadingEnable = VK_FALSE;
-        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    /// <summary>
+    /// Attachment of the pass at "index". It's loaded if it isn't cleared and an earlier pass wrote it, and stored
+    /// if a later pass reads it before anything overwrites it, or if it's an output nothing later overwrites.
+    /// </summary>
+    VkRenderingAttachmentInfo renderingAttachment(const Attachment& attachment, VkImageLayout layout, uint32_t index, const std::vector<bool>& written,
+        std::vector<bool>& needsMemory)
+    {
+        VkRenderingAttachmentInfo info{};
+        info.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        info.imageLayout = layout;
+        info.clearValue = attachment.clearValue;
+
+        if (attachment.clear)
+            info.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        else if (written[attachment.resource])
+            info.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        else
+            info.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 
-        VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-        colorBlendAttachment.blendEnable = VK_FALSE;
+        bool store = resources[attachment.resource].output;
+        bool decided = false;
+        for (uint32_t later = index + 1; later < compiledPasses.size() && !decided; later++)
+        {
+            for (const Access& access : passes[compiledPasses[later].pass].accesses)
+            {
+                if (access.resource != attachment.resource)
+                    continue;
 
-        VkPipelineColorBlendStateCreateInfo colorBlending{};
-        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-        colorBlending.logicOpEnable = VK_FALSE;
-        colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
-        colorBlending.attachmentCount = 1;
-        colorBlending.pAttachments = &colorBlendAttachment;
-        colorBlending.blendConstants[0] = 0.0f; // Optional
-        colorBlending.blendConstants[1] = 0.0f; // Optional
-        colorBlending.blendConstants[2] = 0.0f; // Optional
-        colorBlending.blendConstants[3] = 0.0f; // Optional
-
-        std::vector<VkDynamicState> dynamicStates =
-        {
-            VK_DYNAMIC_STATE_VIEWPORT,
-            VK_DYNAMIC_STATE_SCISSOR
-        };
-
-        VkPipelineDynamicStateCreateInfo dynamicState{};
-        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-        dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-        dynamicState.pDynamicStates = dynamicStates.data();
-
-        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutInfo.setLayoutCount = 1; // Optional
-        pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout; // Optional
-        pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-        pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
-
-        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+                store = access.readsContents;
+                decided = true;
+            }
+        }
+        info.storeOp = store ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        // nothing was written, so the contents in memory are still current whoever reads them next
+        if (attachment.readOnly)
         {
-            throw std::runtime_error("Unable to create graphics pipeline layout.");
+            store = false;
+            info.storeOp = VK_ATTACHMENT_STORE_OP_NONE;
         }
 
-        VkPipelineDepthStencilStateCreateInfo depthStencil{};
-        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-        depthStencil.depthTestEnable = VK_TRUE;
-        depthStencil.depthWriteEnable = VK_TRUE;
-        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-        depthStencil.depthBoundsTestEnable = VK_FALSE;
-        depthStencil.minDepthBounds = 0.0f; // Optional
-        depthStencil.maxDepthBounds = 1.0f; // Optional
-        depthStencil.stencilTestEnable = VK_FALSE;
-        depthStencil.front = {}; // Optional
-        depthStencil.back = {}; // Optional
-
-        VkGraphicsPipelineCreateInfo pipelineInfo{};
-        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipelineInfo.stageCount = 2;
-        pipelineInfo.pStages = shaderStages;
-        pipelineInfo.pVertexInputState = &vertexInputInfo;
-        pipelineInfo.pInputAssemblyState = &inputAssembly;
-        pipelineInfo.pViewportState = &viewportState;
-        pipelineInfo.pRasterizationState = &rasterizer;
-        pipelineInfo.pMultisampleState = &multisampling;
-        pipelineInfo.pDepthStencilState = &depthStencil; // Optional
-        pipelineInfo.pColorBlendState = &colorBlending;
-        pipelineInfo.pDynamicState = &dynamicState;
-        pipelineInfo.layout = pipelineLayout;
-        pipelineInfo.renderPass = renderPass;
-        pipelineInfo.subpass = 0; pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        VkDeviceSize size = imageBytes(resources[attachment.resource]);
+        if (info.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD)
+            stats.attachmentTrafficBytes += size;
+        if (store)
+            stats.attachmentTrafficBytes += size;
+        if (info.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD || store)
+            needsMemory[attachment.resource] = true;
 
-        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, static_cast<uint32_t>(1), &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS)
+        if (attachment.resolveTarget != NO_RESOURCE)
         {
-            throw std::runtime_error("Unable to create graphics pipeline.");
+            info.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+            info.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            stats.attachmentTrafficBytes += imageBytes(resources[attachment.resolveTarget]);
         }
-
-        vkDestroyShaderModule(device, vertShaderModule, nullptr);
-        vkDestroyShaderModule(device, fragShaderModule, nullptr);
+        return info;
     }
 
-    static std::vector<char> readFile(const std::string& filename)
+    /// <summary>
+    /// Rough size of an image at the current extent, for the traffic estimate.
+    /// </summary>
+    VkDeviceSize imageBytes(const Resource& resource) const
     {
-        std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-        if (!file.is_open())
+        VkDeviceSize texelBytes = 4;
+        switch (resource.format)
         {
-            throw std::runtime_error("Error reading file: " + filename);
+        case VK_FORMAT_D16_UNORM:
+            texelBytes = 2;
+            break;
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            texelBytes = 8;
+            break;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            texelBytes = 16;
+            break;
+        default:
+            break;
         }
-
-        size_t filesize = (size_t) file.tellg();
-        std::vector<char> buffer(filesize);
-
-        file.seekg(0);
-        file.read(buffer.data(), filesize);
-
-        file.close();
-        return buffer;
+        return static_cast<VkDeviceSize>(extent.width) * extent.height * resource.samples * texelBytes;
     }
 
-    void createRenderPass()
+    /// <summary>
+    /// Adds the barrier "access" needs, if any, to the current batch. Writes and layout changes wait for the last
+    /// write and every read since, reads only for the last write, and only if it isn't visible to them yet.
+    /// </summary>
+    void addBarrier(const Access& access, ResourceState& state)
     {
-        VkAttachmentDescription colorAttachment{};
-        colorAttachment.format = swapChainImageFormat;
-        colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-        colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-        VkAttachmentReference colorAttachmentRef{};
-        colorAttachmentRef.attachment = 0;
-        colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-        VkAttachmentDescription depthAttachment{};
-        depthAttachment.format = findDepthFormat();
-        depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-        depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-        VkAttachmentReference depthAttachmentRef{};
-        depthAttachmentRef.attachment = 1;
-        depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-        VkSubpassDescription subpass{};
-        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-        subpass.colorAttachmentCount = 1;
-        subpass.pColorAttachments = &colorAttachmentRef;
-        subpass.pDepthStencilAttachment = &depthAttachmentRef;
-
-        VkSubpassDependency dependency{};
-        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-        dependency.dstSubpass = 0;
-        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-        dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-        dependency.srcAccessMask = 0;
-        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-
-        std::array <VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
+        bool layoutChange = resources[access.resource].isImage && access.layout != state.layout;
+        if (access.write || layoutChange)
+        {
+            VkPipelineStageFlags2 srcStages = state.writeStages | state.readStages;
+            if (srcStages != VK_PIPELINE_STAGE_2_NONE || layoutChange)
+            {
+                // contents nobody reads can be thrown away instead of transitioned
+                VkImageLayout oldLayout = access.readsContents ? state.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+                pushBarrier(access.resource, srcStages, state.writeAccess, access.stages, access.access, oldLayout, access.layout);
+            }
 
-        VkRenderPassCreateInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-        renderPassInfo.attachmentCount = 2;
-        renderPassInfo.pAttachments = attachments.data();
-        renderPassInfo.subpassCount = 1;
-        renderPassInfo.pSubpasses = &subpass;
-        renderPassInfo.dependencyCount = 1;
-        renderPassInfo.pDependencies = &dependency;
+            // a layout transition counts as a write, already made visible to this access by its barrier.
+            // what the access writes itself isn't visible to anything yet, not even to the same stages in later passes
+            state.layout = access.layout;
+            state.writeStages = access.stages;
+            state.writeAccess = access.access & WRITE_ACCESS;
+            state.readStages = access.write ? VK_PIPELINE_STAGE_2_NONE : access.stages;
+            state.visibleStages = access.write ? VK_PIPELINE_STAGE_2_NONE : access.stages;
+            state.visibleAccess = access.write ? VK_ACCESS_2_NONE : access.access;
+            return;
+        }
 
-        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS)
+        bool visible = (access.stages & ~state.visibleStages) == 0 && (access.access & ~state.visibleAccess) == 0;
+        if (state.writeStages != VK_PIPELINE_STAGE_2_NONE && !visible)
         {
-            throw std::runtime_error("Unable to create render pass.");
+            pushBarrier(access.resource, state.writeStages, state.writeAccess, access.stages, access.access, state.layout, state.layout);
+            state.visibleStages |= access.stages;
+            state.visibleAccess |= access.access;
         }
+        state.readStages |= access.stages;
     }
 
-    void createFramebuffers()
+    void pushBarrier(uint32_t resource, VkPipelineStageFlags2 srcStages, VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStages, VkAccessFlags2 dstAccess,
+        VkImageLayout oldLayout, VkImageLayout newLayout)
     {
-        swapChainFramebuffers.resize(swapChainImageViews.size());
-
-        for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-            
-            std::array<VkImageView, 2> attachments = {
-                swapChainImageViews[i],
-                depthImageView
-            };
+        if (resources[resource].isImage)
+        {
+            VkImageMemoryBarrier2 barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+            barrier.srcStageMask = srcStages;
+            barrier.srcAccessMask = srcAccess;
+            barrier.dstStageMask = dstStages;
+            barrier.dstAccessMask = dstAccess;
+            barrier.oldLayout = oldLayout;
+            barrier.newLayout = newLayout;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.subresourceRange.aspectMask = resources[resource].aspect;
+            barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+            barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+            imageBarriers.push_back(barrier);
+            imageBarrierResources.push_back(resource);
+        }
+        else
+        {
+            VkBufferMemoryBarrier2 barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+            barrier.srcStageMask = srcStages;
+            barrier.srcAccessMask = srcAccess;
+            barrier.dstStageMask = dstStages;
+            barrier.dstAccessMask = dstAccess;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.offset = 0;
+            barrier.size = VK_WHOLE_SIZE;
+            bufferBarriers.push_back(barrier);
+            bufferBarrierResources.push_back(resource);
+        }
+    }
 
-            VkFramebufferCreateInfo framebufferInfo{};
-            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-            framebufferInfo.renderPass = renderPass;
-            framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-            framebufferInfo.pAttachments = attachments.data();
-            framebufferInfo.width = swapChainExtent.width;
-            framebufferInfo.height = swapChainExtent.height;
-            framebufferInfo.layers = 1;
+    BarrierBatch beginBatch() const
+    {
+        BarrierBatch batch;
+        batch.firstImageBarrier = static_cast<uint32_t>(imageBarriers.size());
+        batch.firstBufferBarrier = static_cast<uint32_t>(bufferBarriers.size());
+        return batch;
+    }
 
-            if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
-                throw std::runtime_error("failed to create framebuffer!");
-            }
+    void endBatch(BarrierBatch& batch)
+    {
+        batch.imageBarrierCount = static_cast<uint32_t>(imageBarriers.size()) - batch.firstImageBarrier;
+        batch.bufferBarrierCount = static_cast<uint32_t>(bufferBarriers.size()) - batch.firstBufferBarrier;
+        stats.barrierCount += batch.imageBarrierCount + batch.bufferBarrierCount;
+        if (batch.imageBarrierCount + batch.bufferBarrierCount > 0)
+        {
+            stats.barrierBatchCount++;
         }
     }
 
-    void createCommandPool()
+    void recordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch)
     {
-        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
-
-        VkCommandPoolCreateInfo poolInfo{};
-        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+        if (batch.imageBarrierCount == 0 && batch.bufferBarrierCount == 0)
+            return;
 
-        if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
+        // imported resources can be different ones every frame
+        for (uint32_t i = batch.firstImageBarrier; i < batch.firstImageBarrier + batch.imageBarrierCount; i++)
         {
-            throw std::runtime_error("Unablw to create command pool.");
+            imageBarriers[i].image = resources[imageBarrierResources[i]].image;
+        }
+        for (uint32_t i = batch.firstBufferBarrier; i < batch.firstBufferBarrier + batch.bufferBarrierCount; i++)
+        {
+            bufferBarriers[i].buffer = resources[bufferBarrierResources[i]].buffer;
         }
+
+        VkDependencyInfo dependencyInfo{};
+        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependencyInfo.imageMemoryBarrierCount = batch.imageBarrierCount;
+        dependencyInfo.pImageMemoryBarriers = imageBarriers.data() + batch.firstImageBarrier;
+        dependencyInfo.bufferMemoryBarrierCount = batch.bufferBarrierCount;
+        dependencyInfo.pBufferMemoryBarriers = bufferBarriers.data() + batch.firstBufferBarrier;
+        vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
     }
 
-    void createCommandBuffers()
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    const VkAllocationCallbacks* allocator = nullptr;
+    DeletionQueue* deletionQueue = nullptr;
+    VkExtent2D extent{};
+
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    // live passes in execution order
+    std::vector<CompiledPass> compiledPasses;
+    std::vector<VkImageMemoryBarrier2> imageBarriers;
+    std::vector<uint32_t> imageBarrierResources;
+    std::vector<VkBufferMemoryBarrier2> bufferBarriers;
+    std::vector<uint32_t> bufferBarrierResources;
+    BarrierBatch finalBarriers;
+    std::vector<VulkanHandle<VkDeviceMemory, vkFreeMemory>> memoryBlocks;
+    RenderGraphStats stats;
+};
+
+/// <summary>
+/// What one binding of a descriptor set points at. Buffer bindings leave the image fields null and the other way around.
+/// </summary>
+struct DescriptorBinding {
+    uint32_t binding = 0;
+    VkDescriptorType type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize range = 0;
+    VkImageView imageView = VK_NULL_HANDLE;
+    VkSampler sampler = VK_NULL_HANDLE;
+    VkImageLayout imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    static DescriptorBinding forBuffer(uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
     {
-        commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+        DescriptorBinding result{};
+        result.binding = binding;
+        result.type = type;
+        result.buffer = buffer;
+        result.offset = offset;
+        result.range = range;
+        return result;
+    }
 
-        VkCommandBufferAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.commandPool = commandPool;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandBufferCount = (uint32_t) commandBuffers.size();
+    static DescriptorBinding forImage(uint32_t binding, VkDescriptorType type, VkImageView imageView, VkSampler sampler, VkImageLayout imageLayout)
+    {
+        DescriptorBinding result{};
+        result.binding = binding;
+        result.type = type;
+        result.imageView = imageView;
+        result.sampler = sampler;
+        result.imageLayout = imageLayout;
+        return result;
+    }
 
-        if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate command buffers!");
-        }
+    bool operator==(const DescriptorBinding& other) const {
+        return binding == other.binding && type == other.type && buffer == other.buffer && offset == other.offset && range == other.range
+            && imageView == other.imageView && sampler == other.sampler && imageLayout == other.imageLayout;
     }
+};
 
-    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
-    {
-        VkCommandBufferBeginInfo beginInfo{};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        beginInfo.flags = 0; // Optional
-        beginInfo.pInheritanceInfo = nullptr; // Optional
+/// <summary>
+/// A primary command buffer recorded for one swapchain image and frame in flight, and what it was recorded with.
+/// </summary>
+struct CachedCommandBuffer {
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    bool valid = false;
+    uint32_t instanceCount = 0;
+    uint32_t dynamicOffsets[2] = {};
+    uint32_t instanceUniformOffset = 0;
+};
 
-        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
-            throw std::runtime_error("failed to begin recording command buffer!");
-        }
+/// <summary>
+/// One slice of the frame's draws, recorded into its own secondary command buffer by whichever job thread picks it up.
+/// Command pools can only be used by one thread at a time, so each slice has its own per frame in flight.
+/// </summary>
+struct RecordSlice {
+    std::array<VkCommandPool, MAX_FRAMES_IN_FLIGHT> commandPools{};
+    std::array<VkCommandBuffer, MAX_FRAMES_IN_FLIGHT> commandBuffers{};
+};
 
-        VkRenderPassBeginInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = renderPass;
-        renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
-        renderPassInfo.renderArea.offset = { 0, 0 };
-        renderPassInfo.renderArea.extent = swapChainExtent;
-        std::array<VkClearValue, 2> clearValues{};
-        clearValues[0].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
-        clearValues[1].depthStencil = { 1.0f, 0 };
-        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-        renderPassInfo.pClearValues = clearValues.data();
+/// <summary>
+/// What the record jobs need to know about the frame they're recording, filled in by the main thread before starting them.
+/// </summary>
+struct RecordJob {
+    uint32_t imageIndex;
+    // camera and the first draw's "DrawUniforms", the other draws' follow "drawUniformStride" bytes apart
+    uint32_t dynamicOffsets[2];
+    uint32_t drawUniformStride;
+    // "InstanceUniforms" in the uniform ring, GPU-driven rendering only
+    uint32_t instanceUniformOffset;
+    uint32_t instanceCount;
+    uint32_t instancesPerDraw;
+    uint32_t drawCount;
+};
 
-        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+/// <summary>
+/// One binding's worth of data for a descriptor update template. A packed array of these, one per binding in the
+/// order the layout declares them, is everything "vkUpdateDescriptorSetWithTemplate" needs.
+/// </summary>
+union DescriptorInfo {
+    VkDescriptorBufferInfo buffer;
+    VkDescriptorImageInfo image;
+};
 
-        VkBuffer vertexBuffers[] = { vertexBuffer };
-        VkDeviceSize offsets[] = { 0 };
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-        vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+/// <summary>
+/// A descriptor set layout and the update template generated from the same binding list. The template reads
+/// the DescriptorInfo for bindings[i] from offset i * sizeof(DescriptorInfo).
+/// </summary>
+struct DescriptorLayout {
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    VkDescriptorUpdateTemplate updateTemplate = VK_NULL_HANDLE;
+    std::vector<uint32_t> bindings;
+};
 
-        VkViewport viewport{};
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = static_cast<float>(swapChainExtent.width);
-        viewport.height = static_cast<float>(swapChainExtent.height);
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+/// <summary>
+/// A descriptor set's layout and contents, two equal keys can share one set.
+/// </summary>
+struct DescriptorSetKey {
+    VkDescriptorSetLayout layout;
+    std::vector<DescriptorBinding> bindings;
 
-        VkRect2D scissor{};
-        scissor.offset = { 0, 0 };
-        scissor.extent = swapChainExtent;
-        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    bool operator==(const DescriptorSetKey& other) const {
+        return layout == other.layout && bindings == other.bindings;
+    }
+};
+
+namespace std {
+    template<> struct hash<DescriptorSetKey> {
+        size_t operator()(DescriptorSetKey const& key) const {
+            // boost style hash_combine over every field
+            size_t seed = hash<uint64_t>()(reinterpret_cast<uint64_t>(key.layout));
+            auto combine = [&seed](uint64_t value) {
+                seed ^= hash<uint64_t>()(value) + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+            };
+            for (const DescriptorBinding& binding : key.bindings) {
+                combine(binding.binding);
+                combine(binding.type);
+                combine(reinterpret_cast<uint64_t>(binding.buffer));
+                combine(binding.offset);
+                combine(binding.range);
+                combine(reinterpret_cast<uint64_t>(binding.imageView));
+                combine(reinterpret_cast<uint64_t>(binding.sampler));
+                combine(binding.imageLayout);
+            }
+            return seed;
+        }
+    };
+}
 
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, nullptr);
+/// <summary>
+/// A list of descriptor pools that sets are allocated from. When the current pool runs out, another one is taken from
+/// "freePools" or created, each new pool twice as big as the one before. Resetting gives every pool back at once.
+/// </summary>
+struct DescriptorAllocator {
+    VkDescriptorPool currentPool = VK_NULL_HANDLE;
+    // pools sets have been allocated from, including the current one
+    std::vector<VkDescriptorPool> usedPools;
+    // pools that have been reset and are ready to be used again
+    std::vector<VkDescriptorPool> freePools;
+    uint32_t setsPerPool = 32;
+};
 
-        vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+#ifdef NDEBUG
+const bool enableValidationLayers = false;
+#else
+const bool enableValidationLayers = true;
+#endif
 
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame + 2], 0, nullptr);
+// allocation tracking is compiled in for debug builds only, define ENABLE_ALLOCATION_TRACKING=1 to get it in a release build
+#ifndef ENABLE_ALLOCATION_TRACKING
+#ifdef NDEBUG
+#define ENABLE_ALLOCATION_TRACKING 0
+#else
+#define ENABLE_ALLOCATION_TRACKING 1
+#endif
+#endif
 
-        vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
 
-        vkCmdEndRenderPass(commandBuffer);
+#if ENABLE_ALLOCATION_TRACKING
+/// <summary>
+/// Allocations made while frame tracking is on, counted per site. Sites are the names of the innermost
+/// PROFILE_SCOPE/ALLOCATION_SITE on the allocating thread.
+/// </summary>
+struct AllocationSiteStats {
+    std::atomic<const char*> site{ nullptr };
+    std::atomic<uint64_t> count{ 0 };
+    std::atomic<uint64_t> bytes{ 0 };
+};
 
-        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-            throw std::runtime_error("failed to record command buffer!");
-        }
+/// <summary>
+/// Counts heap allocations from the global operator new and from Vulkan's host allocation callbacks.
+/// Everything is fixed size and atomic, recording an allocation can't allocate itself.
+/// </summary>
+class AllocationTracker {
+public:
+    static const size_t MAX_SITES = 128;
+
+    static AllocationTracker& get()
+    {
+        static AllocationTracker tracker;
+        return tracker;
     }
 
-    void createSyncObjects()
+    static const char*& currentSite()
     {
-        imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+        thread_local const char* site = nullptr;
+        return site;
+    }
 
-        VkSemaphoreCreateInfo semaphoreInfo{};
-        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-        VkFenceCreateInfo fenceInfo{};
-        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    void setEnabled(bool value) { enabled = value; }
+    bool isEnabled() const { return enabled; }
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    void record(size_t bytes)
+    {
+        if (!enabled.load(std::memory_order_relaxed))
+            return;
+
+        totalCount++;
+        totalBytes += bytes;
+
+        if (!inFrame.load(std::memory_order_relaxed))
+            return;
+
+        frameCount++;
+        frameBytes += bytes;
+
+        const char* site = currentSite() != nullptr ? currentSite() : "(outside any scope)";
+        for (AllocationSiteStats& stats : sites)
         {
-            if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-                vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-                vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS)
+            const char* existing = stats.site.load();
+            if (existing == nullptr && stats.site.compare_exchange_strong(existing, site))
+                existing = site;
+
+            if (existing == site)
             {
-                throw std::runtime_error("failed to create synchronization objects for a frame!");
+                stats.count++;
+                stats.bytes += bytes;
+                return;
             }
         }
+        droppedSites++;
     }
 
-    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+    void beginFrame()
     {
-        VkPhysicalDeviceMemoryProperties memProperties;
-        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-
-        for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-            if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-                return i;
-            }
-        }
-
-        throw std::runtime_error("failed to find suitable memory type!");
+        frameCount = 0;
+        frameBytes = 0;
+        inFrame = true;
     }
 
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+    void endFrame(uint64_t& count, uint64_t& bytes)
     {
-        VkCommandBufferAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandPool = commandPool;
-        allocInfo.commandBufferCount = 1;
-
-        VkCommandBuffer commandBuffer;
-        vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-
-        VkCommandBufferBeginInfo beginInfo{};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        inFrame = false;
+        count = frameCount;
+        bytes = frameBytes;
+    }
 
-        vkBeginCommandBuffer(commandBuffer, &beginInfo);
-        VkBufferCopy copyRegion{};
-        copyRegion.srcOffset = 0; // Optional
-        copyRegion.dstOffset = 0; // Optional
-        copyRegion.size = size;
-        vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-        vkEndCommandBuffer(commandBuffer);
+    /// <summary>
+    /// Prints the sites that allocated inside tracked frames, most allocations first.
+    /// </summary>
+    void printSites(std::ostream& out) const
+    {
+        std::vector<std::pair<uint64_t, size_t>> order;
+        for (size_t i = 0; i < MAX_SITES && sites[i].site.load() != nullptr; i++)
+            order.push_back({ sites[i].count.load(), i });
+        std::sort(order.rbegin(), order.rend());
+
+        for (const auto& [count, i] : order)
+            out << "  " << sites[i].site.load() << ": " << count << " allocation(s), " << sites[i].bytes.load() << " bytes\n";
+        if (droppedSites > 0)
+            out << "  (" << droppedSites << " allocation(s) from sites that didn't fit the table)\n";
+    }
 
-        VkSubmitInfo submitInfo{};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffer;
+    uint64_t totalAllocations() const { return totalCount; }
+    uint64_t totalAllocatedBytes() const { return totalBytes; }
 
-        vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-        vkQueueWaitIdle(graphicsQueue);
+private:
+    AllocationTracker() = default;
+
+    std::atomic<bool> enabled{ false };
+    std::atomic<bool> inFrame{ false };
+    std::atomic<uint64_t> totalCount{ 0 };
+    std::atomic<uint64_t> totalBytes{ 0 };
+    std::atomic<uint64_t> frameCount{ 0 };
+    std::atomic<uint64_t> frameBytes{ 0 };
+    std::atomic<uint64_t> droppedSites{ 0 };
+    std::array<AllocationSiteStats, MAX_SITES> sites;
+};
 
-        vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+/// <summary>
+/// Names the allocations made on this thread until the end of the enclosing scope.
+/// </summary>
+class AllocationSite {
+public:
+    explicit AllocationSite(const char* name) : previous(AllocationTracker::currentSite())
+    {
+        AllocationTracker::currentSite() = name;
     }
 
-    void createIndexBuffer()
+    ~AllocationSite()
     {
-        VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+        AllocationTracker::currentSite() = previous;
+    }
 
-        void* data;
-        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, indices.data(), (size_t)bufferSize);
-        vkUnmapMemory(device, stagingBufferMemory);
+private:
+    const char* previous;
+};
 
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+// the helpers stay out of line, a delete inlined down to free would look mismatched against the operator new it pairs with
+#ifdef _MSC_VER
+#define ALLOCATION_NOINLINE __declspec(noinline)
+#else
+#define ALLOCATION_NOINLINE __attribute__((noinline))
+#endif
 
-        copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+static ALLOCATION_NOINLINE void* allocateTracked(size_t size, size_t alignment) noexcept
+{
+    AllocationTracker::get().record(size);
+    if (size == 0)
+        size = 1;
+    if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+        return std::malloc(size);
+#ifdef _MSC_VER
+    return _aligned_malloc(size, alignment);
+#else
+    // aligned_alloc wants a size that's a multiple of the alignment
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+}
 
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
+static ALLOCATION_NOINLINE void releaseTracked(void* memory, size_t alignment) noexcept
+{
+#ifdef _MSC_VER
+    if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+    {
+        _aligned_free(memory);
+        return;
     }
+#else
+    (void)alignment;
+#endif
+    std::free(memory);
+}
 
-    void createVertexBuffer() {
-        VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+void* operator new(size_t size)
+{
+    if (void* memory = allocateTracked(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__))
+        return memory;
+    throw std::bad_alloc();
+}
 
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
 
-        void* data;
-        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, vertices.data(), (size_t)bufferSize);
-        vkUnmapMemory(device, stagingBufferMemory);
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    if (void* memory = allocateTracked(size, static_cast<size_t>(alignment)))
+        return memory;
+    throw std::bad_alloc();
+}
 
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
 
-        copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return allocateTracked(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
 
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
-    }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return allocateTracked(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
 
-    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
-    {
-        VkBufferCreateInfo bufferInfo{};
-        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        bufferInfo.size = size;
-        bufferInfo.usage = usage;
-        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return allocateTracked(size, static_cast<size_t>(alignment));
+}
 
-        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create buffer!");
-        }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return allocateTracked(size, static_cast<size_t>(alignment));
+}
 
-        VkMemoryRequirements memRequirements;
-        vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+void operator delete(void* memory) noexcept
+{
+    releaseTracked(memory, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+void operator delete[](void* memory) noexcept
+{
+    releaseTracked(memory, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
 
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate buffer memory!");
-        }
+void operator delete(void* memory, size_t) noexcept
+{
+    releaseTracked(memory, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
 
-        vkBindBufferMemory(device, buffer, bufferMemory, 0);
-    }
+void operator delete[](void* memory, size_t) noexcept
+{
+    releaseTracked(memory, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
 
-    void createDescriptorSetLayout()
-    {
-        VkDescriptorSetLayoutBinding uboLayoutBinding{};
-        uboLayoutBinding.binding = 0;
-        uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        uboLayoutBinding.descriptorCount = 1;
-        uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-        uboLayoutBinding.pImmutableSamplers = nullptr;
-
-        VkDescriptorSetLayoutBinding samplerLayoutBinding{};
-        samplerLayoutBinding.binding = 1;
-        samplerLayoutBinding.descriptorCount = 1;
-        samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        samplerLayoutBinding.pImmutableSamplers = nullptr;
-        samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-        std::array<VkDescriptorSetLayoutBinding, 2> bindings = { uboLayoutBinding, samplerLayoutBinding };
-        VkDescriptorSetLayoutCreateInfo layoutInfo{};
-        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-        layoutInfo.pBindings = bindings.data();
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+    releaseTracked(memory, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
 
-        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create descriptor set layout!");
-        }
-    }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+    releaseTracked(memory, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
 
-    void createUniformBuffers()
-    {
-        VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+void operator delete(void* memory, std::align_val_t alignment) noexcept
+{
+    releaseTracked(memory, static_cast<size_t>(alignment));
+}
 
-        // set size of firstUBO vector to the number of frames in flight
-        firstUniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-        firstUniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-        firstUniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+void operator delete[](void* memory, std::align_val_t alignment) noexcept
+{
+    releaseTracked(memory, static_cast<size_t>(alignment));
+}
 
-        // set the size of the second UBO vector to the number of frames in flight
-        secondUniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-        secondUniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-        secondUniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+void operator delete(void* memory, size_t, std::align_val_t alignment) noexcept
+{
+    releaseTracked(memory, static_cast<size_t>(alignment));
+}
 
-        // for each frame in flight create a memory buffer for the the first and second UBOs 
-        // and then map that memory to GPU memory
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-        {
-            // first UBO
-            createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, firstUniformBuffers[i], firstUniformBuffersMemory[i]);
+void operator delete[](void* memory, size_t, std::align_val_t alignment) noexcept
+{
+    releaseTracked(memory, static_cast<size_t>(alignment));
+}
 
-            //second UBO
-            createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, secondUniformBuffers[i], secondUniformBuffersMemory[i]);
+void operator delete(void* memory, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    releaseTracked(memory, static_cast<size_t>(alignment));
+}
 
-            // first mapped UBO
-            vkMapMemory(device, firstUniformBuffersMemory[i], 0, bufferSize, 0, &firstUniformBuffersMapped[i]);
+void operator delete[](void* memory, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    releaseTracked(memory, static_cast<size_t>(alignment));
+}
 
-            // second mapped UBO
-            vkMapMemory(device, secondUniformBuffersMemory[i], 0, bufferSize, 0, &secondUniformBuffersMapped[i]);
-        }
-    }
+/// <summary>
+/// Stored right in front of every block handed to Vulkan, realloc needs the old size and free the original pointer.
+/// </summary>
+struct VulkanAllocationHeader {
+    void* original;
+    size_t size;
+};
 
-    void createDescriptorPool()
-    {
-        // this array describes DESCRIPTORS, not descriptor sets. 
-        // it is an array that describes how many of each type of descriptor we'll be allocating
-        std::array<VkDescriptorPoolSize, 2> poolSizes{};
-        poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT * 2);
-        poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT * 2);
+static void* VKAPI_PTR trackedVulkanAllocation(void* /*pUserData*/, size_t size, size_t alignment, VkSystemAllocationScope /*allocationScope*/)
+{
+    AllocationTracker::get().record(size);
 
-        VkDescriptorPoolCreateInfo poolInfo{};
-        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        poolInfo.poolSizeCount = poolSizes.size();
-        poolInfo.pPoolSizes = poolSizes.data();
-        // max sets is 4 here since we are creating two descriptor sets for each object (an MVP UBO and an ImageSampler for each)
-        // and then two of each of those for each frame in flight
-        poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT * 2);
+    alignment = (std::max)(alignment, alignof(VulkanAllocationHeader));
+    void* original = std::malloc(size + alignment + sizeof(VulkanAllocationHeader));
+    if (original == nullptr)
+        return nullptr;
 
-        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create descriptor pool!");
-        }
+    uintptr_t aligned = (reinterpret_cast<uintptr_t>(original) + sizeof(VulkanAllocationHeader) + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+    reinterpret_cast<VulkanAllocationHeader*>(aligned)[-1] = { original, size };
+    return reinterpret_cast<void*>(aligned);
+}
+
+static void VKAPI_PTR trackedVulkanFree(void* /*pUserData*/, void* pMemory)
+{
+    if (pMemory != nullptr)
+        std::free(static_cast<VulkanAllocationHeader*>(pMemory)[-1].original);
+}
+
+static void* VKAPI_PTR trackedVulkanReallocation(void* pUserData, void* pOriginal, size_t size, size_t alignment, VkSystemAllocationScope allocationScope)
+{
+    if (pOriginal == nullptr)
+        return trackedVulkanAllocation(pUserData, size, alignment, allocationScope);
+    if (size == 0)
+    {
+        trackedVulkanFree(pUserData, pOriginal);
+        return nullptr;
     }
 
-    void createDescriptorSets()
+    void* memory = trackedVulkanAllocation(pUserData, size, alignment, allocationScope);
+    if (memory != nullptr)
     {
-        // four total descriptor set layouts because I will be creating four descriptor sets
-        // two for descriptor set 1 and 2, and two of each of those for each frame in flight.
-        // this is just an array of copies of the descriptor set layout (UBO and ImageSampler layout)
-        // since VkAllocateDescriptorSets requires that the VkDescriptorSetAllocateInfo struct has a pointer to every layout required for each descriptor set being allocated.
-        // Yes, it's a bit redundant here.
-        std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT * 2, descriptorSetLayout);
+        memcpy(memory, pOriginal, (std::min)(size, static_cast<VulkanAllocationHeader*>(pOriginal)[-1].size));
+        trackedVulkanFree(pUserData, pOriginal);
+    }
+    return memory;
+}
 
-        VkDescriptorSetAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        allocInfo.descriptorPool = descriptorPool;
-        // we're allocating a total of 4 descriptor sets. 2 for each object
-        allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT * 2);
-        allocInfo.pSetLayouts = layouts.data();
+#define ALLOCATION_SITE(name) AllocationSite PROFILE_CONCAT(allocationSite, __LINE__)(name)
+#else
+#define ALLOCATION_SITE(name)
+#endif
 
-        // again, 2 for each object here
-        descriptorSets.resize(MAX_FRAMES_IN_FLIGHT * 2);
-        if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate descriptor sets!");
-        }
+// profiling is compiled in for debug builds only, define ENABLE_PROFILING=1 to profile a release build
+#ifndef ENABLE_PROFILING
+#ifdef NDEBUG
+#define ENABLE_PROFILING 0
+#else
+#define ENABLE_PROFILING 1
+#endif
+#endif
 
-        // again, four
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT * 2; i++) {
-            VkDescriptorBufferInfo bufferInfo{};
-            // this syntax is goofy rn but this is what we doin
-            bufferInfo.buffer = (i < 2 ? firstUniformBuffers[i] : secondUniformBuffers[i - 2]);
-            bufferInfo.offset = 0;
-            bufferInfo.range = sizeof(UniformBufferObject);
+#if ENABLE_PROFILING
+/// <summary>
+/// One complete ("X") event in the Chrome trace format, times in microseconds since the recorder was created.
+/// </summary>
+struct TraceEvent {
+    const char* name;
+    uint32_t threadId;
+    double startUs;
+    double durationUs;
+};
 
-            VkDescriptorImageInfo imageInfo{};
-            imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            imageInfo.imageView = textureImageView;
-            imageInfo.sampler = textureSampler;
+/// <summary>
+/// Collects CPU scopes from every thread and GPU scopes from the renderer, and writes them out as Chrome trace JSON
+/// (chrome://tracing or ui.perfetto.dev). Nothing is recorded until it's enabled. Each thread appends to a buffer of
+/// its own, reserved when the thread records its first event, so recording neither locks nor allocates after that.
+/// Events past a buffer's capacity are dropped.
+/// </summary>
+class TraceRecorder {
+public:
+    // thread id the GPU scopes are shown under
+    static const uint32_t GPU_THREAD_ID = 0;
 
-            std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+    static TraceRecorder& get()
+    {
+        static TraceRecorder recorder;
+        return recorder;
+    }
 
-            descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[0].dstSet = descriptorSets[i];
-            descriptorWrites[0].dstBinding = 0;
-            descriptorWrites[0].dstArrayElement = 0;
-            descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            descriptorWrites[0].descriptorCount = 1;
-            descriptorWrites[0].pBufferInfo = &bufferInfo;
+    void setEnabled(bool value) { enabled = value; }
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
 
-            descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[1].dstSet = descriptorSets[i];
-            descriptorWrites[1].dstBinding = 1;
-            descriptorWrites[1].dstArrayElement = 0;
-            descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            descriptorWrites[1].descriptorCount = 1;
-            descriptorWrites[1].pImageInfo = &imageInfo;
+    double nowUs() const
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+    }
 
-            vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
-        }
+    /// <summary>
+    /// Converts a reading of the clock steady_clock runs on (QueryPerformanceCounter on Windows, CLOCK_MONOTONIC
+    /// elsewhere) to the recorder's time.
+    /// </summary>
+    double hostTicksToUs(uint64_t ticks) const
+    {
+#ifdef _WIN32
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        double ticksUs = static_cast<double>(ticks) * 1000000.0 / static_cast<double>(frequency.QuadPart);
+#else
+        double ticksUs = static_cast<double>(ticks) / 1000.0;
+#endif
+        return ticksUs - std::chrono::duration<double, std::micro>(origin.time_since_epoch()).count();
     }
 
-    void generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels)
+    /// <summary>
+    /// Small sequential id for the calling thread, the main thread that records first gets 1.
+    /// </summary>
+    static uint32_t currentThreadId()
     {
-        // Check if image format supports linear blitting
-        VkFormatProperties formatProperties;
-        vkGetPhysicalDeviceFormatProperties(physicalDevice, imageFormat, &formatProperties);
+        static std::atomic<uint32_t> nextThreadId{ 1 };
+        thread_local uint32_t threadId = nextThreadId++;
+        return threadId;
+    }
 
-        if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
-            throw std::runtime_error("texture image format does not support linear blitting!");
+    /// <summary>
+    /// Appends an event to the calling thread's buffer, "threadId" is the row it's shown in.
+    /// </summary>
+    void addEvent(const char* name, uint32_t threadId, double startUs, double durationUs)
+    {
+        ThreadEvents& buffer = threadEvents();
+        if (buffer.events.size() == buffer.events.capacity())
+        {
+            buffer.droppedEvents++;
+            return;
         }
+        buffer.events.push_back({ name, threadId, startUs, durationUs });
+    }
 
-        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-        VkImageMemoryBarrier barrier{};
-        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        barrier.image = image;
-        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        barrier.subresourceRange.baseArrayLayer = 0;
-        barrier.subresourceRange.layerCount = 1;
-        barrier.subresourceRange.levelCount = 1;
-
-        int32_t mipWidth = texWidth;
-        int32_t mipHeight = texHeight;
+    /// <summary>
+    /// Writes every thread's events. The threads that recorded have to be done, or stopped, by then.
+    /// </summary>
+    void write(const std::string& path)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
 
-        for (uint32_t i = 1; i < mipLevels; i++)
+        std::ofstream file(path);
+        if (!file.is_open())
         {
-            barrier.subresourceRange.baseMipLevel = i - 1;
-            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            throw std::runtime_error("Error writing trace: " + path);
+        }
 
-            vkCmdPipelineBarrier(
-                commandBuffer,
-                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
-                0, nullptr,
-                0, nullptr,
-                1, &barrier);
+        std::set<uint32_t> threadIds;
+        size_t eventCount = 0;
+        uint64_t droppedEvents = 0;
+        file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        for (const std::unique_ptr<ThreadEvents>& buffer : threadBuffers)
+        {
+            for (const TraceEvent& event : buffer->events)
+            {
+                file << "{\"name\": \"" << event.name << "\", \"cat\": \"" << (event.threadId == GPU_THREAD_ID ? "gpu" : "cpu")
+                    << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.threadId
+                    << ", \"ts\": " << event.startUs << ", \"dur\": " << event.durationUs << "},\n";
+                threadIds.insert(event.threadId);
+            }
+            eventCount += buffer->events.size();
+            droppedEvents += buffer->droppedEvents;
+        }
+        for (uint32_t threadId : threadIds)
+        {
+            file << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << threadId << ", \"args\": {\"name\": \"";
+            if (threadId == GPU_THREAD_ID)
+                file << "GPU (graphics queue)";
+            else
+                file << "Thread " << threadId;
+            file << "\"}},\n";
+        }
+        file << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"VulkanRenderer\"}}\n";
+        file << "]}\n";
 
-            VkImageBlit blit{};
-            blit.srcOffsets[0] = { 0, 0, 0 };
-            blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
-            blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            blit.srcSubresource.mipLevel = i - 1;
-            blit.srcSubresource.baseArrayLayer = 0;
-            blit.srcSubresource.layerCount = 1;
-            blit.dstOffsets[0] = { 0, 0, 0 };
-            blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
-            blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            blit.dstSubresource.mipLevel = i;
-            blit.dstSubresource.baseArrayLayer = 0;
-            blit.dstSubresource.layerCount = 1;
+        std::cout << "Wrote " << eventCount << " trace events to " << path;
+        if (droppedEvents > 0)
+            std::cout << " (" << droppedEvents << " dropped, a thread's buffer was full)";
+        std::cout << std::endl;
+    }
 
-            vkCmdBlitImage(commandBuffer,
-                image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                1, &blit,
-                VK_FILTER_LINEAR);
+private:
+    static const size_t EVENTS_PER_THREAD = 1 << 17;
 
-            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    // only the thread it belongs to appends to it
+    struct ThreadEvents {
+        std::vector<TraceEvent> events;
+        uint64_t droppedEvents = 0;
+    };
 
-            vkCmdPipelineBarrier(commandBuffer,
-                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-                0, nullptr,
-                0, nullptr,
-                1, &barrier);
+    TraceRecorder() : origin(std::chrono::steady_clock::now()) {}
 
-            if (mipWidth > 1) mipWidth /= 2;
-            if (mipHeight > 1) mipHeight /= 2;
+    ThreadEvents& threadEvents()
+    {
+        thread_local ThreadEvents* buffer = nullptr;
+        if (buffer == nullptr)
+        {
+            // owned by the recorder, so the events outlive the thread
+            std::lock_guard<std::mutex> lock(mutex);
+            threadBuffers.push_back(std::make_unique<ThreadEvents>());
+            buffer = threadBuffers.back().get();
+            buffer->events.reserve(EVENTS_PER_THREAD);
         }
+        return *buffer;
+    }
 
-        barrier.subresourceRange.baseMipLevel = mipLevels - 1;
-        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-        vkCmdPipelineBarrier(commandBuffer,
-            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-            0, nullptr,
-            0, nullptr,
-            1, &barrier);
+    std::chrono::steady_clock::time_point origin;
+    std::atomic<bool> enabled{ false };
+    // guards "threadBuffers", taken once per thread and when writing
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadEvents>> threadBuffers;
+};
 
-        endSingleTimeCommands(commandBuffer);
+/// <summary>
+/// Records the time from its construction to the end of the enclosing scope as a CPU trace event, if the trace recorder is enabled.
+/// </summary>
+class CpuProfileScope {
+public:
+    explicit CpuProfileScope(const char* name) : name(name), recording(TraceRecorder::get().isEnabled())
+    {
+        if (recording)
+            startUs = TraceRecorder::get().nowUs();
     }
 
-    void createTextureImage()
+    ~CpuProfileScope()
     {
+        if (!recording)
+            return;
+
+        TraceRecorder& recorder = TraceRecorder::get();
+        recorder.addEvent(name, TraceRecorder::currentThreadId(), startUs, recorder.nowUs() - startUs);
+    }
+
+private:
+    const char* name;
+    bool recording;
+    double startUs = 0.0;
+};
+
+// name has to be a string literal, only the pointer is stored, it also names allocations made inside the scope
+#define PROFILE_SCOPE(name) CpuProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name); ALLOCATION_SITE(name)
+#define PROFILE_GPU_BEGIN(commandBuffer, name) beginGpuScope(commandBuffer, name)
+#define PROFILE_GPU_END(commandBuffer) endGpuScope(commandBuffer)
+#else
+#define PROFILE_SCOPE(name) ALLOCATION_SITE(name)
+#define PROFILE_GPU_BEGIN(commandBuffer, name)
+#define PROFILE_GPU_END(commandBuffer)
+#endif
+
+/// <summary>
+/// A unit of work for the job system. Jobs run "function(context, begin, end)" and then decrement "counter".
+/// They're plain data so scheduling one never allocates.
+/// </summary>
+struct Job {
+    void (*function)(const void* context, uint32_t begin, uint32_t end);
+    const void* context;
+    uint32_t begin;
+    uint32_t end;
+    std::atomic<uint32_t>* counter;
+};
+
+/// <summary>
+/// Chase-Lev work-stealing deque of a fixed size. Only the owning thread pushes and pops at the bottom,
+/// any thread can steal from the top.
+/// </summary>
+class JobDeque {
+public:
+    static const int64_t CAPACITY = 4096;
+
+    bool push(Job* job)
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        if (b - t >= CAPACITY)
+            return false;
+
+        jobs[b & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+        bottom.store(b + 1, std::memory_order_release);
+        return true;
+    }
+
+    Job* pop()
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b)
+        {
+            // empty
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        Job* job = jobs[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (t == b)
+        {
+            // last job, race the thieves for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                job = nullptr;
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    Job* steal()
+    {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return nullptr;
+
+        Job* job = jobs[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr;
+        return job;
+    }
+
+private:
+    alignas(64) std::atomic<int64_t> top{ 0 };
+    alignas(64) std::atomic<int64_t> bottom{ 0 };
+    std::array<std::atomic<Job*>, CAPACITY> jobs{};
+};
+
+/// <summary>
+/// Work-stealing job scheduler. Thread 0 is whoever calls "start" (the main thread), it only runs jobs while it
+/// waits on a counter. Jobs can schedule more jobs and wait on them too, waiting always runs other jobs meanwhile,
+/// so a job that depends on others just waits on their counter.
+/// </summary>
+class JobSystem {
+public:
+    ~JobSystem() { stop(); }
+
+    /// <summary>
+    /// Starts "threadCount" - 1 worker threads. With "pinThreads" thread i only runs on core i.
+    /// </summary>
+    void start(uint32_t threadCount, bool pinThreads)
+    {
+        threadCount = (std::max)(threadCount, 1u);
+        running = true;
+        workers = std::vector<Worker>(threadCount);
+        if (pinThreads)
+        {
+            pinThread(0);
+        }
+        for (uint32_t index = 1; index < threadCount; index++)
+        {
+            workers[index].thread = std::thread(&JobSystem::workerLoop, this, index, pinThreads);
+        }
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            running = false;
+        }
+        sleepCondition.notify_all();
+
+        for (Worker& worker : workers)
+        {
+            if (worker.thread.joinable())
+                worker.thread.join();
+        }
+        workers.clear();
+    }
+
+    uint32_t threadCount() const { return static_cast<uint32_t>(workers.size()); }
+
+    /// <summary>
+    /// Queues "job" on the calling thread's deque, it runs right away if the deque is full. "job.counter" has to be
+    /// incremented before this.
+    /// </summary>
+    void schedule(const Job& job)
+    {
+        Worker& worker = workers[currentIndex()];
+        Job* slot = &worker.jobPool[worker.nextJob++ & (JOB_POOL_SIZE - 1)];
+        *slot = job;
+
+        if (!worker.deque.push(slot))
+        {
+            execute(*slot);
+            return;
+        }
+
+        // a worker about to sleep either sees the new count, or has registered as sleeping and gets notified.
+        // notifying under the lock means it can't be between checking the count and starting to wait
+        scheduledJobs.fetch_add(1);
+        if (sleepingWorkers.load() > 0)
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            sleepCondition.notify_one();
+        }
+    }
+
+    /// <summary>
+    /// Runs other jobs until "counter" reaches zero.
+    /// </summary>
+    void wait(const std::atomic<uint32_t>& counter)
+    {
+        uint32_t index = currentIndex();
+        while (counter.load(std::memory_order_acquire) != 0)
+        {
+            if (!runOneJob(index))
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    /// <summary>
+    /// Calls "body(begin, end)" for batches of at most "batchSize" out of [0, count) on every thread and returns once
+    /// all of them are done. The first exception a batch throws is rethrown here.
+    /// </summary>
+    template<typename Body>
+    void parallelFor(uint32_t count, uint32_t batchSize, const Body& body)
+    {
+        batchSize = (std::max)(batchSize, 1u);
+        if (workers.size() <= 1 || count <= batchSize)
+        {
+            if (count > 0)
+                body(0u, count);
+            return;
+        }
+
+        // lives on this stack frame, which outlasts every batch since we wait for them below
+        struct Context {
+            const Body* body;
+            std::atomic<bool> failed{ false };
+            std::exception_ptr error;
+        } context;
+        context.body = &body;
+
+        std::atomic<uint32_t> counter{ (count + batchSize - 1) / batchSize };
+        for (uint32_t begin = 0; begin < count; begin += batchSize)
+        {
+            Job job{};
+            job.function = [](const void* data, uint32_t jobBegin, uint32_t jobEnd) {
+                Context& context = *const_cast<Context*>(static_cast<const Context*>(data));
+                try
+                {
+                    (*context.body)(jobBegin, jobEnd);
+                }
+                catch (...)
+                {
+                    if (!context.failed.exchange(true))
+                        context.error = std::current_exception();
+                }
+            };
+            job.context = &context;
+            job.begin = begin;
+            job.end = (std::min)(begin + batchSize, count);
+            job.counter = &counter;
+            schedule(job);
+        }
+
+        wait(counter);
+        if (context.error)
+        {
+            std::rethrow_exception(context.error);
+        }
+    }
+
+private:
+    // per thread, twice the deque size so a slot is never reused while a thief may still be reading it
+    static const uint32_t JOB_POOL_SIZE = 2 * JobDeque::CAPACITY;
+
+    struct Worker {
+        JobDeque deque;
+        std::array<Job, JOB_POOL_SIZE> jobPool{};
+        uint32_t nextJob = 0;
+        std::thread thread;
+    };
+
+    static JobSystem*& currentSystem()
+    {
+        thread_local JobSystem* system = nullptr;
+        return system;
+    }
+
+    static uint32_t& currentWorker()
+    {
+        thread_local uint32_t index = 0;
+        return index;
+    }
+
+    // worker threads know their index, any other thread is treated as thread 0
+    uint32_t currentIndex() const
+    {
+        return currentSystem() == this ? currentWorker() : 0;
+    }
+
+    static void execute(const Job& job)
+    {
+        job.function(job.context, job.begin, job.end);
+        job.counter->fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    /// <summary>
+    /// Runs a job from this thread's deque, or failing that one stolen from another thread. Returns false if there was none.
+    /// </summary>
+    bool runOneJob(uint32_t index)
+    {
+        Job* job = workers[index].deque.pop();
+        for (uint32_t i = 1; job == nullptr && i < workers.size(); i++)
+        {
+            job = workers[(index + i) % workers.size()].deque.steal();
+        }
+        if (job == nullptr)
+            return false;
+
+        // copied out first, the slot belongs to the thread that scheduled it
+        Job copy = *job;
+        execute(copy);
+        return true;
+    }
+
+    void workerLoop(uint32_t index, bool pinThreads)
+    {
+        currentSystem() = this;
+        currentWorker() = index;
+        if (pinThreads)
+        {
+            pinThread(index);
+        }
+
+        uint32_t idleSpins = 0;
+        while (running.load(std::memory_order_acquire))
+        {
+            if (runOneJob(index))
+            {
+                idleSpins = 0;
+                continue;
+            }
+
+            // spin a little before sleeping, frame work comes in bursts
+            if (++idleSpins < 64)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            // look once more after registering as sleeping, anything scheduled from here on bumps "scheduledJobs"
+            sleepingWorkers.fetch_add(1);
+            uint64_t seenJobs = scheduledJobs.load();
+            if (runOneJob(index))
+            {
+                sleepingWorkers.fetch_sub(1);
+                idleSpins = 0;
+                continue;
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(sleepMutex);
+                sleepCondition.wait(lock, [&]() {
+                    return !running.load(std::memory_order_acquire) || scheduledJobs.load() != seenJobs;
+                });
+            }
+            sleepingWorkers.fetch_sub(1);
+            idleSpins = 0;
+        }
+    }
+
+    static void pinThread(uint32_t core)
+    {
+#ifdef _WIN32
+        SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << (core % (sizeof(DWORD_PTR) * 8)));
+#else
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(core % CPU_SETSIZE, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#endif
+    }
+
+    std::vector<Worker> workers;
+    std::atomic<bool> running{ false };
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+    std::atomic<uint32_t> sleepingWorkers{ 0 };
+    // bumped by every schedule, sleeping workers wake up when it changes
+    std::atomic<uint64_t> scheduledJobs{ 0 };
+};
+
+// the frustum culler has SSE and AVX2 versions on x86, picked at runtime so the build doesn't need /arch:AVX2
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define FRUSTUM_CULLING_SIMD 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define FRUSTUM_CULLING_SIMD 0
+#endif
+
+/// <summary>
+/// Axis aligned box.
+/// </summary>
+struct BoundingBox {
+    glm::vec3 min{ 0.0f };
+    glm::vec3 max{ 0.0f };
+};
+
+/// <summary>
+/// World space boxes of many objects, one array per coordinate so the culler loads the same coordinate of 8 objects
+/// at once. The arrays are padded to a multiple of 8, what's in the padding doesn't matter.
+/// </summary>
+struct BoundsSoA {
+    static constexpr uint32_t LANES = 8;
+    std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+    uint32_t count = 0;
+
+    void resize(uint32_t objectCount)
+    {
+        count = objectCount;
+        size_t padded = (static_cast<size_t>(objectCount) + LANES - 1) / LANES * LANES;
+        for (std::vector<float>* coordinate : { &minX, &minY, &minZ, &maxX, &maxY, &maxZ })
+        {
+            coordinate->resize(padded, 0.0f);
+        }
+    }
+
+    void set(uint32_t index, const glm::vec3& center, const glm::vec3& extent)
+    {
+        minX[index] = center.x - extent.x;
+        minY[index] = center.y - extent.y;
+        minZ[index] = center.z - extent.z;
+        maxX[index] = center.x + extent.x;
+        maxY[index] = center.y + extent.y;
+        maxZ[index] = center.z + extent.z;
+    }
+};
+
+/// <summary>
+/// Tests boxes against the six planes of a view projection, 8 per iteration with AVX2 if the CPU has it, as two
+/// halves of 4 with SSE otherwise. Batches of boxes go to the job system, and the indices of the visible boxes
+/// come out in order.
+/// </summary>
+class FrustumCuller {
+public:
+    enum class Path { Scalar, Sse, Avx2 };
+
+    // boxes per job, a multiple of "BoundsSoA::LANES"
+    static constexpr uint32_t BATCH_SIZE = 4096;
+
+    static Path bestPath()
+    {
+#if FRUSTUM_CULLING_SIMD
+        return cpuHasAvx2() ? Path::Avx2 : Path::Sse;
+#else
+        return Path::Scalar;
+#endif
+    }
+
+    static const char* pathName(Path path)
+    {
+        switch (path)
+        {
+        case Path::Avx2: return "AVX2";
+        case Path::Sse: return "SSE";
+        default: return "scalar";
+        }
+    }
+
+    /// <summary>
+    /// Makes room for culling "count" boxes without allocating.
+    /// </summary>
+    void reserve(uint32_t count)
+    {
+        batchCounts.resize((count + BATCH_SIZE - 1) / BATCH_SIZE);
+    }
+
+    /// <summary>
+    /// Writes the indices of the boxes in "bounds" that are at least partly inside the frustum of "viewProj" to
+    /// "visible", which needs room for all of them, and returns how many that is. Boxes that straddle a plane
+    /// count as visible, so does the odd box just outside a corner of the frustum.
+    /// </summary>
+    uint32_t cull(JobSystem& jobs, const glm::mat4& viewProj, const BoundsSoA& bounds, uint32_t* visible, Path path)
+    {
+        setPlanes(viewProj);
+        reserve(bounds.count);
+
+        // every batch compacts into the start of its own range, then the ranges are moved together
+        jobs.parallelFor(bounds.count, BATCH_SIZE, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t batchBegin = begin; batchBegin < end; batchBegin += BATCH_SIZE)
+            {
+                uint32_t batchEnd = (std::min)(batchBegin + BATCH_SIZE, end);
+                batchCounts[batchBegin / BATCH_SIZE] = cullRange(bounds, batchBegin, batchEnd, visible, path);
+            }
+        });
+
+        uint32_t visibleCount = 0;
+        for (uint32_t batch = 0; batch * BATCH_SIZE < bounds.count; batch++)
+        {
+            if (visibleCount != batch * BATCH_SIZE)
+            {
+                memmove(visible + visibleCount, visible + batch * BATCH_SIZE, batchCounts[batch] * sizeof(uint32_t));
+            }
+            visibleCount += batchCounts[batch];
+        }
+        return visibleCount;
+    }
+
+private:
+    // "xyz" is the plane's normal pointing into the frustum and "w" its offset, not normalized
+    std::array<glm::vec4, 6> planes{};
+    std::vector<uint32_t> batchCounts;
+
+    /// <summary>
+    /// Takes the planes out of the rows of the view projection, for clip space x and y in [-w, w] and z in [0, w].
+    /// </summary>
+    void setPlanes(const glm::mat4& viewProj)
+    {
+        glm::mat4 rows = glm::transpose(viewProj);
+        planes = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[2], rows[3] - rows[2] };
+    }
+
+    uint32_t cullRange(const BoundsSoA& bounds, uint32_t begin, uint32_t end, uint32_t* visible, Path path) const
+    {
+        switch (path)
+        {
+#if FRUSTUM_CULLING_SIMD
+        case Path::Avx2: return cullAvx2(bounds, begin, end, visible);
+        case Path::Sse: return cullSse(bounds, begin, end, visible);
+#endif
+        default: return cullScalar(bounds, begin, end, visible);
+        }
+    }
+
+    // the distance of the box corner farthest along the plane's normal, the box is outside if that's negative.
+    // Picking the corner is a max per axis: n * min and n * max, whichever is bigger
+    uint32_t cullScalar(const BoundsSoA& bounds, uint32_t begin, uint32_t end, uint32_t* visible) const
+    {
+        uint32_t visibleCount = begin;
+        for (uint32_t i = begin; i < end; i++)
+        {
+            bool inside = true;
+            for (const glm::vec4& plane : planes)
+            {
+                float distance = (std::max)(plane.x * bounds.minX[i], plane.x * bounds.maxX[i]) +
+                    (std::max)(plane.y * bounds.minY[i], plane.y * bounds.maxY[i]) +
+                    (std::max)(plane.z * bounds.minZ[i], plane.z * bounds.maxZ[i]) + plane.w;
+                inside = inside && distance >= 0.0f;
+            }
+            visible[visibleCount] = i;
+            visibleCount += inside ? 1 : 0;
+        }
+        return visibleCount - begin;
+    }
+
+    /// <summary>
+    /// Appends the lanes set in "mask" of the 8 boxes from "first" on. Every box gets written and only the visible
+    /// ones are kept, which never writes past the box itself, so batches can't step on each other.
+    /// </summary>
+    static uint32_t appendVisible(uint32_t mask, uint32_t first, uint32_t end, uint32_t* visible, uint32_t visibleCount)
+    {
+        uint32_t lanes = (std::min)(end - first, BoundsSoA::LANES);
+        for (uint32_t lane = 0; lane < lanes; lane++)
+        {
+            visible[visibleCount] = first + lane;
+            visibleCount += (mask >> lane) & 1;
+        }
+        return visibleCount;
+    }
+
+#if FRUSTUM_CULLING_SIMD
+    static bool cpuHasAvx2()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+
+        // AVX has to be enabled by the OS as well, it saves the YMM registers
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+            return false;
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+
+    uint32_t cullSse(const BoundsSoA& bounds, uint32_t begin, uint32_t end, uint32_t* visible) const
+    {
+        uint32_t visibleCount = begin;
+        for (uint32_t i = begin; i < end; i += BoundsSoA::LANES)
+        {
+            uint32_t mask = 0;
+            for (uint32_t half = 0; half < 2; half++)
+            {
+                uint32_t first = i + half * 4;
+                __m128 minX = _mm_loadu_ps(&bounds.minX[first]);
+                __m128 minY = _mm_loadu_ps(&bounds.minY[first]);
+                __m128 minZ = _mm_loadu_ps(&bounds.minZ[first]);
+                __m128 maxX = _mm_loadu_ps(&bounds.maxX[first]);
+                __m128 maxY = _mm_loadu_ps(&bounds.maxY[first]);
+                __m128 maxZ = _mm_loadu_ps(&bounds.maxZ[first]);
+
+                __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                for (const glm::vec4& plane : planes)
+                {
+                    __m128 x = _mm_set1_ps(plane.x);
+                    __m128 y = _mm_set1_ps(plane.y);
+                    __m128 z = _mm_set1_ps(plane.z);
+                    __m128 distance = _mm_add_ps(_mm_max_ps(_mm_mul_ps(x, minX), _mm_mul_ps(x, maxX)),
+                        _mm_add_ps(_mm_max_ps(_mm_mul_ps(y, minY), _mm_mul_ps(y, maxY)),
+                            _mm_add_ps(_mm_max_ps(_mm_mul_ps(z, minZ), _mm_mul_ps(z, maxZ)), _mm_set1_ps(plane.w))));
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+                }
+                mask |= static_cast<uint32_t>(_mm_movemask_ps(inside)) << (half * 4);
+            }
+            visibleCount = appendVisible(mask, i, end, visible, visibleCount);
+        }
+        return visibleCount - begin;
+    }
+
+    TARGET_AVX2 uint32_t cullAvx2(const BoundsSoA& bounds, uint32_t begin, uint32_t end, uint32_t* visible) const
+    {
+        // the planes are the same for every box, broadcast them once
+        __m256 broadcastPlanes[24];
+        for (size_t plane = 0; plane < planes.size(); plane++)
+        {
+            for (int component = 0; component < 4; component++)
+            {
+                broadcastPlanes[plane * 4 + component] = _mm256_set1_ps(planes[plane][component]);
+            }
+        }
+
+        uint32_t visibleCount = begin;
+        for (uint32_t i = begin; i < end; i += BoundsSoA::LANES)
+        {
+            __m256 minX = _mm256_loadu_ps(&bounds.minX[i]);
+            __m256 minY = _mm256_loadu_ps(&bounds.minY[i]);
+            __m256 minZ = _mm256_loadu_ps(&bounds.minZ[i]);
+            __m256 maxX = _mm256_loadu_ps(&bounds.maxX[i]);
+            __m256 maxY = _mm256_loadu_ps(&bounds.maxY[i]);
+            __m256 maxZ = _mm256_loadu_ps(&bounds.maxZ[i]);
+
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (size_t plane = 0; plane < planes.size(); plane++)
+            {
+                const __m256* p = &broadcastPlanes[plane * 4];
+                __m256 distance = _mm256_add_ps(_mm256_max_ps(_mm256_mul_ps(p[0], minX), _mm256_mul_ps(p[0], maxX)),
+                    _mm256_add_ps(_mm256_max_ps(_mm256_mul_ps(p[1], minY), _mm256_mul_ps(p[1], maxY)),
+                        _mm256_add_ps(_mm256_max_ps(_mm256_mul_ps(p[2], minZ), _mm256_mul_ps(p[2], maxZ)), p[3])));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+            }
+            visibleCount = appendVisible(static_cast<uint32_t>(_mm256_movemask_ps(inside)), i, end, visible, visibleCount);
+        }
+        return visibleCount - begin;
+    }
+#endif
+};
+
+/// <summary>
+/// Used to call "VkCreateDebugUtilMessengerEXT". Function address needs to be loaded at runtime since it is an extension. This function uses the same arguments as the actual Vulkan function.
+/// </summary>
+/// <param name="instance"></param>
+/// <param name="pCreateInfo"></param>
+/// <param name="pAllocator"></param>
+/// <param name="pDebugMessenger"></param>
+/// <returns>Will return false if function address couldn't be found.</returns>
+VkResult CreateDebugUtilsMessengerEXT(
+    VkInstance instance,
+    const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo,
+    const VkAllocationCallbacks* pAllocator,
+    VkDebugUtilsMessengerEXT* pDebugMessenger)
+{
+    auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
+    if (func != nullptr)
+    {
+        return func(instance, pCreateInfo, pAllocator, pDebugMessenger);
+    }
+    else
+    {
+        return VK_ERROR_EXTENSION_NOT_PRESENT;
+    }
+}
+ 
+/// <summary>
+/// Used to call "VkDestroyDebugUtilMessengerEXT". Function address needs to be loaded at runtime since it is an extension. This function uses the same arguments as the actual Vulkan function.
+/// </summary>
+/// <param name="instance"></param>
+/// <param name="debugMessenger"></param>
+/// <param name="pAllocator"></param>
+void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger, const VkAllocationCallbacks* pAllocator)
+{
+    auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
+    if (func != nullptr)
+    {
+        func(instance, debugMessenger, pAllocator);
+    }
+    else
+    {
+        throw std::runtime_error("could not find \"vkDestroyDebugUtilsMessengerEXT\" function address.");
+    }
+}
+
+class HelloTriangleApplication {
+public:
+    explicit HelloTriangleApplication(const AppOptions& options) : options(options)
+    {
+#if ENABLE_ALLOCATION_TRACKING
+        if (options.allocations.enabled)
+        {
+            trackedAllocator.pfnAllocation = trackedVulkanAllocation;
+            trackedAllocator.pfnReallocation = trackedVulkanReallocation;
+            trackedAllocator.pfnFree = trackedVulkanFree;
+            allocator = &trackedAllocator;
+            AllocationTracker::get().setEnabled(true);
+        }
+#endif
+#if ENABLE_PROFILING
+        // scopes cost next to nothing unless there's a trace to write
+        TraceRecorder::get().setEnabled(!options.tracePath.empty());
+#endif
+    }
+
+    /// <summary>
+    /// Entry point of application.
+    /// </summary>
+    void run() {
+        initWindow();
+        initVulkan();
+        mainLoop();
+        // the benchmark modes return without waiting, the startup uploads may not even be done
+        vkDeviceWaitIdle(device);
+        cleanup();
+    }
+
+private:
+    AppOptions options;
+    // passed to every Vulkan create/destroy call, only set when allocation tracking is on
+    const VkAllocationCallbacks* allocator = nullptr;
+#if ENABLE_ALLOCATION_TRACKING
+    VkAllocationCallbacks trackedAllocator{};
+    uint64_t drawnFrames = 0;
+    uint64_t trackedFrames = 0;
+    uint64_t framesWithAllocations = 0;
+    uint64_t trackedFrameAllocations = 0;
+    uint64_t trackedFrameBytes = 0;
+    uint64_t maxFrameAllocations = 0;
+#endif
+    // frames that recreate the swapchain are allowed to allocate
+    uint64_t swapChainRecreations = 0;
+    GLFWwindow* window;
+    VkInstance instance;
+    VkDebugUtilsMessengerEXT debugMessenger;
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkDevice device;
+    VkQueue graphicsQueue;
+    VkQueue presentationQueue;
+    VkQueue transferQueue;
+    VkSurfaceKHR surface;
+    VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+    std::vector<VkImage> swapChainImages;
+    VkFormat swapChainImageFormat;
+    VkExtent2D swapChainExtent;
+    std::vector<VkImageView> swapChainImageViews;
+    // headless mode renders into these instead of swapchain images, one per frame in flight
+    std::vector<VkDeviceMemory> offscreenImagesMemory;
+    std::vector<VkBuffer> readbackBuffers;
+    std::vector<VkDeviceMemory> readbackBuffersMemory;
+    std::vector<void*> readbackBuffersMapped;
+    // frame number whose pixels each readback buffer is waiting to have written out, -1 if none
+    std::array<int64_t, MAX_FRAMES_IN_FLIGHT> pendingReadbackFrames;
+    int64_t renderedFrameCount = 0;
+    // descriptor sets are split by how often they change: set 0 per frame and per draw (dynamic offsets into
+    // the uniform ring), set 1 is the bindless texture table every draw indexes into
+    DescriptorLayout frameSetLayout;
+    VkDescriptorSetLayout bindlessSetLayout;
+    VkPipelineLayout pipelineLayout;
+    // declared ahead of every VulkanHandle and the render graph, they retire into it when they're destroyed
+    DeletionQueue deletionQueue;
+    VulkanHandle<VkPipeline, vkDestroyPipeline> graphicsPipeline;
+    // the frame's passes and what they pass between each other, see "RenderGraph"
+    RenderGraph renderGraph;
+    uint32_t colorTarget;
+    uint32_t depthTarget;
+    // multisampled color the main pass renders into and resolves into "colorTarget", only with MSAA
+    uint32_t msaaColorTarget = RenderGraph::NO_RESOURCE;
+    uint32_t readbackTarget = RenderGraph::NO_RESOURCE;
+    uint32_t mainPass;
+    VkFormat depthFormat;
+    VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+    VkCommandPool commandPool;
+    VkCommandPool transferCommandPool = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer> commandBuffers;
+    // command caching, one primary buffer per swapchain image and frame in flight. Raising "commandCacheDirty"
+    // (scene, pipeline or swapchain changes) has all of them re-recorded
+    std::vector<CachedCommandBuffer> cachedCommandBuffers;
+    bool commandCacheDirty = true;
+    JobSystem jobs;
+    // parallel recording, each slice of the draws is a job recording into its own secondary buffer
+    std::vector<RecordSlice> recordSlices;
+    uint32_t activeRecordSlices = 0;
+    RecordJob recordJob{};
+    std::vector<VkSemaphore> imageAvailableSemaphores;
+    std::vector<VkSemaphore> renderFinishedSemaphores;
+    GpuTimeline graphicsTimeline;
+    GpuTimeline transferTimeline;
+    // graphics timeline value each frame in flight signals when its command buffer is done
+    std::array<uint64_t, MAX_FRAMES_IN_FLIGHT> frameTimelineValues{};
+
+    // when each frame in flight sampled the simulation, and whether we still owe it a GPU latency sample
+    std::array<std::chrono::steady_clock::time_point, MAX_FRAMES_IN_FLIGHT> frameSampleTimes{};
+    std::array<bool, MAX_FRAMES_IN_FLIGHT> frameLatencyPending{};
+    FrameLatencyStats latencyStats;
+    FrameLatencyStats reportedLatencyStats;
+    std::chrono::steady_clock::time_point lastLatencyReport;
+
+    // animation is driven by "simulationTime", which benchmark runs advance by a fixed timestep
+    std::chrono::steady_clock::time_point animationStartTime;
+    double simulationTime = 0.0;
+    std::vector<CameraKeyframe> cameraPath;
+
+    // GPU frame times for benchmark runs, a begin and end timestamp per frame in flight
+    VkQueryPool timestampQueryPool = VK_NULL_HANDLE;
+    float timestampPeriod = 1.0f;
+    // benchmark sample each frame in flight's timestamps belong to, -1 if none
+    std::array<int64_t, MAX_FRAMES_IN_FLIGHT> timestampSamples;
+    int64_t benchmarkSampleIndex = -1;
+    double lastCpuFrameMs = 0.0;
+    std::vector<BenchmarkSample> benchmarkSamples;
+
+#if ENABLE_PROFILING
+    // GPU scopes of the frame command buffers, "GPU_QUERIES_PER_FRAME" timestamps per frame in flight
+    struct GpuProfileScope {
+        const char* name;
+        uint32_t beginQuery;
+        uint32_t endQuery;
+    };
+    static const uint32_t GPU_QUERIES_PER_FRAME = 32;
+    // the GPU and CPU clocks drift apart, so their offset is measured again this often. Without calibrated
+    // timestamps measuring it drains the graphics queue, so that's done less often
+    static constexpr double CALIBRATION_INTERVAL_US = 1000000.0;
+    static constexpr double QUEUE_CALIBRATION_INTERVAL_US = 10000000.0;
+    // one query after the frames' ones, for calibrating without VK_EXT_calibrated_timestamps
+    static const uint32_t CALIBRATION_QUERY = MAX_FRAMES_IN_FLIGHT * GPU_QUERIES_PER_FRAME;
+    VkQueryPool profilerQueryPool = VK_NULL_HANDLE;
+    double profilerTimestampPeriodUs = 0.0;
+    uint64_t profilerTimestampMask = ~0ull;
+    // added to converted GPU timestamps to put them on the trace recorder's CPU clock
+    double gpuClockOffsetUs = 0.0;
+    double lastCalibrationUs = 0.0;
+    // set when the device was created with VK_EXT_calibrated_timestamps
+    PFN_vkGetCalibratedTimestampsEXT getCalibratedTimestamps = nullptr;
+    std::array<std::vector<GpuProfileScope>, MAX_FRAMES_IN_FLIGHT> gpuScopes;
+    std::array<uint32_t, MAX_FRAMES_IN_FLIGHT> gpuQueriesUsed{};
+    // scopes that have begun but not ended in the command buffer being recorded
+    std::vector<uint32_t> openGpuScopes;
+#endif
+    uint32_t currentFrame = 0;
+    bool framebufferResized = false;
+    // set while recreateSwapChain waits for a minimized window, the resize callback mustn't draw then
+    bool waitingForWindow = false;
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    VulkanHandle<VkBuffer, vkDestroyBuffer> vertexBuffer;
+    VulkanHandle<VkDeviceMemory, vkFreeMemory> vertexBufferMemory;
+    VulkanHandle<VkBuffer, vkDestroyBuffer> indexBuffer;
+    VulkanHandle<VkDeviceMemory, vkFreeMemory> indexBufferMemory;
+    // the depth pre-pass only reads positions, tightly packed they take a fraction of the bandwidth of full vertices
+    VulkanHandle<VkBuffer, vkDestroyBuffer> positionBuffer;
+    VulkanHandle<VkDeviceMemory, vkFreeMemory> positionBufferMemory;
+    VulkanHandle<VkPipeline, vkDestroyPipeline> depthPrepassPipeline;
+    // fragment shader invocations, one query per frame in flight. Null if the device can't count them
+    VkQueryPool pipelineStatisticsPool = VK_NULL_HANDLE;
+    std::array<bool, MAX_FRAMES_IN_FLIGHT> pipelineStatisticsPending{};
+
+    // the model's bounding sphere, center and radius
+    glm::vec4 modelBounds{};
+    // occlusion culling, see "addOcclusionCullingPasses"
+    DescriptorLayout cullSetLayout;
+    DescriptorLayout hiZSetLayout;
+    VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;
+    VkPipelineLayout hiZPipelineLayout = VK_NULL_HANDLE;
+    VulkanHandle<VkPipeline, vkDestroyPipeline> cullPipeline;
+    VulkanHandle<VkPipeline, vkDestroyPipeline> hiZPipeline;
+    // whether each instance passed the last late test, that's what the early phase draws
+    VulkanHandle<VkBuffer, vkDestroyBuffer> visibilityBuffer;
+    VulkanHandle<VkDeviceMemory, vkFreeMemory> visibilityBufferMemory;
+    // one indexed indirect draw per phase, and the instances each phase draws with room for all of them in both
+    VulkanHandle<VkBuffer, vkDestroyBuffer> drawCommandBuffer;
+    VulkanHandle<VkDeviceMemory, vkFreeMemory> drawCommandBufferMemory;
+    VulkanHandle<VkBuffer, vkDestroyBuffer> culledInstanceBuffer;
+    VulkanHandle<VkDeviceMemory, vkFreeMemory> culledInstanceBufferMemory;
+    uint32_t culledInstanceCapacity = 0;
+    // the draw commands as the GPU left them, copied out every frame for the culling stats
+    std::array<VulkanHandle<VkBuffer, vkDestroyBuffer>, MAX_FRAMES_IN_FLIGHT> cullingStatsBuffers;
+    std::array<VulkanHandle<VkDeviceMemory, vkFreeMemory>, MAX_FRAMES_IN_FLIGHT> cullingStatsBuffersMemory;
+    std::array<VkDrawIndexedIndirectCommand*, MAX_FRAMES_IN_FLIGHT> cullingStatsMapped{};
+    std::array<bool, MAX_FRAMES_IN_FLIGHT> cullingStatsPending{};
+    // farthest depth per texel, the first level is the swapchain size rounded down to powers of two
+    VulkanHandle<VkImage, vkDestroyImage> hiZImage;
+    VulkanHandle<VkDeviceMemory, vkFreeMemory> hiZImageMemory;
+    VulkanHandle<VkImageView, vkDestroyImageView> hiZView;
+    std::vector<VulkanHandle<VkImageView, vkDestroyImageView>> hiZLevelViews;
+    VulkanHandle<VkSampler, vkDestroySampler> hiZSampler;
+    VkExtent2D hiZExtent{};
+    // one set per pyramid level, from pools of their own that are retired along with the pyramid
+    std::vector<VkDescriptorSet> hiZSets;
+    DescriptorAllocator hiZDescriptors;
+    // the frame's culling set, written every frame since each frame in flight has its own instance buffer
+    VkDescriptorSet cullSet = VK_NULL_HANDLE;
+    uint32_t hiZTarget = RenderGraph::NO_RESOURCE;
+    uint32_t visibilityTarget = RenderGraph::NO_RESOURCE;
+    uint32_t drawCommandTarget = RenderGraph::NO_RESOURCE;
+    uint32_t culledInstanceTarget = RenderGraph::NO_RESOURCE;
+    uint32_t cullingStatsTarget = RenderGraph::NO_RESOURCE;
+
+    // GPU-driven rendering, see "addDrawGenerationPass". The instance offsets live on the GPU, the draw generation
+    // shader writes the visible instances' transforms, one draw per visible instance and how many draws there are
+    DescriptorLayout drawGenerationSetLayout;
+    VkPipelineLayout drawGenerationPipelineLayout = VK_NULL_HANDLE;
+    VulkanHandle<VkPipeline, vkDestroyPipeline> drawGenerationPipeline;
+    VkDescriptorSet drawGenerationSet = VK_NULL_HANDLE;
+    VulkanHandle<VkBuffer, vkDestroyBuffer> instanceOffsetBuffer;
+    VulkanHandle<VkDeviceMemory, vkFreeMemory> instanceOffsetBufferMemory;
+    VulkanHandle<VkBuffer, vkDestroyBuffer> generatedInstanceBuffer;
+    VulkanHandle<VkDeviceMemory, vkFreeMemory> generatedInstanceBufferMemory;
+    VulkanHandle<VkBuffer, vkDestroyBuffer> generatedDrawBuffer;
+    VulkanHandle<VkDeviceMemory, vkFreeMemory> generatedDrawBufferMemory;
+    VulkanHandle<VkBuffer, vkDestroyBuffer> drawCountBuffer;
+    VulkanHandle<VkDeviceMemory, vkFreeMemory> drawCountBufferMemory;
+    // the draw count copied out every frame for the latency report
+    std::array<VulkanHandle<VkBuffer, vkDestroyBuffer>, MAX_FRAMES_IN_FLIGHT> drawCountReadbackBuffers;
+    std::array<VulkanHandle<VkDeviceMemory, vkFreeMemory>, MAX_FRAMES_IN_FLIGHT> drawCountReadbackBuffersMemory;
+    std::array<uint32_t*, MAX_FRAMES_IN_FLIGHT> drawCountReadbackMapped{};
+    std::array<bool, MAX_FRAMES_IN_FLIGHT> drawCountReadbackPending{};
+    uint32_t instanceUniformOffset = 0;
+    uint32_t generatedInstanceTarget = RenderGraph::NO_RESOURCE;
+    uint32_t generatedDrawTarget = RenderGraph::NO_RESOURCE;
+    uint32_t drawCountTarget = RenderGraph::NO_RESOURCE;
+    uint32_t drawCountReadbackTarget = RenderGraph::NO_RESOURCE;
+
+    // all uniform data, see "UniformRing". the camera is allocated once per frame
+    UniformRing uniformRing;
+    uint32_t cameraUniformOffset = 0;
+
+    // per-instance transforms, one persistently mapped buffer per frame in flight that grows when needed
+    std::array<VulkanHandle<VkBuffer, vkDestroyBuffer>, MAX_FRAMES_IN_FLIGHT> instanceBuffers;
+    std::array<VulkanHandle<VkDeviceMemory, vkFreeMemory>, MAX_FRAMES_IN_FLIGHT> instanceBuffersMemory;
+    std::array<InstanceData*, MAX_FRAMES_IN_FLIGHT> instanceBuffersMapped{};
+    std::array<uint32_t, MAX_FRAMES_IN_FLIGHT> instanceBufferCapacities{};
+    std::array<uint32_t, MAX_FRAMES_IN_FLIGHT> instanceCounts{};
+    // where each instance sits relative to the model's rotation, and how far the projection has to reach to see them all
+    std::vector<glm::vec3> instanceOffsets;
+    float farPlane = 10.0f;
+    // the model's box in model space, and with frustum culling every instance's box in world space and the indices
+    // of the visible ones, which are the only ones written to the instance buffer
+    BoundingBox modelBox;
+    BoundsSoA instanceBounds;
+    FrustumCuller frustumCuller;
+    FrustumCuller::Path cullPath = FrustumCuller::Path::Scalar;
+    std::vector<uint32_t> visibleInstances;
+
+    // sets that live as long as the renderer, cached by content so equal ones are only allocated once
+    DescriptorAllocator persistentDescriptors;
+    std::unordered_map<DescriptorSetKey, VkDescriptorSet> descriptorSetCache;
+    // sets that only live for one frame, the frame's pools are reset together once the GPU is done with it
+    std::array<DescriptorAllocator, MAX_FRAMES_IN_FLIGHT> frameDescriptors;
+    VkDescriptorSet frameDescriptorSet;
+    // one update-after-bind set with an array of every texture, slots are handed out by "registerTexture"
+    VkDescriptorPool bindlessPool;
+    VkDescriptorSet bindlessSet;
+    uint32_t bindlessTextureCount = 0;
+    uint32_t modelTextureIndex;
+    uint32_t mipLevels;
+    // owned through VulkanHandles, so replacing them at runtime doesn't need the device to be idle
+    VulkanHandle<VkImage, vkDestroyImage> textureImage;
+    VulkanHandle<VkDeviceMemory, vkFreeMemory> textureImageMemory;
+    VulkanHandle<VkImageView, vkDestroyImageView> textureImageView;
+    VulkanHandle<VkSampler, vkDestroySampler> textureSampler;
+    UploadContext uploadContext;
+
+    // what the instances sample until the streamed model texture is in, see "streamModelTexture"
+    TextureStreamState textureStream = TextureStreamState::Off;
+    uint32_t streamedTextureIndex = 0;
+    uint32_t textureStreamFrames = 0;
+    VulkanHandle<VkImage, vkDestroyImage> placeholderTexture;
+    VulkanHandle<VkDeviceMemory, vkFreeMemory> placeholderTextureMemory;
+    VulkanHandle<VkImageView, vkDestroyImageView> placeholderTextureView;
+
+    /// <summary>
+    /// Just a utility function to fill out the descriptor struct.
+    /// </summary>
+    /// <param name="createInfo"> - Pass by reference</param>
+    void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo)
+    {
+        createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+        createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+        createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+        createInfo.pfnUserCallback = debugCallback;
+        createInfo.pUserData = nullptr;
+    }
+
+    /// <summary>
+    /// Gets called whenever there is a validation message. Function signature is determined by Vulkan.
+    /// </summary>
+    /// <param name="messageSeverity"></param>
+    /// <param name="messageType"></param>
+    /// <param name="pCallbackData"></param>
+    /// <param name="pUserData"></param>
+    /// <returns></returns>
+    static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
+        VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
+        VkDebugUtilsMessageTypeFlagsEXT messageType,
+        const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData,
+        void* pUserData)
+    {
+        std::cerr << "validation layer: " << pCallbackData->pMessage << "\n\n" << std::endl;
+        return VK_FALSE;
+    }
+
+    /// <summary>
+    /// Gets all of the required extensions for GLFW to operate with Vulkan.
+    /// </summary>
+    /// <returns> A vector of all of the necessary extensions as char* strings</returns>
+    std::vector<const char*> getRequiredExtensions()
+    {
+        std::vector<const char*> extensions;
+
+        // no window means no surface extensions
+        if (!options.headless.enabled)
+        {
+            uint32_t glfwExtensionCount = 0;
+            const char** glfwExtensions;
+            glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+
+            extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        }
+
+        if (enableValidationLayers)
+        {
+            extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+        }
+
+        return extensions;
+    }
+
+    /// <summary>
+    /// Iterates through the available surface formats and picks one.
+    /// </summary>
+    /// <param name="availableFormats"></param>
+    /// <returns></returns>
+    VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats)
+    {
+        for (const auto& format : availableFormats)
+        {
+            if (format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR && format.format == VK_FORMAT_B8G8R8A8_SRGB)
+            {
+                return format;
+            }
+        }
+
+        return availableFormats[0];
+    }
+
+    /// <summary>
+    /// Iterates through the available present modes and picks one.
+    /// </summary>
+    /// <param name="availablePresentModes"></param>
+    /// <returns></returns>
+    VkPresentModeKHR chooseSwapSurfacePresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes)
+    {
+        VkPresentModeKHR wanted = VK_PRESENT_MODE_FIFO_KHR;
+        switch (options.pacing.presentMode)
+        {
+        case PresentModePolicy::Mailbox: wanted = VK_PRESENT_MODE_MAILBOX_KHR; break;
+        case PresentModePolicy::Fifo: wanted = VK_PRESENT_MODE_FIFO_KHR; break;
+        case PresentModePolicy::FifoRelaxed: wanted = VK_PRESENT_MODE_FIFO_RELAXED_KHR; break;
+        case PresentModePolicy::Immediate: wanted = VK_PRESENT_MODE_IMMEDIATE_KHR; break;
+        }
+
+        for (const auto& presentMode : availablePresentModes)
+        {
+            if (presentMode == wanted)
+            {
+                return presentMode;
+            }
+        }
+
+        // FIFO is the only mode every surface has to support
+        return VK_PRESENT_MODE_FIFO_KHR;
+    }
+
+    /// <summary>
+    /// Picks an appropriate swapChain extent based on surface capabilities.
+    /// </summary>
+    /// <param name="capabilities"></param>
+    /// <returns></returns>
+    VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities)
+    {
+        // have to do this odd parenthese syntax to avoid a member/macro conflict inherent in STL:
+        // https://stackoverflow.com/questions/1394132/macro-and-member-function-conflict
+        if (capabilities.currentExtent.width != (std::numeric_limits<uint32_t>::max)()) 
+        {
+            return capabilities.currentExtent;
+        }
+        else
+        {
+            int width, height;
+            glfwGetFramebufferSize(window, &width, &height);
+                
+            VkExtent2D actualExtent = {
+                static_cast<uint32_t>(width),
+                static_cast<uint32_t>(height)
+            };
+
+            actualExtent.width = std::clamp(actualExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+            actualExtent.height = std::clamp(actualExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+
+            return actualExtent;
+        }
+    }
+
+    /// <summary>
+    /// Gets all of the available validation layers that are supported and checks to make sure the one(s) we've requested (in global const "validationLayers") are supported.
+    /// </summary>
+    /// <returns>Will return false if a requested validation layer is not supported.</returns>
+    bool checkValidationLayerSupport()
+    {
+        uint32_t layerCount;
+        vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+
+        std::vector<VkLayerProperties> availableLayers(layerCount);
+        vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+
+        /// loop through each validation layer that we have specified that we want to use,
+        /// for each of those check if it exists in the available layers
+        /// if it doesn't, then stop and return false because we'd be getting an error when we try to use it
+        /// otherwise if all goes well, return true
+        for (auto& validationLayer : validationLayers)
+        {
+            bool layerFound = false;
+            for (auto& availableLayer : availableLayers)
+            {
+                if (strcmp(validationLayer, availableLayer.layerName) == 0)
+                {
+                    layerFound = true;
+                    break;
+                }
+            }
+
+            if (!layerFound)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /// <summary>
+    /// Initializes GLFW and creates a window. Sotres window in private class member "window"
+    /// </summary>
+    void initWindow() {
+        if (options.headless.enabled)
+            return;
+
+        glfwInit();
+
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+        
+        window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
+        glfwSetWindowUserPointer(window, this);
+        glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+    }
+
+    static void framebufferResizeCallback(GLFWwindow* window, int width, int height)
+    {
+        auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+        app->framebufferResized = true;
+
+        // on Windows glfwPollEvents doesn't return while the window is being resized, drawing from here keeps
+        // the window updating meanwhile. The frame picks up the resize flag and recreates the swapchain itself.
+        // benchmark runs only draw from their loop, which counts and times every frame and steps the simulation
+        if (!app->waitingForWindow && !app->options.benchmark.enabled)
+        {
+            app->drawFrame();
+        }
+    }
+
+    /// <summary>
+    /// Uses all of the "find____" and "choose____" utility functions to create a swapchain with the proper settings
+    /// based on our hardware's capabilities.
+    /// </summary>
+    void createSwapChain()
+    {
+        if (options.headless.enabled)
+        {
+            createOffscreenTargets();
+            return;
+        }
+
+        SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
+
+        VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
+        VkPresentModeKHR presentMode = chooseSwapSurfacePresentMode(swapChainSupport.presentModes);
+        VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
+
+        // one more than the minimum so we don't have to wait on the driver before we can acquire, unless the pacing config says otherwise
+        uint32_t imageCount = options.pacing.swapchainImageCount != 0 ? options.pacing.swapchainImageCount : swapChainSupport.capabilities.minImageCount + 1;
+        imageCount = (std::max)(imageCount, swapChainSupport.capabilities.minImageCount);
+
+        if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount)
+        {
+            imageCount = swapChainSupport.capabilities.maxImageCount;
+        }
+
+        VkSwapchainCreateInfoKHR createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+        createInfo.surface = surface;
+        createInfo.minImageCount = imageCount;
+        createInfo.imageFormat = surfaceFormat.format;
+        createInfo.imageColorSpace = surfaceFormat.colorSpace;
+        createInfo.imageExtent = extent;
+        createInfo.imageArrayLayers = 1;
+        createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+        QueueFamilyIndices queueFamilies = findQueueFamilies(physicalDevice);
+        uint32_t familyIndices[] = { queueFamilies.graphicsFamily.value(),  queueFamilies.presentationFamily.value() };
+
+        if (queueFamilies.graphicsFamily != queueFamilies.presentationFamily)
+        {
+            createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+            createInfo.queueFamilyIndexCount = 2;
+            createInfo.pQueueFamilyIndices = familyIndices;
+        }
+        else
+        {
+            createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            createInfo.queueFamilyIndexCount = 0;
+            createInfo.pQueueFamilyIndices = nullptr;
+        }
+
+        createInfo.preTransform = swapChainSupport.capabilities.currentTransform; //this is specify no transformation
+        createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+        createInfo.presentMode = presentMode;
+        createInfo.clipped = VK_TRUE;
+        // lets the driver hand resources over from the swapchain being replaced, frames already queued on it still present
+        createInfo.oldSwapchain = swapChain;
+
+        if (vkCreateSwapchainKHR(device, &createInfo, allocator, &swapChain))
+        {
+            throw std::runtime_error("Failed to create swapchain");
+        }
+
+        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
+        swapChainImages.resize(imageCount);
+        vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
+
+        swapChainImageFormat = surfaceFormat.format;
+        swapChainExtent = extent;
+    }
+
+    void createImageViews()
+    {
+        swapChainImageViews.resize(swapChainImages.size());
+        for (int i = 0; i < swapChainImageViews.size(); i++)
+        {
+            swapChainImageViews[i] = createImageView(swapChainImages[i], swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+        }                                                           
+    }
+
+    /// <summary>
+    /// Headless replacement for "createSwapChain". Creates one color target per frame in flight at the configured
+    /// resolution and stores them in "swapChainImages" so the rest of the renderer doesn't need to know the difference.
+    /// </summary>
+    void createOffscreenTargets()
+    {
+        swapChainImageFormat = VK_FORMAT_R8G8B8A8_SRGB;
+        swapChainExtent = { options.headless.width, options.headless.height };
+
+        swapChainImages.resize(MAX_FRAMES_IN_FLIGHT);
+        offscreenImagesMemory.resize(MAX_FRAMES_IN_FLIGHT);
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            createImage(swapChainExtent.width, swapChainExtent.height, 1, swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL,
+                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                swapChainImages[i], offscreenImagesMemory[i]);
+        }
+    }
+
+    /// <summary>
+    /// Creates a host visible buffer per offscreen target that finished frames get copied into, if frames should be written out.
+    /// </summary>
+    void createReadbackBuffers()
+    {
+        pendingReadbackFrames.fill(-1);
+
+        if (!options.headless.enabled || options.headless.dumpDirectory.empty())
+            return;
+
+        std::filesystem::create_directories(options.headless.dumpDirectory);
+
+        VkDeviceSize bufferSize = static_cast<VkDeviceSize>(swapChainExtent.width) * swapChainExtent.height * 4;
+
+        readbackBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+        readbackBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+        readbackBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readbackBuffers[i], readbackBuffersMemory[i]);
+            vkMapMemory(device, readbackBuffersMemory[i], 0, bufferSize, 0, &readbackBuffersMapped[i]);
+        }
+    }
+
+    /// <summary>
+    /// Copies the finished offscreen target into its readback buffer. The render graph's barriers put the target in
+    /// TRANSFER_SRC_OPTIMAL before the copy and make the copy visible to the host after the frame.
+    /// </summary>
+    void recordReadback(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+    {
+        VkBufferImageCopy region{};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = { swapChainExtent.width, swapChainExtent.height, 1 };
+
+        vkCmdCopyImageToBuffer(commandBuffer, swapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffers[imageIndex], 1, &region);
+    }
+
+    /// <summary>
+    /// Writes the frame waiting in the given slot's readback buffer out as a binary .ppm. The GPU has to be done with that slot.
+    /// </summary>
+    void writeReadback(uint32_t slot)
+    {
+        if (readbackBuffers.empty() || pendingReadbackFrames[slot] < 0)
+            return;
+
+        char fileName[32];
+        snprintf(fileName, sizeof(fileName), "frame_%06lld.ppm", static_cast<long long>(pendingReadbackFrames[slot]));
+        pendingReadbackFrames[slot] = -1;
+
+        std::ofstream file(std::filesystem::path(options.headless.dumpDirectory) / fileName, std::ios::binary);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("Error writing frame: " + std::string(fileName));
+        }
+
+        file << "P6\n" << swapChainExtent.width << " " << swapChainExtent.height << "\n255\n";
+
+        // RGBA -> RGB, the values are already sRGB encoded like .ppm expects
+        const uint8_t* pixels = static_cast<const uint8_t*>(readbackBuffersMapped[slot]);
+        std::vector<char> row(swapChainExtent.width * 3);
+        for (uint32_t y = 0; y < swapChainExtent.height; y++)
+        {
+            for (uint32_t x = 0; x < swapChainExtent.width; x++)
+            {
+                const uint8_t* pixel = pixels + (static_cast<size_t>(y) * swapChainExtent.width + x) * 4;
+                row[x * 3 + 0] = static_cast<char>(pixel[0]);
+                row[x * 3 + 1] = static_cast<char>(pixel[1]);
+                row[x * 3 + 2] = static_cast<char>(pixel[2]);
+            }
+            file.write(row.data(), row.size());
+        }
+    }
+
+    /// <summary>
+    /// Calls "vkCreateInstance", stores instance in private member "instance". Checks for validation layer support before doing so.
+    /// </summary>
+    void createInstance() {
+        if (enableValidationLayers && !checkValidationLayerSupport())
+        {
+            throw std::runtime_error("Validation layer(s) requested, but not available.");
+        }
+
+        VkApplicationInfo appInfo{};
+        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        appInfo.pApplicationName = "Hello Triangle";
+        appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+        appInfo.pEngineName = "No engine";
+        appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+        appInfo.apiVersion = VK_API_VERSION_1_3; // timeline semaphores are core in 1.2, dynamic rendering and synchronization2 in 1.3
+
+        VkInstanceCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        createInfo.pApplicationInfo = &appInfo;
+
+        VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
+        if (enableValidationLayers)
+        {
+            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
+            createInfo.ppEnabledLayerNames = validationLayers.data();
+
+            populateDebugMessengerCreateInfo(debugCreateInfo);
+            createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)&debugCreateInfo;
+        }
+        else
+        {
+            createInfo.enabledLayerCount = 0;
+            createInfo.pNext = nullptr;
+        }
+
+        auto extensions = getRequiredExtensions();
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+        createInfo.ppEnabledExtensionNames = extensions.data();
+
+        if (vkCreateInstance(&createInfo, allocator, &instance) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create instance!");
+        }
+    }
+
+    /// <summary>
+    /// Enumerates through all avilable extensions.
+    /// </summary>
+    void checkVulkanExtensions()
+    {
+        uint32_t extensionCount = 0;
+        vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> extensions(extensionCount);
+        vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensions.data());
+
+        std::cout << "Available Vulkan extensions:" << std::endl;
+
+        for (const auto& extension : extensions)
+        {
+            std::cout << "\t" << extension.extensionName << " | " << extension.specVersion << std::endl;
+        }
+    }
+
+    /// <summary>
+    /// Will attempt to find the index of each of the queue families that are present as members in "QueueFamilyIndices".
+    /// </summary>
+    /// <param name="device"></param>
+    /// <returns></returns>
+    QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device)
+    {
+        QueueFamilyIndices indices;
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+
+        int i = 0;
+        for (const auto& queueFamily : queueFamilies)
+        {
+            if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+            {
+                indices.graphicsFamily = i;
+            }
+
+            VkBool32 presentSupport = false;
+            if (options.headless.enabled)
+            {
+                // nothing gets presented, so any family that can draw will do
+                presentSupport = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+            }
+            else
+            {
+                vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+            }
+            if (presentSupport)
+            {
+                indices.presentationFamily = i;
+            }
+
+            if (indices.isComplete())
+                break;
+
+            i++;
+        }
+
+        // look for a transfer family that doesn't do graphics, preferably a pure copy engine that doesn't do compute either
+        for (uint32_t j = 0; j < queueFamilyCount; j++)
+        {
+            VkQueueFlags flags = queueFamilies[j].queueFlags;
+            if (!(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT))
+                continue;
+
+            if (!indices.transferFamily.has_value() || !(flags & VK_QUEUE_COMPUTE_BIT))
+            {
+                indices.transferFamily = j;
+            }
+        }
+
+        return indices;
+    }
+
+    /// <summary>
+    /// Fills out a "SwapChainSupportDetails" struct
+    /// </summary>
+    /// <param name="device"></param>
+    /// <returns></returns>
+    SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device)
+    {
+        SwapChainSupportDetails details;
+        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
+
+        uint32_t formatCount;
+        vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
+        if (formatCount != 0)
+        {
+            details.formats.resize(formatCount);
+            vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, details.formats.data());
+        }
+
+        uint32_t presentModeCount = 0;
+        vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, nullptr);
+        if (presentModeCount != 0)
+        {
+            details.presentModes.resize(presentModeCount);
+            vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, details.presentModes.data());
+        }
+        
+        return details;
+    }
+
+    /// <summary>
+    /// Enumerates through all available extension on given physical device, and checks to see if all of the requested extensions (in the const global vector) are present.
+    /// </summary>
+    /// <param name="physicalDevice"></param>
+    /// <returns></returns>
+    bool checkDeviceExtensionSupport(VkPhysicalDevice device)
+    {
+        uint32_t extensionsCount = 0;
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionsCount, nullptr);
+        std::vector<VkExtensionProperties> availableExtensions(extensionsCount);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionsCount, availableExtensions.data());
+
+        std::vector<const char*> deviceExtensions = getRequiredDeviceExtensions();
+        std::set<std::string>requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+
+        // We have all the available extensions, and we have the required ones, so if we loop through all of the available ones and erase them from the vector of requestedExtensions
+        // then we can just check to see if the vector has anything left. If it's empty, that means we're good to go.
+        for (const auto& extension : availableExtensions)
+        {
+            requiredExtensions.erase(extension.extensionName);
+        }
+
+        return requiredExtensions.empty(); // If list is empty, they were all checked off.
+    }
+
+    /// <summary>
+    /// Device extensions we need. The swapchain extension isn't needed in headless mode.
+    /// </summary>
+    std::vector<const char*> getRequiredDeviceExtensions()
+    {
+        if (options.headless.enabled)
+        {
+            return {};
+        }
+
+        return physicalDeviceExtensions;
+    }
+
+    /// <summary>
+    /// Verifies a device is suitable for our program.
+    /// </summary>
+    /// <param name="device"></param>
+    /// <returns></returns>
+    bool isDeviceSuitable(VkPhysicalDevice device)
+    {
+        QueueFamilyIndices indices = findQueueFamilies(device);
+        bool extensionsSupported = checkDeviceExtensionSupport(device);
+
+        bool swapChainAcceptable = options.headless.enabled;
+        if (extensionsSupported && !options.headless.enabled)
+        {
+            SwapChainSupportDetails details = querySwapChainSupport(device);
+            swapChainAcceptable = !details.formats.empty() && !details.presentModes.empty();
+        }
+
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
+
+        // frame and upload synchronization is built on Vulkan 1.2 timeline semaphores, the render graph on 1.3
+        // dynamic rendering and synchronization2
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+        if (properties.apiVersion < VK_API_VERSION_1_3)
+        {
+            return false;
+        }
+
+        VkPhysicalDeviceVulkan13Features vulkan13Features{};
+        vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+        VkPhysicalDeviceVulkan12Features vulkan12Features{};
+        vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        vulkan12Features.pNext = &vulkan13Features;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &vulkan12Features;
+        vkGetPhysicalDeviceFeatures2(device, &features2);
+
+        // the bindless texture table needs descriptor indexing
+        bool descriptorIndexingSupported = vulkan12Features.runtimeDescriptorArray && vulkan12Features.shaderSampledImageArrayNonUniformIndexing &&
+            vulkan12Features.descriptorBindingPartiallyBound && vulkan12Features.descriptorBindingSampledImageUpdateAfterBind &&
+            vulkan12Features.descriptorBindingVariableDescriptorCount;
+
+        return indices.isComplete() && extensionsSupported && swapChainAcceptable && supportedFeatures.samplerAnisotropy && vulkan12Features.timelineSemaphore &&
+            descriptorIndexingSupported && vulkan13Features.dynamicRendering && vulkan13Features.synchronization2;
+    }
+
+    /// <summary>
+    /// enumerates through physical devices available and picks one to use as the physical device.
+    /// </summary>
+    void pickPhysicalDevice()
+    {
+        uint32_t deviceCount = 0;
+        vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+        if (deviceCount == 0)
+        {
+            throw std::runtime_error("No Vulkan Physical Devices found.");
+        }
+        std::vector<VkPhysicalDevice> devices(deviceCount);
+        vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+
+        for (auto& device : devices)
+        {
+            if (isDeviceSuitable(device))
+            {
+                physicalDevice = device;
+                break;
+            }
+        }
+
+        if (physicalDevice == VK_NULL_HANDLE)
+        {
+            throw std::runtime_error("No suitable physical devices found.");
+        }
+    }
+
+    /// <summary>
+    /// Creates a logical device with queue families created based off of the "QueueFamilyIndices" struct. Hooks up validation laers in create info struct here as well.
+    /// </summary>
+    void createLogicalDevice()
+    {
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+
+        std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+        std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentationFamily.value() };
+        if (indices.transferFamily.has_value())
+        {
+            uniqueQueueFamilies.insert(indices.transferFamily.value());
+        }
+
+        float queuePriority = 1.0f;
+
+        for (uint32_t queueFamily : uniqueQueueFamilies)
+        {
+            VkDeviceQueueCreateInfo queueCreateInfo{};
+            queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+            queueCreateInfo.queueFamilyIndex = queueFamily;
+            queueCreateInfo.queueCount = 1;
+            queueCreateInfo.pQueuePriorities = &queuePriority;
+            queueCreateInfos.push_back(queueCreateInfo);
+        }
+
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
+        VkPhysicalDeviceFeatures deviceFeatures{};
+        deviceFeatures.samplerAnisotropy = VK_TRUE;
+        // optional, only used to count fragment shader invocations, including those of draws in secondary buffers
+        deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+        deviceFeatures.inheritedQueries = supportedFeatures.inheritedQueries;
+
+        // GPU-driven rendering issues all its draws with one indirect draw whose count the GPU wrote
+        if (options.gpuDriven)
+        {
+            VkPhysicalDeviceVulkan12Features supported12Features{};
+            supported12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+            VkPhysicalDeviceFeatures2 features2{};
+            features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            features2.pNext = &supported12Features;
+            vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+            VkPhysicalDeviceProperties properties{};
+            vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+            if (!supportedFeatures.multiDrawIndirect || !supported12Features.drawIndirectCount ||
+                properties.limits.maxDrawIndirectCount < options.instanceCount)
+            {
+                std::cout << "The device can't draw " << options.instanceCount << " instances with one indirect count draw, GPU-driven rendering is turned off." << std::endl;
+                options.gpuDriven = false;
+            }
+        }
+        deviceFeatures.multiDrawIndirect = options.gpuDriven ? VK_TRUE : VK_FALSE;
+
+        VkPhysicalDeviceVulkan12Features vulkan12Features{};
+        vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        vulkan12Features.drawIndirectCount = options.gpuDriven ? VK_TRUE : VK_FALSE;
+        vulkan12Features.timelineSemaphore = VK_TRUE;
+        vulkan12Features.runtimeDescriptorArray = VK_TRUE;
+        vulkan12Features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+        vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;
+        vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        vulkan12Features.descriptorBindingVariableDescriptorCount = VK_TRUE;
+
+        VkPhysicalDeviceVulkan13Features vulkan13Features{};
+        vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+        vulkan13Features.dynamicRendering = VK_TRUE;
+        vulkan13Features.synchronization2 = VK_TRUE;
+        vulkan12Features.pNext = &vulkan13Features;
+
+        VkDeviceCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        createInfo.pNext = &vulkan12Features;
+        createInfo.pQueueCreateInfos = queueCreateInfos.data();
+        createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+
+        createInfo.pEnabledFeatures = &deviceFeatures;
+
+        std::vector<const char*> deviceExtensions = getRequiredDeviceExtensions();
+#if ENABLE_PROFILING
+        bool calibratedTimestamps = !options.tracePath.empty() && supportsCalibratedTimestamps();
+        if (calibratedTimestamps)
+        {
+            deviceExtensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+        }
+#endif
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+
+        if (enableValidationLayers)
+        {
+            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
+            createInfo.ppEnabledLayerNames = validationLayers.data();
+        }
+        {
+            createInfo.enabledLayerCount = 0;
+        }
+
+        if (vkCreateDevice(physicalDevice, &createInfo, allocator, &device) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Logical device creation failed.");
+        }
+
+        vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
+        vkGetDeviceQueue(device, indices.presentationFamily.value(), 0, &presentationQueue);
+        vkGetDeviceQueue(device, indices.transferFamily.value_or(indices.graphicsFamily.value()), 0, &transferQueue);
+#if ENABLE_PROFILING
+        if (calibratedTimestamps)
+        {
+            getCalibratedTimestamps = (PFN_vkGetCalibratedTimestampsEXT)vkGetDeviceProcAddr(device, "vkGetCalibratedTimestampsEXT");
+        }
+#endif
+    }
+
+    /// <summary>
+    /// Uses "glfwCreateSurface" to create a VkSurfaceKHR. Populates private member "surface".
+    /// </summary>
+    void createSurface()
+    {
+        if (options.headless.enabled)
+            return;
+
+        if (glfwCreateWindowSurface(instance, window, allocator, &surface))
+        {
+            throw std::runtime_error("Failed to create window surface.");
+        }
+    }
+
+    VkShaderModule createShaderModule(const std::vector<char>& code) {
+        VkShaderModuleCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        createInfo.codeSize = code.size();
+        createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(device, &createInfo, allocator, &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shader module!");
+        }
+
+        return shaderModule;
+    }
+
+    /// <summary>
+    /// Creates the vkPipelineLayout object. isn't dependent on too much outside information, it's mostly just pipeline configuration in here.
+    /// </summary>
+    void createGraphicsPipeline()
+    {
+        auto vertShaderCode = readFile("./shaders/vert.spv");
+        auto fragShaderCode = readFile("./shaders/frag.spv");
+
+        VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
+        VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+
+        VkPipelineShaderStageCreateInfo vertCreateInfo{};
+        vertCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        vertCreateInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        vertCreateInfo.module = vertShaderModule;
+        vertCreateInfo.pName = "main";
+
+        VkPipelineShaderStageCreateInfo fragCreateInfo{};
+        fragCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        fragCreateInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        fragCreateInfo.module = fragShaderModule;
+        fragCreateInfo.pName = "main";
+
+        VkPipelineShaderStageCreateInfo shaderStages[] = { vertCreateInfo, fragCreateInfo };
+
+        // binding 0 is per vertex, binding 1 per instance
+        std::array<VkVertexInputBindingDescription, 2> bindingDescriptions = { Vertex::getBindingDescription(), InstanceData::getBindingDescription() };
+        auto vertexAttributes = Vertex::getAttributeDescriptions();
+        auto instanceAttributes = InstanceData::getAttributeDescriptions();
+        std::array<VkVertexInputAttributeDescription, std::tuple_size_v<decltype(vertexAttributes)> + std::tuple_size_v<decltype(instanceAttributes)>> attributeDescriptions{};
+        std::copy(vertexAttributes.begin(), vertexAttributes.end(), attributeDescriptions.begin());
+        std::copy(instanceAttributes.begin(), instanceAttributes.end(), attributeDescriptions.begin() + vertexAttributes.size());
+
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+        vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
+        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+        /* 
+        * This is unecessary per below comment
+        * Leaving here in case I want to use it.
+        VkViewport viewport{};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = (float)swapChainExtent.width;
+        viewport.height = (float)swapChainExtent.height;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        */
+
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.scissorCount = 1;
+        // The pointers to the viewport and scissor are left null here because
+        // having them as a dynamic state means that we are required to define the viewport(s) and scissor(s) at draw-time.
+
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.depthClampEnable = VK_FALSE;
+        rasterizer.rasterizerDiscardEnable = VK_FALSE;
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+        rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        rasterizer.depthBiasEnable = VK_FALSE;
+        rasterizer.lineWidth = 1.0f;
+
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = msaaSamples;
+
+        VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        colorBlendAttachment.blendEnable = VK_FALSE;
+
+        VkPipelineColorBlendStateCreateInfo colorBlending{};
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlending.logicOpEnable = VK_FALSE;
+        colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
+        colorBlending.attachmentCount = 1;
+        colorBlending.pAttachments = &colorBlendAttachment;
+        colorBlending.blendConstants[0] = 0.0f; // Optional
+        colorBlending.blendConstants[1] = 0.0f; // Optional
+        colorBlending.blendConstants[2] = 0.0f; // Optional
+        colorBlending.blendConstants[3] = 0.0f; // Optional
+
+        std::vector<VkDynamicState> dynamicStates =
+        {
+            VK_DYNAMIC_STATE_VIEWPORT,
+            VK_DYNAMIC_STATE_SCISSOR
+        };
+
+        VkPipelineDynamicStateCreateInfo dynamicState{};
+        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+        dynamicState.pDynamicStates = dynamicStates.data();
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        std::array<VkDescriptorSetLayout, 2> setLayouts = { frameSetLayout.layout, bindlessSetLayout };
+        pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+        pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+        pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
+        pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
+
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, allocator, &pipelineLayout) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Unable to create graphics pipeline layout.");
+        }
+
+        VkPipelineDepthStencilStateCreateInfo depthStencil{};
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = VK_TRUE;
+        // after a depth pre-pass only the fragments that ended up in the depth buffer pass
+        depthStencil.depthWriteEnable = options.depthPrepass ? VK_FALSE : VK_TRUE;
+        depthStencil.depthCompareOp = options.depthPrepass ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS;
+        depthStencil.depthBoundsTestEnable = VK_FALSE;
+        depthStencil.minDepthBounds = 0.0f; // Optional
+        depthStencil.maxDepthBounds = 1.0f; // Optional
+        depthStencil.stencilTestEnable = VK_FALSE;
+        depthStencil.front = {}; // Optional
+        depthStencil.back = {}; // Optional
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = 2;
+        pipelineInfo.pStages = shaderStages;
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = &depthStencil; // Optional
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDynamicState = &dynamicState;
+        pipelineInfo.layout = pipelineLayout;
+        pipelineInfo.renderPass = VK_NULL_HANDLE;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+        // dynamic rendering, the pipeline only needs to know the attachment formats of the main pass
+        VkPipelineRenderingCreateInfo renderingInfo{};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+        renderingInfo.colorAttachmentCount = 1;
+        renderingInfo.pColorAttachmentFormats = &swapChainImageFormat;
+        renderingInfo.depthAttachmentFormat = depthFormat;
+        pipelineInfo.pNext = &renderingInfo;
+
+        VkPipeline pipeline;
+        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, static_cast<uint32_t>(1), &pipelineInfo, allocator, &pipeline) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Unable to create graphics pipeline.");
+        }
+        // a pipeline this replaces is retired, frames in flight may still be using it
+        graphicsPipeline = own<vkDestroyPipeline>(pipeline);
+
+        vkDestroyShaderModule(device, vertShaderModule, allocator);
+        vkDestroyShaderModule(device, fragShaderModule, allocator);
+
+        // recorded buffers still bind the old pipeline
+        commandCacheDirty = true;
+    }
+
+    /// <summary>
+    /// Creates the depth pre-pass pipeline: positions and instance transforms in, depth out, and no fragment shader.
+    /// Uses the main pipeline's layout, so it has to be created after it.
+    /// </summary>
+    void createDepthPrepassPipeline()
+    {
+        if (!options.depthPrepass)
+            return;
+
+        auto vertShaderCode = readFile("./shaders/depth.spv");
+        VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
+
+        VkPipelineShaderStageCreateInfo vertCreateInfo{};
+        vertCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        vertCreateInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        vertCreateInfo.module = vertShaderModule;
+        vertCreateInfo.pName = "main";
+
+        // binding 0 is the tightly packed positions, binding 1 the same instance data the main pass uses
+        VkVertexInputBindingDescription positionBinding{};
+        positionBinding.binding = 0;
+        positionBinding.stride = sizeof(glm::vec3);
+        positionBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        std::array<VkVertexInputBindingDescription, 2> bindingDescriptions = { positionBinding, InstanceData::getBindingDescription() };
+
+        // the position and the four columns of the model matrix, the texture index isn't needed
+        auto instanceAttributes = InstanceData::getAttributeDescriptions();
+        std::array<VkVertexInputAttributeDescription, 5> attributeDescriptions{};
+        attributeDescriptions[0].binding = 0;
+        attributeDescriptions[0].location = 0;
+        attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+        attributeDescriptions[0].offset = 0;
+        std::copy(instanceAttributes.begin(), instanceAttributes.begin() + 4, attributeDescriptions.begin() + 1);
+
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+        vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
+        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.scissorCount = 1;
+
+        // has to match the main pipeline, or the EQUAL test there fails on the triangles culled here
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.depthClampEnable = VK_FALSE;
+        rasterizer.rasterizerDiscardEnable = VK_FALSE;
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+        rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        rasterizer.depthBiasEnable = VK_FALSE;
+        rasterizer.lineWidth = 1.0f;
+
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = msaaSamples;
+
+        VkPipelineDepthStencilStateCreateInfo depthStencil{};
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = VK_TRUE;
+        depthStencil.depthWriteEnable = VK_TRUE;
+        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+        depthStencil.depthBoundsTestEnable = VK_FALSE;
+        depthStencil.stencilTestEnable = VK_FALSE;
+
+        VkPipelineColorBlendStateCreateInfo colorBlending{};
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlending.attachmentCount = 0;
+
+        std::array<VkDynamicState, 2> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+        VkPipelineDynamicStateCreateInfo dynamicState{};
+        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+        dynamicState.pDynamicStates = dynamicStates.data();
+
+        // no color attachments, only depth
+        VkPipelineRenderingCreateInfo renderingInfo{};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+        renderingInfo.colorAttachmentCount = 0;
+        renderingInfo.depthAttachmentFormat = depthFormat;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.pNext = &renderingInfo;
+        pipelineInfo.stageCount = 1;
+        pipelineInfo.pStages = &vertCreateInfo;
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = &depthStencil;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDynamicState = &dynamicState;
+        pipelineInfo.layout = pipelineLayout;
+        pipelineInfo.renderPass = VK_NULL_HANDLE;
+
+        VkPipeline pipeline;
+        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, allocator, &pipeline) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Unable to create depth pre-pass pipeline.");
+        }
+        depthPrepassPipeline = own<vkDestroyPipeline>(pipeline);
+
+        vkDestroyShaderModule(device, vertShaderModule, allocator);
+
+        commandCacheDirty = true;
+    }
+
+    static std::vector<char> readFile(const std::string& filename)
+    {
+        std::ifstream file(filename, std::ios::ate | std::ios::binary);
+
+        if (!file.is_open())
+        {
+            throw std::runtime_error("Error reading file: " + filename);
+        }
+
+        size_t filesize = (size_t) file.tellg();
+        std::vector<char> buffer(filesize);
+
+        file.seekg(0);
+        file.read(buffer.data(), filesize);
+
+        file.close();
+        return buffer;
+    }
+
+    /// <summary>
+    /// Declares the frame's passes and the images and buffers they use, then compiles the graph for the current
+    /// swapchain size. Passes render with dynamic rendering, so there are no render pass or framebuffer objects.
+    /// </summary>
+    void createRenderGraph()
+    {
+        // the late culling phase draws on top of the early one, a pre-pass would have to be split the same way
+        if (options.occlusionCulling && options.depthPrepass)
+        {
+            std::cout << "The depth pre-pass doesn't work with occlusion culling, it's turned off." << std::endl;
+            options.depthPrepass = false;
+        }
+        if (options.occlusionCulling && options.gpuDriven)
+        {
+            std::cout << "GPU-driven rendering doesn't work with occlusion culling, which draws indirectly already. It's turned off." << std::endl;
+            options.gpuDriven = false;
+        }
+        if (options.gpuDriven && options.frustumCulling)
+        {
+            std::cout << "CPU frustum culling isn't used with GPU-driven rendering, the draw generation shader culls." << std::endl;
+            options.frustumCulling = false;
+        }
+        // the culling shader tests every instance against the frustum, and tracks visibility by instance index
+        if (options.occlusionCulling && options.frustumCulling)
+        {
+            std::cout << "CPU frustum culling isn't used with occlusion culling, the culling shader tests the frustum too." << std::endl;
+            options.frustumCulling = false;
+        }
+
+        depthFormat = findDepthFormat();
+        msaaSamples = chooseSampleCount();
+        renderGraph.init(device, physicalDevice, allocator, deletionQueue);
+
+        // the first pass waits for the image available semaphore, which the submit waits for at color attachment output.
+        // headless frames are left as they are, or copied out, instead of presented
+        colorTarget = renderGraph.importImage("color target", swapChainImageFormat, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+            options.headless.enabled ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, true);
+        depthTarget = renderGraph.createImage("depth", depthFormat, msaaSamples);
+
+        if (options.gpuDriven)
+        {
+            addDrawGenerationPass();
+        }
+
+        // the main pass then only tests against the finished depth buffer
+        if (options.depthPrepass)
+        {
+            uint32_t depthPrepass = renderGraph.addPass("depth pre-pass", [this](VkCommandBuffer commandBuffer) {
+                if (options.gpuDriven)
+                    recordGeneratedDraws(commandBuffer, true);
+                else
+                    recordDraws(commandBuffer, 0, recordJob.drawCount, true);
+            });
+            renderGraph.setDepthAttachment(depthPrepass, depthTarget, true, { 1.0f, 0 });
+            readGeneratedDraws(depthPrepass);
+        }
+
+        if (options.occlusionCulling)
+        {
+            addOcclusionCullingPasses();
+        }
+        else
+        {
+            mainPass = renderGraph.addPass("main pass", [this](VkCommandBuffer commandBuffer) { recordMainPass(commandBuffer); });
+            if (msaaSamples == VK_SAMPLE_COUNT_1_BIT)
+            {
+                renderGraph.addColorAttachment(mainPass, colorTarget, true, { {0.0f, 0.0f, 0.0f, 1.0f} });
+            }
+            else
+            {
+                // resolved at the end of the pass, the samples themselves are never stored
+                msaaColorTarget = renderGraph.createImage("msaa color", swapChainImageFormat, msaaSamples);
+                renderGraph.addColorAttachment(mainPass, msaaColorTarget, true, { {0.0f, 0.0f, 0.0f, 1.0f} }, colorTarget);
+            }
+            if (options.depthPrepass)
+            {
+                renderGraph.setDepthAttachment(mainPass, depthTarget, false, {}, true);
+            }
+            else
+            {
+                renderGraph.setDepthAttachment(mainPass, depthTarget, true, { 1.0f, 0 });
+            }
+            readGeneratedDraws(mainPass);
+        }
+
+        if (options.gpuDriven)
+        {
+            drawCountReadbackTarget = renderGraph.importBuffer("draw count readback", VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT, true);
+            uint32_t copyPass = renderGraph.addPass("copy draw count", [this](VkCommandBuffer commandBuffer) { copyDrawCount(commandBuffer); });
+            renderGraph.read(copyPass, drawCountTarget, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+            renderGraph.write(copyPass, drawCountReadbackTarget, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+        }
+
+        // the copy out only matters when frames get written to disk, otherwise it's culled
+        if (options.headless.enabled)
+        {
+            bool writeFrames = !options.headless.dumpDirectory.empty();
+            readbackTarget = renderGraph.importBuffer("readback", VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT, writeFrames);
+            uint32_t readbackPass = renderGraph.addPass("readback", [this](VkCommandBuffer commandBuffer) { recordReadback(commandBuffer, recordJob.imageIndex); });
+            renderGraph.read(readbackPass, colorTarget, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+            renderGraph.write(readbackPass, readbackTarget, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+        }
+
+        renderGraph.compile(swapChainExtent);
+
+        const RenderGraphStats& stats = renderGraph.getStats();
+        std::cout << "Render graph: " << stats.passCount - stats.culledPassCount << " of " << stats.passCount << " pass(es) ("
+            << stats.culledPassCount << " culled), " << stats.barrierCount << " barrier(s) in " << stats.barrierBatchCount << " batch(es) per frame, "
+            << stats.transientBytes / 1024 << " KiB of transient images (" << stats.aliasingSavedBytes() / 1024 << " KiB saved by aliasing)" << std::endl;
+        std::cout << "Attachments: " << msaaSamples << "x MSAA, " << stats.lazyBytes / 1024 << " KiB of the transient images lazily allocated, ~"
+            << stats.attachmentTrafficBytes / (1024 * 1024) << " MiB of attachment loads, stores and resolves per frame" << std::endl;
+    }
+
+    /// <summary>
+    /// Declares the compute pass GPU-driven rendering starts with. It writes the transforms of the visible instances,
+    /// a draw for each and the number of draws, and the passes after it draw them with one indirect count draw.
+    /// </summary>
+    void addDrawGenerationPass()
+    {
+        // rewritten every frame, only the last frame's reads have to be done first
+        generatedInstanceTarget = renderGraph.importBuffer("generated instances", VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, false,
+            VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT);
+        generatedDrawTarget = renderGraph.importBuffer("generated draws", VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, false,
+            VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT);
+        drawCountTarget = renderGraph.importBuffer("draw count", VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, false,
+            VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_COPY_BIT);
+
+        uint32_t resetPass = renderGraph.addPass("reset draw count", [this](VkCommandBuffer commandBuffer) {
+            vkCmdFillBuffer(commandBuffer, drawCountBuffer.get(), 0, sizeof(uint32_t), 0);
+        });
+        renderGraph.write(resetPass, drawCountTarget, VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+
+        uint32_t generatePass = renderGraph.addPass("generate draws", [this](VkCommandBuffer commandBuffer) { dispatchDrawGeneration(commandBuffer); });
+        renderGraph.read(generatePass, drawCountTarget, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+        renderGraph.write(generatePass, drawCountTarget, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+        renderGraph.write(generatePass, generatedInstanceTarget, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+        renderGraph.write(generatePass, generatedDrawTarget, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+    }
+
+    /// <summary>
+    /// Declares that "pass" draws what the draw generation pass wrote. Does nothing without GPU-driven rendering.
+    /// </summary>
+    void readGeneratedDraws(uint32_t pass)
+    {
+        if (!options.gpuDriven)
+            return;
+
+        renderGraph.read(pass, generatedDrawTarget, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+        renderGraph.read(pass, drawCountTarget, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+        renderGraph.read(pass, generatedInstanceTarget, VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT);
+    }
+
+    /// <summary>
+    /// Declares two-phase occlusion culling in place of the main pass. The early phase draws what was visible last
+    /// frame, the depth pyramid is built from the depth that leaves, and the late phase tests every instance against
+    /// it and draws the visible ones the early phase missed. Visibility for the next frame comes from the late test,
+    /// so instances coming into view are drawn in the frame they appear instead of popping in a frame later.
+    /// </summary>
+    void addOcclusionCullingPasses()
+    {
+        hiZTarget = renderGraph.importImage("hi-z", VK_FORMAT_R32_SFLOAT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false);
+        // read by the next frame's early phase
+        visibilityTarget = renderGraph.importBuffer("visibility", VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, true,
+            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+        // rewritten every frame, only the last frame's reads have to be done first
+        drawCommandTarget = renderGraph.importBuffer("draw commands", VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, false,
+            VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_COPY_BIT);
+        culledInstanceTarget = renderGraph.importBuffer("culled instances", VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, false,
+            VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT);
+        cullingStatsTarget = renderGraph.importBuffer("culling stats", VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT, true);
+
+        uint32_t resetPass = renderGraph.addPass("reset draw commands", [this](VkCommandBuffer commandBuffer) { resetDrawCommands(commandBuffer); });
+        renderGraph.write(resetPass, drawCommandTarget, VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+
+        // both phases bind the same set, so the pyramid has to be in its layout even though the early phase doesn't sample it
+        uint32_t earlyCullPass = renderGraph.addPass("early cull", [this](VkCommandBuffer commandBuffer) { dispatchCull(commandBuffer, false); });
+        renderGraph.read(earlyCullPass, visibilityTarget, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+        renderGraph.read(earlyCullPass, drawCommandTarget, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+        renderGraph.write(earlyCullPass, drawCommandTarget, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+        renderGraph.write(earlyCullPass, culledInstanceTarget, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+        renderGraph.read(earlyCullPass, hiZTarget, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_GENERAL);
+
+        mainPass = renderGraph.addPass("early draw", [this](VkCommandBuffer commandBuffer) { recordCulledDraws(commandBuffer, 0); });
+        renderGraph.addColorAttachment(mainPass, colorTarget, true, { {0.0f, 0.0f, 0.0f, 1.0f} });
+        renderGraph.setDepthAttachment(mainPass, depthTarget, true, { 1.0f, 0 });
+        renderGraph.read(mainPass, drawCommandTarget, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+        renderGraph.read(mainPass, culledInstanceTarget, VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT);
+
+        // each level reads the one before, "buildHiZ" has the barriers between them
+        uint32_t hiZPass = renderGraph.addPass("build hi-z", [this](VkCommandBuffer commandBuffer) { buildHiZ(commandBuffer); });
+        renderGraph.read(hiZPass, depthTarget, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        renderGraph.write(hiZPass, hiZTarget, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+            VK_IMAGE_LAYOUT_GENERAL);
+
+        uint32_t lateCullPass = renderGraph.addPass("late cull", [this](VkCommandBuffer commandBuffer) { dispatchCull(commandBuffer, true); });
+        renderGraph.read(lateCullPass, visibilityTarget, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+        renderGraph.write(lateCullPass, visibilityTarget, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+        renderGraph.read(lateCullPass, drawCommandTarget, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+        renderGraph.write(lateCullPass, drawCommandTarget, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+        renderGraph.write(lateCullPass, culledInstanceTarget, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+        renderGraph.read(lateCullPass, hiZTarget, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_GENERAL);
+
+        uint32_t lateDrawPass = renderGraph.addPass("late draw", [this](VkCommandBuffer commandBuffer) { recordCulledDraws(commandBuffer, 1); });
+        renderGraph.addColorAttachment(lateDrawPass, colorTarget, false);
+        renderGraph.setDepthAttachment(lateDrawPass, depthTarget, false);
+        renderGraph.read(lateDrawPass, drawCommandTarget, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+        renderGraph.read(lateDrawPass, culledInstanceTarget, VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT);
+
+        uint32_t statsPass = renderGraph.addPass("copy culling stats", [this](VkCommandBuffer commandBuffer) { copyCullingStats(commandBuffer); });
+        renderGraph.read(statsPass, drawCommandTarget, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+        renderGraph.write(statsPass, cullingStatsTarget, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+    }
+
+    /// <summary>
+    /// Highest sample count up to the requested one that color and depth attachments both support.
+    /// </summary>
+    VkSampleCountFlagBits chooseSampleCount()
+    {
+        // the depth pyramid is built from single sampled depth
+        if (options.occlusionCulling && options.msaaSamples > 1)
+        {
+            std::cout << "MSAA doesn't work with occlusion culling, using 1x." << std::endl;
+            return VK_SAMPLE_COUNT_1_BIT;
+        }
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        VkSampleCountFlags supported = properties.limits.framebufferColorSampleCounts & properties.limits.framebufferDepthSampleCounts;
+
+        uint32_t samples = 1;
+        while (samples * 2 <= options.msaaSamples && (supported & (samples * 2)))
+        {
+            samples *= 2;
+        }
+
+        if (samples != options.msaaSamples)
+        {
+            std::cout << options.msaaSamples << "x MSAA isn't supported, using " << samples << "x." << std::endl;
+        }
+        return static_cast<VkSampleCountFlagBits>(samples);
+    }
+
+    void createCommandPool()
+    {
+        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+        if (vkCreateCommandPool(device, &poolInfo, allocator, &commandPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Unablw to create command pool.");
+        }
+
+        if (queueFamilyIndices.transferFamily.has_value())
+        {
+            poolInfo.queueFamilyIndex = queueFamilyIndices.transferFamily.value();
+            if (vkCreateCommandPool(device, &poolInfo, allocator, &transferCommandPool) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Unable to create transfer command pool.");
+            }
+        }
+    }
+
+    void createCommandBuffers()
+    {
+        commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = (uint32_t) commandBuffers.size();
+
+        if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate command buffers!");
+        }
+    }
+
+    /// <summary>
+    /// Creates the timestamp queries benchmark runs measure GPU frame time with. Leaves "timestampQueryPool" null
+    /// if this isn't a benchmark run or the graphics queue can't write timestamps.
+    /// </summary>
+    void createTimestampQueries()
+    {
+        timestampSamples.fill(-1);
+
+        if (!options.benchmark.enabled)
+            return;
+
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+        if (queueFamilies[indices.graphicsFamily.value()].timestampValidBits == 0)
+        {
+            std::cout << "Graphics queue doesn't support timestamps, GPU frame times won't be measured." << std::endl;
+            return;
+        }
+
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        timestampPeriod = properties.limits.timestampPeriod;
+
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = MAX_FRAMES_IN_FLIGHT * 2;
+
+        if (vkCreateQueryPool(device, &queryPoolInfo, allocator, &timestampQueryPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create timestamp query pool!");
+        }
+    }
+
+    /// <summary>
+    /// Stores the GPU time of the last frame rendered in the given slot into its benchmark sample.
+    /// The GPU has to be done with that slot.
+    /// </summary>
+    void readGpuTimestamps(uint32_t slot)
+    {
+        if (timestampSamples[slot] < 0)
+            return;
+
+        uint64_t timestamps[2];
+        VkResult result = vkGetQueryPoolResults(device, timestampQueryPool, slot * 2, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+        if (result == VK_SUCCESS)
+        {
+            benchmarkSamples[timestampSamples[slot]].gpuMs = (timestamps[1] - timestamps[0]) * static_cast<double>(timestampPeriod) / 1e6;
+        }
+        timestampSamples[slot] = -1;
+    }
+
+    /// <summary>
+    /// Creates the query counting each frame's fragment shader invocations, which shows how much shading the depth
+    /// pre-pass saves. Leaves "pipelineStatisticsPool" null if the device can't count them, or can't count them in
+    /// the secondary buffers record threads use.
+    /// </summary>
+    void createPipelineStatisticsQueries()
+    {
+        VkPhysicalDeviceFeatures features;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+        if (!features.pipelineStatisticsQuery || (options.recordThreads > 0 && !features.inheritedQueries))
+        {
+            std::cout << "Pipeline statistics aren't supported, fragment shader invocations won't be counted." << std::endl;
+            return;
+        }
+
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        queryPoolInfo.queryCount = MAX_FRAMES_IN_FLIGHT;
+        queryPoolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+        if (vkCreateQueryPool(device, &queryPoolInfo, allocator, &pipelineStatisticsPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline statistics query pool!");
+        }
+    }
+
+    /// <summary>
+    /// Adds the fragment shader invocations of the last frame rendered in the given slot to the latency stats.
+    /// The GPU has to be done with that slot.
+    /// </summary>
+    void readPipelineStatistics(uint32_t slot)
+    {
+        if (!pipelineStatisticsPending[slot])
+            return;
+
+        uint64_t invocations = 0;
+        VkResult result = vkGetQueryPoolResults(device, pipelineStatisticsPool, slot, 1, sizeof(invocations), &invocations, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+        if (result == VK_SUCCESS)
+        {
+            latencyStats.fragmentInvocations += invocations;
+            latencyStats.statisticsFrameCount++;
+        }
+        pipelineStatisticsPending[slot] = false;
+    }
+
+    /// <summary>
+    /// Creates what occlusion culling needs apart from the depth pyramid, see "addOcclusionCullingPasses".
+    /// </summary>
+    void createOcclusionCulling()
+    {
+        if (!options.occlusionCulling)
+            return;
+
+        VkFormatProperties depthProperties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, depthFormat, &depthProperties);
+        if (!(depthProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) || hasStencilComponent(depthFormat)) {
+            throw std::runtime_error("occlusion culling needs a depth format without stencil that can be sampled!");
+        }
+
+        std::array<VkDescriptorSetLayoutBinding, 6> cullBindings{};
+        for (uint32_t i = 0; i < cullBindings.size(); i++)
+        {
+            cullBindings[i].binding = i;
+            cullBindings[i].descriptorCount = 1;
+            cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+            cullBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        }
+        cullBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        cullBindings[5].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        cullSetLayout = createDescriptorLayout(cullBindings.data(), static_cast<uint32_t>(cullBindings.size()));
+
+        std::array<VkDescriptorSetLayoutBinding, 2> hiZBindings{};
+        for (uint32_t i = 0; i < hiZBindings.size(); i++)
+        {
+            hiZBindings[i].binding = i;
+            hiZBindings[i].descriptorCount = 1;
+            hiZBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+        hiZBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        hiZBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        hiZSetLayout = createDescriptorLayout(hiZBindings.data(), static_cast<uint32_t>(hiZBindings.size()));
+
+        cullPipelineLayout = createComputePipelineLayout(cullSetLayout.layout, sizeof(CullConstants));
+        hiZPipelineLayout = createComputePipelineLayout(hiZSetLayout.layout, sizeof(HiZConstants));
+        cullPipeline = own<vkDestroyPipeline>(createComputePipeline("./shaders/cull.spv", cullPipelineLayout));
+        hiZPipeline = own<vkDestroyPipeline>(createComputePipeline("./shaders/hiz.spv", hiZPipelineLayout));
+
+        culledInstanceCapacity = options.instanceCount;
+        VkDeviceSize visibilitySize = sizeof(uint32_t) * static_cast<VkDeviceSize>(culledInstanceCapacity);
+        createBuffer(visibilitySize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            visibilityBuffer, visibilityBufferMemory);
+        createBuffer(sizeof(VkDrawIndexedIndirectCommand) * 2,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawCommandBuffer, drawCommandBufferMemory);
+        createBuffer(sizeof(InstanceData) * 2 * static_cast<VkDeviceSize>(culledInstanceCapacity), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, culledInstanceBuffer, culledInstanceBufferMemory);
+
+        // nothing counts as visible before the first frame, so it's all drawn by the late phase
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+        vkCmdFillBuffer(commandBuffer, visibilityBuffer.get(), 0, VK_WHOLE_SIZE, 0);
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = visibilityBuffer.get();
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+        endSingleTimeCommands();
+
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            VkDeviceSize statsSize = sizeof(VkDrawIndexedIndirectCommand) * 2;
+            createBuffer(statsSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                cullingStatsBuffers[i], cullingStatsBuffersMemory[i]);
+            void* data;
+            vkMapMemory(device, cullingStatsBuffersMemory[i].get(), 0, statsSize, 0, &data);
+            cullingStatsMapped[i] = static_cast<VkDrawIndexedIndirectCommand*>(data);
+        }
+
+        // texels are read one at a time with texelFetch, only clamping matters
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_NEAREST;
+        samplerInfo.minFilter = VK_FILTER_NEAREST;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+        VkSampler sampler;
+        if (vkCreateSampler(device, &samplerInfo, allocator, &sampler) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create hi-z sampler!");
+        }
+        hiZSampler = own<vkDestroySampler>(sampler);
+
+        // also writes the culling sets
+        createHiZ();
+    }
+
+    /// <summary>
+    /// (Re-)creates the depth pyramid for the current swapchain size, along with the sets that read the depth buffer
+    /// or the pyramid. Call after the render graph is compiled, the depth buffer is one of its transient images.
+    /// </summary>
+    void createHiZ()
+    {
+        if (!options.occlusionCulling)
+            return;
+
+        // powers of two make every level exactly half the one before
+        hiZExtent.width = 1u << static_cast<uint32_t>(std::floor(std::log2(swapChainExtent.width)));
+        hiZExtent.height = 1u << static_cast<uint32_t>(std::floor(std::log2(swapChainExtent.height)));
+        uint32_t levels = static_cast<uint32_t>(std::floor(std::log2((std::max)(hiZExtent.width, hiZExtent.height)))) + 1;
+
+        createImage(hiZExtent.width, hiZExtent.height, levels, VK_FORMAT_R32_SFLOAT, VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, hiZImage, hiZImageMemory);
+        hiZView = own<vkDestroyImageView>(createImageView(hiZImage.get(), VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, levels));
+
+        // the old pyramid's sets may still be in use by frames in flight, like the pyramid itself
+        retireDescriptorAllocator(hiZDescriptors);
+
+        hiZLevelViews.resize(levels);
+        hiZSets.resize(levels);
+        for (uint32_t level = 0; level < levels; level++)
+        {
+            hiZLevelViews[level] = own<vkDestroyImageView>(createImageView(hiZImage.get(), VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 1, level));
+
+            DescriptorBinding source = level == 0
+                ? DescriptorBinding::forImage(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, renderGraph.imageView(depthTarget), hiZSampler.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+                : DescriptorBinding::forImage(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, hiZLevelViews[level - 1].get(), hiZSampler.get(), VK_IMAGE_LAYOUT_GENERAL);
+            hiZSets[level] = allocateDescriptorSet(hiZDescriptors, hiZSetLayout.layout);
+            std::array<DescriptorBinding, 2> bindings = {
+                source,
+                DescriptorBinding::forImage(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, hiZLevelViews[level].get(), VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL),
+            };
+            writeDescriptorSet(hiZSetLayout, hiZSets[level], bindings.data(), static_cast<uint32_t>(bindings.size()));
+        }
+
+        commandCacheDirty = true;
+    }
+
+    /// <summary>
+    /// Writes this frame's culling set, pointing at the frame's instance buffer and the current pyramid.
+    /// </summary>
+    void writeCullSet()
+    {
+        if (!options.occlusionCulling || hiZView.get() == VK_NULL_HANDLE)
+            return;
+
+        VkDeviceSize culledSize = sizeof(InstanceData) * 2 * static_cast<VkDeviceSize>(culledInstanceCapacity);
+        cullSet = allocateFrameDescriptorSet(cullSetLayout, {
+            DescriptorBinding::forBuffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, uniformRing.buffer, 0, sizeof(CameraUniforms)),
+            DescriptorBinding::forBuffer(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, instanceBuffers[currentFrame].get(), 0, VK_WHOLE_SIZE),
+            DescriptorBinding::forBuffer(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, visibilityBuffer.get(), 0, VK_WHOLE_SIZE),
+            DescriptorBinding::forBuffer(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, drawCommandBuffer.get(), 0, VK_WHOLE_SIZE),
+            DescriptorBinding::forBuffer(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, culledInstanceBuffer.get(), 0, culledSize),
+            DescriptorBinding::forImage(5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, hiZView.get(), hiZSampler.get(), VK_IMAGE_LAYOUT_GENERAL),
+        });
+    }
+
+    VkPipelineLayout createComputePipelineLayout(VkDescriptorSetLayout setLayout, uint32_t constantsSize)
+    {
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = constantsSize;
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &setLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        VkPipelineLayout layout;
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, allocator, &layout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create compute pipeline layout!");
+        }
+        return layout;
+    }
+
+    VkPipeline createComputePipeline(const std::string& shaderPath, VkPipelineLayout layout)
+    {
+        auto shaderCode = readFile(shaderPath);
+        VkShaderModule shaderModule = createShaderModule(shaderCode);
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = layout;
+
+        VkPipeline pipeline;
+        if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, allocator, &pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create compute pipeline " + shaderPath + "!");
+        }
+
+        vkDestroyShaderModule(device, shaderModule, allocator);
+        return pipeline;
+    }
+
+    /// <summary>
+    /// Adds how many instances each culling phase drew in the last frame rendered in the given slot to the latency
+    /// stats. The GPU has to be done with that slot.
+    /// </summary>
+    void readCullingStats(uint32_t slot)
+    {
+        if (!cullingStatsPending[slot])
+            return;
+
+        latencyStats.culledTestedInstances += (std::min)(instanceCounts[slot], culledInstanceCapacity);
+        latencyStats.earlyDrawnInstances += cullingStatsMapped[slot][0].instanceCount;
+        latencyStats.lateDrawnInstances += cullingStatsMapped[slot][1].instanceCount;
+        latencyStats.cullingFrameCount++;
+        cullingStatsPending[slot] = false;
+    }
+
+    /// <summary>
+    /// Creates what GPU-driven rendering needs: the draw generation pipeline, the instance offsets on the GPU and the
+    /// buffers the shader writes. Only the upper bound of every buffer depends on the instance count, so nothing here
+    /// changes per frame.
+    /// </summary>
+    void createGpuDrivenRendering()
+    {
+        if (!options.gpuDriven)
+            return;
+
+        std::array<VkDescriptorSetLayoutBinding, 6> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); i++)
+        {
+            bindings[i].binding = i;
+            bindings[i].descriptorCount = 1;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        }
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        drawGenerationSetLayout = createDescriptorLayout(bindings.data(), static_cast<uint32_t>(bindings.size()));
+        drawGenerationPipelineLayout = createComputePipelineLayout(drawGenerationSetLayout.layout, sizeof(DrawGenerationConstants));
+        drawGenerationPipeline = own<vkDestroyPipeline>(createComputePipeline("./shaders/drawgen.spv", drawGenerationPipelineLayout));
+
+        // the shader reads vec4s, std430 pads a vec3 array to that anyway
+        uint32_t capacity = static_cast<uint32_t>(instanceOffsets.size());
+        std::vector<glm::vec4> offsets(capacity);
+        for (uint32_t i = 0; i < capacity; i++)
+        {
+            offsets[i] = glm::vec4(instanceOffsets[i], 0.0f);
+        }
+        VkDeviceSize offsetsSize = sizeof(offsets[0]) * static_cast<VkDeviceSize>((std::max)(capacity, 1u));
+
+        VkBuffer stagingBuffer;
+        VkDeviceMemory stagingBufferMemory;
+        createBuffer(offsetsSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+        void* data;
+        vkMapMemory(device, stagingBufferMemory, 0, offsetsSize, 0, &data);
+        memcpy(data, offsets.data(), sizeof(offsets[0]) * offsets.size());
+        vkUnmapMemory(device, stagingBufferMemory);
+
+        createBuffer(offsetsSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            instanceOffsetBuffer, instanceOffsetBufferMemory);
+
+        // the copy and its ownership transfer go in one batch
+        beginUploadBatch();
+        copyBuffer(stagingBuffer, instanceOffsetBuffer.get(), offsetsSize);
+        transferBufferOwnership(instanceOffsetBuffer.get(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+        releaseStagingBuffer(stagingBuffer, stagingBufferMemory);
+        flushUploads(true);
+
+        VkDeviceSize instancesSize = sizeof(InstanceData) * static_cast<VkDeviceSize>((std::max)(capacity, 1u));
+        createBuffer(instancesSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            generatedInstanceBuffer, generatedInstanceBufferMemory);
+        createBuffer(sizeof(VkDrawIndexedIndirectCommand) * static_cast<VkDeviceSize>((std::max)(capacity, 1u)),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            generatedDrawBuffer, generatedDrawBufferMemory);
+        createBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawCountBuffer, drawCountBufferMemory);
+
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            createBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                drawCountReadbackBuffers[i], drawCountReadbackBuffersMemory[i]);
+            vkMapMemory(device, drawCountReadbackBuffersMemory[i].get(), 0, sizeof(uint32_t), 0, &data);
+            drawCountReadbackMapped[i] = static_cast<uint32_t*>(data);
+        }
+
+        drawGenerationSet = getPersistentDescriptorSet(drawGenerationSetLayout, {
+            DescriptorBinding::forBuffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, uniformRing.buffer, 0, sizeof(CameraUniforms)),
+            DescriptorBinding::forBuffer(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, uniformRing.buffer, 0, sizeof(InstanceUniforms)),
+            DescriptorBinding::forBuffer(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, instanceOffsetBuffer.get(), 0, VK_WHOLE_SIZE),
+            DescriptorBinding::forBuffer(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, generatedInstanceBuffer.get(), 0, VK_WHOLE_SIZE),
+            DescriptorBinding::forBuffer(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, generatedDrawBuffer.get(), 0, VK_WHOLE_SIZE),
+            DescriptorBinding::forBuffer(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, drawCountBuffer.get(), 0, VK_WHOLE_SIZE),
+        });
+    }
+
+    void readDrawCount(uint32_t slot)
+    {
+        if (!drawCountReadbackPending[slot])
+            return;
+
+        latencyStats.generatedDraws += *drawCountReadbackMapped[slot];
+        latencyStats.generatedDrawFrameCount++;
+        drawCountReadbackPending[slot] = false;
+    }
+
+#if ENABLE_PROFILING
+#ifdef _WIN32
+    static const VkTimeDomainEXT HOST_TIME_DOMAIN = VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT;
+#else
+    static const VkTimeDomainEXT HOST_TIME_DOMAIN = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+#endif
+
+    /// <summary>
+    /// Can the physical device sample its timestamp clock together with the clock the trace recorder runs on?
+    /// </summary>
+    bool supportsCalibratedTimestamps()
+    {
+        uint32_t extensionCount = 0;
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> extensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+
+        bool found = false;
+        for (const auto& extension : extensions)
+        {
+            found = found || strcmp(extension.extensionName, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME) == 0;
+        }
+
+        auto getTimeDomains = (PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT");
+        if (!found || getTimeDomains == nullptr)
+            return false;
+
+        uint32_t domainCount = 0;
+        getTimeDomains(physicalDevice, &domainCount, nullptr);
+        std::vector<VkTimeDomainEXT> domains(domainCount);
+        getTimeDomains(physicalDevice, &domainCount, domains.data());
+
+        return std::find(domains.begin(), domains.end(), VK_TIME_DOMAIN_DEVICE_EXT) != domains.end() &&
+            std::find(domains.begin(), domains.end(), HOST_TIME_DOMAIN) != domains.end();
+    }
+
+    /// <summary>
+    /// Creates the profiler's timestamp queries and works out how GPU timestamps map onto the CPU clock.
+    /// Does nothing unless there's a trace to write, GPU scopes aren't recorded then.
+    /// </summary>
+    void createProfiler()
+    {
+        if (options.tracePath.empty())
+            return;
+
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+        uint32_t validBits = queueFamilies[indices.graphicsFamily.value()].timestampValidBits;
+        if (validBits == 0)
+            return;
+        profilerTimestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        profilerTimestampPeriodUs = properties.limits.timestampPeriod / 1000.0;
+
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = CALIBRATION_QUERY + 1;
+
+        if (vkCreateQueryPool(device, &queryPoolInfo, allocator, &profilerQueryPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create profiler query pool!");
+        }
+
+        for (auto& scopes : gpuScopes)
+            scopes.reserve(GPU_QUERIES_PER_FRAME / 2);
+        openGpuScopes.reserve(GPU_QUERIES_PER_FRAME / 2);
+
+        calibrateGpuClock();
+        std::cout << "GPU clock calibration: " << (getCalibratedTimestamps != nullptr ? "calibrated timestamps" : "timestamp query, drains the queue")
+            << ", repeated every " << (getCalibratedTimestamps != nullptr ? CALIBRATION_INTERVAL_US : QUEUE_CALIBRATION_INTERVAL_US) / 1000000.0 << " s" << std::endl;
+    }
+
+    /// <summary>
+    /// Measures the offset between GPU timestamps and the trace recorder's clock. With VK_EXT_calibrated_timestamps both
+    /// clocks are sampled together. Without it a timestamp is written and waited for, which drains the graphics queue and
+    /// puts GPU scopes slightly early, by however long it takes us to notice the wait finished.
+    /// </summary>
+    void calibrateGpuClock()
+    {
+        if (getCalibratedTimestamps != nullptr)
+        {
+            std::array<VkCalibratedTimestampInfoEXT, 2> timestampInfos{};
+            timestampInfos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+            timestampInfos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+            timestampInfos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+            timestampInfos[1].timeDomain = HOST_TIME_DOMAIN;
+
+            std::array<uint64_t, 2> timestamps{};
+            uint64_t maxDeviation = 0;
+            if (getCalibratedTimestamps(device, 2, timestampInfos.data(), timestamps.data(), &maxDeviation) == VK_SUCCESS)
+            {
+                gpuClockOffsetUs = TraceRecorder::get().hostTicksToUs(timestamps[1]) - (timestamps[0] & profilerTimestampMask) * profilerTimestampPeriodUs;
+                lastCalibrationUs = TraceRecorder::get().nowUs();
+                return;
+            }
+        }
+
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+        vkCmdResetQueryPool(commandBuffer, profilerQueryPool, CALIBRATION_QUERY, 1);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, profilerQueryPool, CALIBRATION_QUERY);
+        endSingleTimeCommands();
+        double cpuUs = TraceRecorder::get().nowUs();
+
+        uint64_t gpuTimestamp = 0;
+        vkGetQueryPoolResults(device, profilerQueryPool, CALIBRATION_QUERY, 1, sizeof(gpuTimestamp), &gpuTimestamp, sizeof(gpuTimestamp), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+        gpuClockOffsetUs = cpuUs - (gpuTimestamp & profilerTimestampMask) * profilerTimestampPeriodUs;
+        lastCalibrationUs = cpuUs;
+    }
+
+    /// <summary>
+    /// Resets the current frame's profiler queries. Has to be recorded before the frame's first GPU scope.
+    /// </summary>
+    void resetGpuScopes(VkCommandBuffer commandBuffer)
+    {
+        gpuScopes[currentFrame].clear();
+        gpuQueriesUsed[currentFrame] = 0;
+        openGpuScopes.clear();
+
+        if (profilerQueryPool != VK_NULL_HANDLE)
+        {
+            vkCmdResetQueryPool(commandBuffer, profilerQueryPool, currentFrame * GPU_QUERIES_PER_FRAME, GPU_QUERIES_PER_FRAME);
+        }
+    }
+
+    void beginGpuScope(VkCommandBuffer commandBuffer, const char* name)
+    {
+        if (profilerQueryPool == VK_NULL_HANDLE)
+            return;
+
+        if (gpuQueriesUsed[currentFrame] + 2 > GPU_QUERIES_PER_FRAME)
+        {
+            // out of queries, the matching end is skipped as well
+            openGpuScopes.push_back(UINT32_MAX);
+            return;
+        }
+
+        uint32_t query = currentFrame * GPU_QUERIES_PER_FRAME + gpuQueriesUsed[currentFrame];
+        gpuQueriesUsed[currentFrame] += 2;
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, profilerQueryPool, query);
+
+        openGpuScopes.push_back(static_cast<uint32_t>(gpuScopes[currentFrame].size()));
+        gpuScopes[currentFrame].push_back({ name, query, query + 1 });
+    }
+
+    void endGpuScope(VkCommandBuffer commandBuffer)
+    {
+        if (profilerQueryPool == VK_NULL_HANDLE)
+            return;
+
+        uint32_t scope = openGpuScopes.back();
+        openGpuScopes.pop_back();
+        if (scope == UINT32_MAX)
+            return;
+
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, profilerQueryPool, gpuScopes[currentFrame][scope].endQuery);
+    }
+
+    /// <summary>
+    /// Adds the GPU scopes of the last frame rendered in the given slot to the trace. The GPU has to be done with
+    /// that slot, so the results are there and reading them never stalls.
+    /// </summary>
+    void collectGpuScopes(uint32_t slot)
+    {
+        if (gpuScopes[slot].empty())
+            return;
+
+        double calibrationInterval = getCalibratedTimestamps != nullptr ? CALIBRATION_INTERVAL_US : QUEUE_CALIBRATION_INTERVAL_US;
+        if (TraceRecorder::get().nowUs() - lastCalibrationUs > calibrationInterval)
+        {
+            calibrateGpuClock();
+        }
+
+        std::array<uint64_t, GPU_QUERIES_PER_FRAME> timestamps;
+        VkResult result = vkGetQueryPoolResults(device, profilerQueryPool, slot * GPU_QUERIES_PER_FRAME, gpuQueriesUsed[slot],
+            sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+        if (result == VK_SUCCESS)
+        {
+            uint32_t firstQuery = slot * GPU_QUERIES_PER_FRAME;
+            for (const GpuProfileScope& scope : gpuScopes[slot])
+            {
+                uint64_t begin = timestamps[scope.beginQuery - firstQuery] & profilerTimestampMask;
+                uint64_t end = timestamps[scope.endQuery - firstQuery] & profilerTimestampMask;
+                TraceRecorder::get().addEvent(scope.name, TraceRecorder::GPU_THREAD_ID,
+                    begin * profilerTimestampPeriodUs + gpuClockOffsetUs, (end - begin) * profilerTimestampPeriodUs);
+            }
+        }
+
+        gpuScopes[slot].clear();
+        gpuQueriesUsed[slot] = 0;
+    }
+#endif
+
+    /// <summary>
+    /// Pushes this frame's draw constants and fills in "recordJob". Happens every frame, whether the command buffer
+    /// gets recorded or comes from the cache, since the uniforms have to be written either way.
+    /// </summary>
+    void prepareRecordJob(uint32_t imageIndex)
+    {
+        recordJob.imageIndex = imageIndex;
+        recordJob.instanceUniformOffset = instanceUniformOffset;
+        recordJob.instanceCount = instanceCounts[currentFrame];
+        recordJob.instancesPerDraw = options.instancesPerDraw == 0 ? (std::max)(recordJob.instanceCount, 1u) : options.instancesPerDraw;
+        recordJob.drawCount = (recordJob.instanceCount + recordJob.instancesPerDraw - 1) / recordJob.instancesPerDraw;
+
+        // the uniform ring isn't thread safe, so everything the draws need from it is pushed before recording them
+        recordJob.drawUniformStride = static_cast<uint32_t>(drawUniformStride());
+        void* data;
+        recordJob.dynamicOffsets[0] = cameraUniformOffset;
+        recordJob.dynamicOffsets[1] = allocateUniforms(recordJob.drawUniformStride * static_cast<VkDeviceSize>((std::max)(recordJob.drawCount, 1u)), data);
+
+        // the first draw keeps the texture's own colors, so a single draw looks like it always has. the others get
+        // a light tint each, hues a golden ratio apart so neighbouring draws are easy to tell apart
+        for (uint32_t drawIndex = 0; drawIndex < (std::max)(recordJob.drawCount, 1u); drawIndex++)
+        {
+            DrawUniforms draw{};
+            draw.tint = glm::vec4(1.0f);
+            if (drawIndex != 0)
+            {
+                float hue = glm::fract(drawIndex * 0.618034f);
+                glm::vec3 color = glm::clamp(glm::abs(glm::fract(hue + glm::vec3(0.0f, 2.0f / 3.0f, 1.0f / 3.0f)) * 6.0f - 3.0f) - 1.0f, 0.0f, 1.0f);
+                draw.tint = glm::vec4(glm::mix(glm::vec3(1.0f), color, 0.5f), 1.0f);
+            }
+            memcpy(static_cast<uint8_t*>(data) + drawIndex * static_cast<VkDeviceSize>(recordJob.drawUniformStride), &draw, sizeof(draw));
+        }
+
+        // allocating sets isn't thread safe either
+        writeCullSet();
+    }
+
+    /// <summary>
+    /// Returns the command buffer to submit this frame. With command caching that's the cached one for this image and
+    /// frame slot if it was recorded with the same instance count and uniform offsets and nothing raised
+    /// "commandCacheDirty" since, otherwise the buffer gets (re-)recorded.
+    /// </summary>
+    VkCommandBuffer getFrameCommandBuffer(uint32_t imageIndex)
+    {
+        VkCommandBuffer commandBuffer = commandBuffers[currentFrame];
+        if (!cachedCommandBuffers.empty())
+        {
+            if (commandCacheDirty)
+            {
+                for (CachedCommandBuffer& cached : cachedCommandBuffers)
+                {
+                    cached.valid = false;
+                }
+                commandCacheDirty = false;
+            }
+
+            CachedCommandBuffer& cached = cachedCommandBuffers[imageIndex * MAX_FRAMES_IN_FLIGHT + currentFrame];
+            if (cached.valid && cached.instanceCount == recordJob.instanceCount &&
+                cached.dynamicOffsets[0] == recordJob.dynamicOffsets[0] && cached.dynamicOffsets[1] == recordJob.dynamicOffsets[1] &&
+                cached.instanceUniformOffset == recordJob.instanceUniformOffset)
+            {
+                latencyStats.commandCacheHits++;
+                return cached.commandBuffer;
+            }
+
+            cached.valid = true;
+            cached.instanceCount = recordJob.instanceCount;
+            cached.dynamicOffsets[0] = recordJob.dynamicOffsets[0];
+            cached.dynamicOffsets[1] = recordJob.dynamicOffsets[1];
+            cached.instanceUniformOffset = recordJob.instanceUniformOffset;
+            commandBuffer = cached.commandBuffer;
+        }
+
+        auto recordStart = std::chrono::steady_clock::now();
+        vkResetCommandBuffer(commandBuffer, 0);
+        recordCommandBuffer(commandBuffer, imageIndex);
+        latencyStats.commandRecordSumNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - recordStart).count();
+        latencyStats.commandRecordCount++;
+        return commandBuffer;
+    }
+
+    /// <summary>
+    /// (Re-)allocates a cached command buffer for every swapchain image and frame in flight, all of them start out
+    /// needing to be recorded. Does nothing unless command caching is on.
+    /// </summary>
+    void createCommandCache()
+    {
+        if (!options.cacheCommands)
+            return;
+
+        // secondaries are re-recorded per frame slot, GPU scopes are only known while recording and the culling set is
+        // freed with the rest of the frame's sets, none of them survive reuse
+        if (activeRecordSlices > 0 || !options.tracePath.empty() || options.occlusionCulling)
+        {
+            std::cout << "Command caching doesn't work with --record-threads, --trace or --occlusion-culling, recording every frame." << std::endl;
+            options.cacheCommands = false;
+            return;
+        }
+
+        destroyCommandCache();
+        cachedCommandBuffers.resize(swapChainImages.size() * MAX_FRAMES_IN_FLIGHT);
+
+        std::vector<VkCommandBuffer> buffers(cachedCommandBuffers.size());
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = static_cast<uint32_t>(buffers.size());
+
+        if (vkAllocateCommandBuffers(device, &allocInfo, buffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate cached command buffers!");
+        }
+
+        for (size_t i = 0; i < buffers.size(); i++)
+        {
+            cachedCommandBuffers[i].commandBuffer = buffers[i];
+        }
+        commandCacheDirty = true;
+    }
+
+    /// <summary>
+    /// Frees the cached command buffers once the frames submitted so far, which may be executing them, are done.
+    /// </summary>
+    void destroyCommandCache()
+    {
+        if (cachedCommandBuffers.empty())
+            return;
+
+        std::vector<VkCommandBuffer> buffers;
+        for (const CachedCommandBuffer& cached : cachedCommandBuffers)
+        {
+            buffers.push_back(cached.commandBuffer);
+        }
+        deferDestruction(graphicsTimeline.lastSignaled, [this, buffers]() {
+            vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(buffers.size()), buffers.data());
+        });
+        cachedCommandBuffers.clear();
+    }
+
+    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+    {
+        PROFILE_SCOPE("recordCommandBuffer");
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = 0; // Optional
+        beginInfo.pInheritanceInfo = nullptr; // Optional
+
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording command buffer!");
+        }
+
+#if ENABLE_PROFILING
+        resetGpuScopes(commandBuffer);
+#endif
+        PROFILE_GPU_BEGIN(commandBuffer, "frame");
+
+        if (timestampQueryPool != VK_NULL_HANDLE)
+        {
+            vkCmdResetQueryPool(commandBuffer, timestampQueryPool, currentFrame * 2, 2);
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool, currentFrame * 2);
+        }
+
+        renderGraph.bindImage(colorTarget, swapChainImages[imageIndex], swapChainImageViews[imageIndex]);
+        if (!readbackBuffers.empty())
+        {
+            renderGraph.bindBuffer(readbackTarget, readbackBuffers[imageIndex]);
+        }
+        // indirect draws are always recorded inline, there's only one per pass
+        bool indirect = options.occlusionCulling || options.gpuDriven;
+        renderGraph.setRenderingFlags(mainPass, activeRecordSlices == 0 || indirect ? 0 : VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT);
+        if (options.occlusionCulling)
+        {
+            renderGraph.bindImage(hiZTarget, hiZImage.get(), hiZView.get());
+            renderGraph.bindBuffer(visibilityTarget, visibilityBuffer.get());
+            renderGraph.bindBuffer(drawCommandTarget, drawCommandBuffer.get());
+            renderGraph.bindBuffer(culledInstanceTarget, culledInstanceBuffer.get());
+            renderGraph.bindBuffer(cullingStatsTarget, cullingStatsBuffers[currentFrame].get());
+        }
+        if (options.gpuDriven)
+        {
+            renderGraph.bindBuffer(generatedInstanceTarget, generatedInstanceBuffer.get());
+            renderGraph.bindBuffer(generatedDrawTarget, generatedDrawBuffer.get());
+            renderGraph.bindBuffer(drawCountTarget, drawCountBuffer.get());
+            renderGraph.bindBuffer(drawCountReadbackTarget, drawCountReadbackBuffers[currentFrame].get());
+        }
+
+        if (pipelineStatisticsPool != VK_NULL_HANDLE)
+        {
+            vkCmdResetQueryPool(commandBuffer, pipelineStatisticsPool, currentFrame, 1);
+            vkCmdBeginQuery(commandBuffer, pipelineStatisticsPool, currentFrame, 0);
+        }
+
+        for (uint32_t pass = 0; pass < renderGraph.passCount(); pass++)
+        {
+            PROFILE_GPU_BEGIN(commandBuffer, renderGraph.passName(pass));
+            renderGraph.executePass(commandBuffer, pass);
+            PROFILE_GPU_END(commandBuffer);
+        }
+        renderGraph.executeFinalBarriers(commandBuffer);
+
+        if (pipelineStatisticsPool != VK_NULL_HANDLE)
+        {
+            vkCmdEndQuery(commandBuffer, pipelineStatisticsPool, currentFrame);
+        }
+
+        if (timestampQueryPool != VK_NULL_HANDLE)
+        {
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool, currentFrame * 2 + 1);
+        }
+
+        PROFILE_GPU_END(commandBuffer);
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record command buffer!");
+        }
+    }
+
+    /// <summary>
+    /// Records the main pass, inline or by executing a secondary buffer per record slice.
+    /// </summary>
+    void recordMainPass(VkCommandBuffer commandBuffer)
+    {
+        if (options.gpuDriven)
+        {
+            recordGeneratedDraws(commandBuffer, false);
+            return;
+        }
+
+        if (activeRecordSlices == 0)
+        {
+            recordDraws(commandBuffer, 0, recordJob.drawCount);
+            return;
+        }
+
+        jobs.parallelFor(activeRecordSlices, 1, [this](uint32_t begin, uint32_t end) {
+            for (uint32_t slice = begin; slice < end; slice++)
+            {
+                recordSliceDraws(slice);
+            }
+        });
+
+        std::array<VkCommandBuffer, MAX_RECORD_SLICES> secondaries;
+        for (uint32_t slice = 0; slice < activeRecordSlices; slice++)
+        {
+            secondaries[slice] = recordSlices[slice].commandBuffers[currentFrame];
+        }
+        vkCmdExecuteCommands(commandBuffer, activeRecordSlices, secondaries.data());
+    }
+
+    /// <summary>
+    /// Records draws [firstDraw, endDraw) of "recordJob" along with all the state they need, so it works the same
+    /// in a primary buffer and in a secondary one that inherits nothing but the attachment formats.
+    /// "depthOnly" draws them with the depth pre-pass pipeline and the position stream instead.
+    /// </summary>
+    void recordDraws(VkCommandBuffer commandBuffer, uint32_t firstDraw, uint32_t endDraw, bool depthOnly = false)
+    {
+        bindDrawState(commandBuffer, depthOnly ? depthPrepassPipeline.get() : graphicsPipeline.get(), depthOnly ? positionBuffer.get() : vertexBuffer.get(),
+            instanceBuffers[currentFrame].get(), 0);
+
+        // with the default of one draw this is every copy of the model at once
+        for (uint32_t drawIndex = firstDraw; drawIndex < endDraw; drawIndex++)
+        {
+            // "bindDrawState" bound the first draw's constants, the others move the dynamic offset on to their own
+            if (drawIndex != 0)
+            {
+                uint32_t dynamicOffsets[] = { recordJob.dynamicOffsets[0], recordJob.dynamicOffsets[1] + drawIndex * recordJob.drawUniformStride };
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &frameDescriptorSet, 2, dynamicOffsets);
+            }
+
+            uint32_t firstInstance = drawIndex * recordJob.instancesPerDraw;
+            uint32_t instanceCount = (std::min)(recordJob.instancesPerDraw, recordJob.instanceCount - firstInstance);
+            vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), instanceCount, 0, 0, firstInstance);
+        }
+    }
+
+    /// <summary>
+    /// Binds everything a draw of the model needs, with per-instance data read from "instanceBuffer" at "instanceOffset".
+    /// </summary>
+    void bindDrawState(VkCommandBuffer commandBuffer, VkPipeline pipeline, VkBuffer vertices, VkBuffer instanceBuffer, VkDeviceSize instanceOffset)
+    {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+        VkBuffer vertexBuffers[] = { vertices, instanceBuffer };
+        VkDeviceSize offsets[] = { 0, instanceOffset };
+        vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+        vkCmdBindIndexBuffer(commandBuffer, indexBuffer.get(), 0, VK_INDEX_TYPE_UINT32);
+
+        VkViewport viewport{};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = static_cast<float>(swapChainExtent.width);
+        viewport.height = static_cast<float>(swapChainExtent.height);
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor{};
+        scissor.offset = { 0, 0 };
+        scissor.extent = swapChainExtent;
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+        // set 0 is the camera and this draw's constants, both picked out of the uniform ring by dynamic offsets,
+        // set 1 the texture table, which instances index into so no per-material binds are needed
+        VkDescriptorSet sets[] = { frameDescriptorSet, bindlessSet };
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 2, sets, 2, recordJob.dynamicOffsets);
+    }
+
+    /// <summary>
+    /// Draws the instances culling phase "phase" (0 early, 1 late) picked, with the draw command the culling shader filled in.
+    /// </summary>
+    void recordCulledDraws(VkCommandBuffer commandBuffer, uint32_t phase)
+    {
+        VkDeviceSize instanceOffset = phase * sizeof(InstanceData) * static_cast<VkDeviceSize>(culledInstanceCapacity);
+        bindDrawState(commandBuffer, graphicsPipeline.get(), vertexBuffer.get(), culledInstanceBuffer.get(), instanceOffset);
+        vkCmdDrawIndexedIndirect(commandBuffer, drawCommandBuffer.get(), phase * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+    }
+
+    /// <summary>
+    /// Draws every instance the draw generation shader kept, as many draws as it counted. The CPU doesn't know how
+    /// many that is, it only gives the upper bound.
+    /// </summary>
+    void recordGeneratedDraws(VkCommandBuffer commandBuffer, bool depthOnly)
+    {
+        bindDrawState(commandBuffer, depthOnly ? depthPrepassPipeline.get() : graphicsPipeline.get(), depthOnly ? positionBuffer.get() : vertexBuffer.get(),
+            generatedInstanceBuffer.get(), 0);
+        vkCmdDrawIndexedIndirectCount(commandBuffer, generatedDrawBuffer.get(), 0, drawCountBuffer.get(), 0, static_cast<uint32_t>(instanceOffsets.size()),
+            sizeof(VkDrawIndexedIndirectCommand));
+    }
+
+    /// <summary>
+    /// Culls every instance and writes the draws of the visible ones, see drawgen.comp.
+    /// </summary>
+    void dispatchDrawGeneration(VkCommandBuffer commandBuffer)
+    {
+        DrawGenerationConstants constants{};
+        constants.bounds = modelBounds;
+        constants.instanceCount = static_cast<uint32_t>(instanceOffsets.size());
+        constants.indexCount = static_cast<uint32_t>(indices.size());
+        constants.textureIndex = modelTextureIndex;
+
+        uint32_t dynamicOffsets[] = { recordJob.dynamicOffsets[0], recordJob.instanceUniformOffset };
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, drawGenerationPipeline.get());
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, drawGenerationPipelineLayout, 0, 1, &drawGenerationSet, 2, dynamicOffsets);
+        vkCmdPushConstants(commandBuffer, drawGenerationPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatch(commandBuffer, (constants.instanceCount + 63) / 64, 1, 1);
+    }
+
+    void copyDrawCount(VkCommandBuffer commandBuffer)
+    {
+        VkBufferCopy copyRegion{};
+        copyRegion.size = sizeof(uint32_t);
+        vkCmdCopyBuffer(commandBuffer, drawCountBuffer.get(), drawCountReadbackBuffers[currentFrame].get(), 1, &copyRegion);
+    }
+
+    /// <summary>
+    /// Sets both phases' draw commands to draw the model zero times, the culling shader counts the instances up.
+    /// </summary>
+    void resetDrawCommands(VkCommandBuffer commandBuffer)
+    {
+        std::array<VkDrawIndexedIndirectCommand, 2> draws{};
+        for (VkDrawIndexedIndirectCommand& draw : draws)
+        {
+            draw.indexCount = static_cast<uint32_t>(indices.size());
+        }
+        vkCmdUpdateBuffer(commandBuffer, drawCommandBuffer.get(), 0, sizeof(draws), draws.data());
+    }
+
+    /// <summary>
+    /// Tests every instance of the frame, see cull.comp.
+    /// </summary>
+    void dispatchCull(VkCommandBuffer commandBuffer, bool late)
+    {
+        CullConstants constants{};
+        constants.bounds = modelBounds;
+        constants.hiZSize = glm::vec2(hiZExtent.width, hiZExtent.height);
+        // instances past the culled buffer's halves aren't drawn at all
+        constants.instanceCount = (std::min)(recordJob.instanceCount, culledInstanceCapacity);
+        constants.late = late ? 1 : 0;
+        constants.capacity = culledInstanceCapacity;
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline.get());
+        // the camera is the first dynamic offset of the frame set
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &cullSet, 1, recordJob.dynamicOffsets);
+        vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatch(commandBuffer, (constants.instanceCount + 63) / 64, 1, 1);
+    }
+
+    /// <summary>
+    /// Builds the depth pyramid level by level from the depth buffer. The graph only syncs the pass as a whole,
+    /// so each level waits for the one before here.
+    /// </summary>
+    void buildHiZ(VkCommandBuffer commandBuffer)
+    {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, hiZPipeline.get());
+
+        VkImageMemoryBarrier2 barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+        barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+        barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+        barrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = hiZImage.get();
+        barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+        VkDependencyInfo dependencyInfo{};
+        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependencyInfo.imageMemoryBarrierCount = 1;
+        dependencyInfo.pImageMemoryBarriers = &barrier;
+
+        HiZConstants constants{};
+        constants.sourceSize = glm::ivec2(swapChainExtent.width, swapChainExtent.height);
+        for (uint32_t level = 0; level < hiZLevelViews.size(); level++)
+        {
+            constants.destinationSize = glm::ivec2((std::max)(hiZExtent.width >> level, 1u), (std::max)(hiZExtent.height >> level, 1u));
+
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, hiZPipelineLayout, 0, 1, &hiZSets[level], 0, nullptr);
+            vkCmdPushConstants(commandBuffer, hiZPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+            vkCmdDispatch(commandBuffer, (constants.destinationSize.x + 7) / 8, (constants.destinationSize.y + 7) / 8, 1);
+
+            // the graph's barrier after the pass covers the last level
+            if (level + 1 < hiZLevelViews.size())
+            {
+                barrier.subresourceRange.baseMipLevel = level;
+                vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+            }
+            constants.sourceSize = constants.destinationSize;
+        }
+    }
+
+    /// <summary>
+    /// Copies the draw commands out to the frame's stats buffer, they hold how many instances each phase drew.
+    /// </summary>
+    void copyCullingStats(VkCommandBuffer commandBuffer)
+    {
+        VkBufferCopy copyRegion{};
+        copyRegion.size = sizeof(VkDrawIndexedIndirectCommand) * 2;
+        vkCmdCopyBuffer(commandBuffer, drawCommandBuffer.get(), cullingStatsBuffers[currentFrame].get(), 1, &copyRegion);
+    }
+
+    /// <summary>
+    /// Records slice "slice" of the draws into its secondary buffer for the current frame.
+    /// </summary>
+    void recordSliceDraws(uint32_t slice)
+    {
+        PROFILE_SCOPE("recordSliceDraws");
+
+        RecordSlice& recordSlice = recordSlices[slice];
+        vkResetCommandPool(device, recordSlice.commandPools[currentFrame], 0);
+
+        VkCommandBufferInheritanceRenderingInfo renderingInfo{};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+        renderingInfo.colorAttachmentCount = 1;
+        renderingInfo.pColorAttachmentFormats = &swapChainImageFormat;
+        renderingInfo.depthAttachmentFormat = depthFormat;
+        renderingInfo.rasterizationSamples = msaaSamples;
+
+        VkCommandBufferInheritanceInfo inheritanceInfo{};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.pNext = &renderingInfo;
+        // executed while the primary's statistics query is active
+        if (pipelineStatisticsPool != VK_NULL_HANDLE)
+        {
+            inheritanceInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+        }
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+        VkCommandBuffer commandBuffer = recordSlice.commandBuffers[currentFrame];
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording secondary command buffer!");
+        }
+
+        // contiguous slices, so the instance buffer is walked front to back
+        uint64_t drawCount = recordJob.drawCount;
+        uint32_t firstDraw = static_cast<uint32_t>(drawCount * slice / activeRecordSlices);
+        uint32_t endDraw = static_cast<uint32_t>(drawCount * (slice + 1) / activeRecordSlices);
+        recordDraws(commandBuffer, firstDraw, endDraw);
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record secondary command buffer!");
+        }
+    }
+
+    /// <summary>
+    /// Creates the command pools and secondary buffers the draws are split into. The record benchmark gets a slice
+    /// per job thread, so it can try every count up to that.
+    /// </summary>
+    void createRecordSlices()
+    {
+        uint32_t sliceCount = options.recordThreads;
+        if (options.recordBenchmark)
+        {
+            sliceCount = (std::max)(sliceCount, jobs.threadCount());
+        }
+        sliceCount = (std::min)(sliceCount, MAX_RECORD_SLICES);
+        activeRecordSlices = (std::min)(options.recordThreads, sliceCount);
+
+        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+        recordSlices.resize(sliceCount);
+        for (RecordSlice& slice : recordSlices)
+        {
+            for (uint32_t slot = 0; slot < MAX_FRAMES_IN_FLIGHT; slot++)
+            {
+                // buffers are only ever reset together with their pool
+                VkCommandPoolCreateInfo poolInfo{};
+                poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+                poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+                poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+                if (vkCreateCommandPool(device, &poolInfo, allocator, &slice.commandPools[slot]) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create record slice command pool!");
+                }
+
+                VkCommandBufferAllocateInfo allocInfo{};
+                allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                allocInfo.commandPool = slice.commandPools[slot];
+                allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+                allocInfo.commandBufferCount = 1;
+
+                if (vkAllocateCommandBuffers(device, &allocInfo, &slice.commandBuffers[slot]) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to allocate record slice command buffer!");
+                }
+            }
+        }
+    }
+
+    void createSyncObjects()
+    {
+        // frames in flight are tracked with "graphicsTimeline", only the swapchain still needs binary semaphores
+        imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+        renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            if (vkCreateSemaphore(device, &semaphoreInfo, allocator, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
+                vkCreateSemaphore(device, &semaphoreInfo, allocator, &renderFinishedSemaphores[i]) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create synchronization objects for a frame!");
+            }
+        }
+    }
+
+    /// <summary>
+    /// Creates the timeline semaphores for the graphics and transfer queues. Each queue gets its own because
+    /// values on one timeline have to be signaled in increasing order, which two queues can't promise.
+    /// </summary>
+    void createTimelines()
+    {
+        VkSemaphoreTypeCreateInfo typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+
+        if (vkCreateSemaphore(device, &semaphoreInfo, allocator, &graphicsTimeline.semaphore) != VK_SUCCESS ||
+            vkCreateSemaphore(device, &semaphoreInfo, allocator, &transferTimeline.semaphore) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create timeline semaphores!");
+        }
+
+        deletionQueue.init(device, allocator, &graphicsTimeline);
+    }
+
+    /// <summary>
+    /// Has the GPU reached "value" on the given timeline yet? Doesn't block.
+    /// </summary>
+    bool gpuPointReached(GpuTimeline& timeline, uint64_t value)
+    {
+        if (value <= timeline.lastCompleted)
+            return true;
+
+        vkGetSemaphoreCounterValue(device, timeline.semaphore, &timeline.lastCompleted);
+        return value <= timeline.lastCompleted;
+    }
+
+    /// <summary>
+    /// Blocks until the GPU has reached "value" on the given timeline.
+    /// </summary>
+    /// <returns>false if the point had already been reached and we didn't have to wait</returns>
+    bool waitForGpuPoint(GpuTimeline& timeline, uint64_t value)
+    {
+        if (gpuPointReached(timeline, value))
+            return false;
+
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &timeline.semaphore;
+        waitInfo.pValues = &value;
+
+        if (vkWaitSemaphores(device, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+            throw std::runtime_error("failed to wait on timeline semaphore!");
+        }
+
+        timeline.lastCompleted = (std::max)(timeline.lastCompleted, value);
+        return true;
+    }
+
+    /// <summary>
+    /// Queues "destroy" to run once the graphics timeline has reached "timelineValue".
+    /// </summary>
+    void deferDestruction(uint64_t timelineValue, std::function<void()> destroy)
+    {
+        deletionQueue.push(timelineValue, std::move(destroy));
+    }
+
+    /// <summary>
+    /// Runs every queued destruction the GPU is done with.
+    /// </summary>
+    void collectDeferredDeletions()
+    {
+        gpuPointReached(graphicsTimeline, graphicsTimeline.lastSignaled);
+        deletionQueue.collect(graphicsTimeline.lastCompleted);
+    }
+
+    /// <summary>
+    /// Wraps "handle" so it's retired to the deletion queue instead of destroyed on the spot.
+    /// </summary>
+    template<auto Destroy, typename T>
+    VulkanHandle<T, Destroy> own(T handle)
+    {
+        return VulkanHandle<T, Destroy>(deletionQueue, handle);
+    }
+
+    /// <summary>
+    /// "createBuffer" for a buffer and memory owned by VulkanHandles.
+    /// </summary>
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VulkanHandle<VkBuffer, vkDestroyBuffer>& buffer, VulkanHandle<VkDeviceMemory, vkFreeMemory>& bufferMemory)
+    {
+        VkBuffer rawBuffer;
+        VkDeviceMemory rawMemory;
+        createBuffer(size, usage, properties, rawBuffer, rawMemory);
+        buffer = own<vkDestroyBuffer>(rawBuffer);
+        bufferMemory = own<vkFreeMemory>(rawMemory);
+    }
+
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+    {
+        VkPhysicalDeviceMemoryProperties memProperties;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+        for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+            if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                return i;
+            }
+        }
+
+        throw std::runtime_error("failed to find suitable memory type!");
+    }
+
+    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+    {
+        PROFILE_SCOPE("copyBuffer");
+
+        VkCommandBuffer commandBuffer = beginTransferCommands();
+
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = 0; // Optional
+        copyRegion.dstOffset = 0; // Optional
+        copyRegion.size = size;
+        vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+
+        endSingleTimeCommands();
+    }
+
+    void createIndexBuffer()
+    {
+        VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+
+        VkBuffer stagingBuffer;
+        VkDeviceMemory stagingBufferMemory;
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+        void* data;
+        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
+        memcpy(data, indices.data(), (size_t)bufferSize);
+        vkUnmapMemory(device, stagingBufferMemory);
+
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+
+        copyBuffer(stagingBuffer, indexBuffer.get(), bufferSize);
+        transferBufferOwnership(indexBuffer.get(), VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+
+        releaseStagingBuffer(stagingBuffer, stagingBufferMemory);
+    }
+
+    void createVertexBuffer() {
+        VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+
+        VkBuffer stagingBuffer;
+        VkDeviceMemory stagingBufferMemory;
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+        void* data;
+        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
+        memcpy(data, vertices.data(), (size_t)bufferSize);
+        vkUnmapMemory(device, stagingBufferMemory);
+
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+
+        copyBuffer(stagingBuffer, vertexBuffer.get(), bufferSize);
+        transferBufferOwnership(vertexBuffer.get(), VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+
+        releaseStagingBuffer(stagingBuffer, stagingBufferMemory);
+    }
+
+    /// <summary>
+    /// Copies just the vertex positions into a buffer of their own for the depth pre-pass, which doesn't need the rest.
+    /// </summary>
+    void createPositionBuffer()
+    {
+        if (!options.depthPrepass)
+            return;
+
+        std::vector<glm::vec3> positions(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            positions[i] = vertices[i].pos;
+        }
+        VkDeviceSize bufferSize = sizeof(positions[0]) * positions.size();
+
+        VkBuffer stagingBuffer;
+        VkDeviceMemory stagingBufferMemory;
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+        void* data;
+        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
+        memcpy(data, positions.data(), (size_t)bufferSize);
+        vkUnmapMemory(device, stagingBufferMemory);
+
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, positionBuffer, positionBufferMemory);
+
+        copyBuffer(stagingBuffer, positionBuffer.get(), bufferSize);
+        transferBufferOwnership(positionBuffer.get(), VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+
+        releaseStagingBuffer(stagingBuffer, stagingBufferMemory);
+    }
+
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
+    {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device, &bufferInfo, allocator, &buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+
+        if (vkAllocateMemory(device, &allocInfo, allocator, &bufferMemory) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate buffer memory!");
+        }
+
+        vkBindBufferMemory(device, buffer, bufferMemory, 0);
+    }
+
+    /// <summary>
+    /// Set 0 holds what changes every frame or draw (the camera and draw UBOs, dynamic offsets into the uniform ring),
+    /// set 1 is the bindless texture table. Per-object transforms and texture indices aren't in a set at all, they come from the instance buffer.
+    /// </summary>
+    void createDescriptorSetLayout()
+    {
+        VkDescriptorSetLayoutBinding cameraLayoutBinding{};
+        cameraLayoutBinding.binding = 0;
+        cameraLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        cameraLayoutBinding.descriptorCount = 1;
+        cameraLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        cameraLayoutBinding.pImmutableSamplers = nullptr;
+
+        VkDescriptorSetLayoutBinding drawLayoutBinding{};
+        drawLayoutBinding.binding = 1;
+        drawLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        drawLayoutBinding.descriptorCount = 1;
+        drawLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        drawLayoutBinding.pImmutableSamplers = nullptr;
+
+        std::array<VkDescriptorSetLayoutBinding, 2> frameBindings = { cameraLayoutBinding, drawLayoutBinding };
+        frameSetLayout = createDescriptorLayout(frameBindings.data(), static_cast<uint32_t>(frameBindings.size()));
+
+        VkDescriptorSetLayoutBinding texturesLayoutBinding{};
+        texturesLayoutBinding.binding = 0;
+        texturesLayoutBinding.descriptorCount = MAX_BINDLESS_TEXTURES;
+        texturesLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        texturesLayoutBinding.pImmutableSamplers = nullptr;
+        texturesLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        // slots past the registered textures are never written, and new textures can be registered while
+        // earlier frames that bound the set are still in flight
+        VkDescriptorBindingFlags texturesBindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+            VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT;
+        VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+        bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        bindingFlagsInfo.bindingCount = 1;
+        bindingFlagsInfo.pBindingFlags = &texturesBindingFlags;
+
+        VkDescriptorSetLayoutCreateInfo texturesLayoutInfo{};
+        texturesLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        texturesLayoutInfo.pNext = &bindingFlagsInfo;
+        texturesLayoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+        texturesLayoutInfo.bindingCount = 1;
+        texturesLayoutInfo.pBindings = &texturesLayoutBinding;
+
+        if (vkCreateDescriptorSetLayout(device, &texturesLayoutInfo, allocator, &bindlessSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create bindless texture descriptor set layout!");
+        }
+    }
+
+    /// <summary>
+    /// Allocates the bindless texture table. It has its own update-after-bind pool since sets from those can't
+    /// come from the ordinary pools.
+    /// </summary>
+    void createBindlessTextures()
+    {
+        VkDescriptorPoolSize poolSize{};
+        poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        poolSize.descriptorCount = MAX_BINDLESS_TEXTURES;
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = 1;
+
+        if (vkCreateDescriptorPool(device, &poolInfo, allocator, &bindlessPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create bindless texture descriptor pool!");
+        }
+
+        VkDescriptorSetVariableDescriptorCountAllocateInfo variableCountInfo{};
+        variableCountInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
+        variableCountInfo.descriptorSetCount = 1;
+        variableCountInfo.pDescriptorCounts = &MAX_BINDLESS_TEXTURES;
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.pNext = &variableCountInfo;
+        allocInfo.descriptorPool = bindlessPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &bindlessSetLayout;
+
+        if (vkAllocateDescriptorSets(device, &allocInfo, &bindlessSet) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate bindless texture descriptor set!");
+        }
+    }
+
+    /// <summary>
+    /// Puts a texture into the next free slot of the bindless table and returns the slot, which is what instances
+    /// use to pick their texture. The image has to be in SHADER_READ_ONLY_OPTIMAL by the time it's sampled.
+    /// </summary>
+    uint32_t registerTexture(VkImageView imageView, VkSampler sampler)
+    {
+        if (bindlessTextureCount == MAX_BINDLESS_TEXTURES) {
+            throw std::runtime_error("bindless texture table is full!");
+        }
+
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageView = imageView;
+        imageInfo.sampler = sampler;
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = bindlessSet;
+        descriptorWrite.dstBinding = 0;
+        descriptorWrite.dstArrayElement = bindlessTextureCount;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pImageInfo = &imageInfo;
+        vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+
+        return bindlessTextureCount++;
+    }
+
+    /// <summary>
+    /// Creates a descriptor set layout and, from the same bindings, the update template that writes all of them at once.
+    /// </summary>
+    DescriptorLayout createDescriptorLayout(const VkDescriptorSetLayoutBinding* bindings, uint32_t bindingCount)
+    {
+        DescriptorLayout result;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = bindingCount;
+        layoutInfo.pBindings = bindings;
+
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, allocator, &result.layout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor set layout!");
+        }
+
+        std::vector<VkDescriptorUpdateTemplateEntry> entries(bindingCount);
+        for (uint32_t i = 0; i < bindingCount; i++)
+        {
+            if (bindings[i].descriptorCount != 1) {
+                throw std::runtime_error("descriptor update templates only support single descriptor bindings!");
+            }
+
+            entries[i].dstBinding = bindings[i].binding;
+            entries[i].dstArrayElement = 0;
+            entries[i].descriptorCount = 1;
+            entries[i].descriptorType = bindings[i].descriptorType;
+            entries[i].offset = i * sizeof(DescriptorInfo);
+            entries[i].stride = sizeof(DescriptorInfo);
+            result.bindings.push_back(bindings[i].binding);
+        }
+
+        VkDescriptorUpdateTemplateCreateInfo templateInfo{};
+        templateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+        templateInfo.descriptorUpdateEntryCount = bindingCount;
+        templateInfo.pDescriptorUpdateEntries = entries.data();
+        templateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+        templateInfo.descriptorSetLayout = result.layout;
+
+        if (vkCreateDescriptorUpdateTemplate(device, &templateInfo, allocator, &result.updateTemplate) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor update template!");
+        }
+
+        return result;
+    }
+
+    void destroyDescriptorLayout(DescriptorLayout& layout)
+    {
+        vkDestroyDescriptorUpdateTemplate(device, layout.updateTemplate, allocator);
+        vkDestroyDescriptorSetLayout(device, layout.layout, allocator);
+    }
+
+    /// <summary>
+    /// Creates the uniform ring, one slice of "frameSize" bytes per frame in flight, plus room for every draw's "DrawUniforms".
+    /// </summary>
+    void createUniformRing()
+    {
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        uniformRing.alignment = (std::max)(properties.limits.minUniformBufferOffsetAlignment, static_cast<VkDeviceSize>(16));
+
+        uint32_t instancesPerDraw = options.instancesPerDraw == 0 ? (std::max)(options.instanceCount, 1u) : options.instancesPerDraw;
+        uint32_t maxDrawCount = (std::max)((options.instanceCount + instancesPerDraw - 1) / instancesPerDraw, 1u);
+        uniformRing.frameSize += maxDrawCount * drawUniformStride();
+
+        VkDeviceSize bufferSize = uniformRing.frameSize * MAX_FRAMES_IN_FLIGHT;
+        createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformRing.buffer, uniformRing.memory);
+
+        void* data;
+        vkMapMemory(device, uniformRing.memory, 0, bufferSize, 0, &data);
+        uniformRing.mapped = static_cast<uint8_t*>(data);
+    }
+
+    /// <summary>
+    /// Starts allocating from the current frame's slice of the uniform ring. The GPU has to be done with the frame.
+    /// </summary>
+    void resetUniformRing()
+    {
+        uniformRing.head = uniformRing.frameSize * currentFrame;
+        uniformRing.frameEnd = uniformRing.head + uniformRing.frameSize;
+    }
+
+    /// <summary>
+    /// How far apart consecutive draws' "DrawUniforms" are, each has to start at a valid dynamic offset.
+    /// </summary>
+    VkDeviceSize drawUniformStride() const
+    {
+        return (sizeof(DrawUniforms) + uniformRing.alignment - 1) & ~(uniformRing.alignment - 1);
+    }
+
+    /// <summary>
+    /// Sub-allocates "size" bytes for this frame. Returns the offset to bind them at and where to write them.
+    /// </summary>
+    uint32_t allocateUniforms(VkDeviceSize size, void*& data)
+    {
+        VkDeviceSize offset = (uniformRing.head + uniformRing.alignment - 1) & ~(uniformRing.alignment - 1);
+        if (offset + size > uniformRing.frameEnd)
+        {
+            throw std::runtime_error("uniform ring is out of space for this frame!");
+        }
+
+        uniformRing.head = offset + size;
+        data = uniformRing.mapped + offset;
+        return static_cast<uint32_t>(offset);
+    }
+
+    /// <summary>
+    /// Copies "value" into this frame's slice of the uniform ring and returns its dynamic offset.
+    /// </summary>
+    template<typename T>
+    uint32_t pushUniforms(const T& value)
+    {
+        void* data;
+        uint32_t offset = allocateUniforms(sizeof(T), data);
+        memcpy(data, &value, sizeof(T));
+        return offset;
+    }
+
+    /// <summary>
+    /// Lays out the copies of the model and creates the instance buffers. The default two copies keep the placement
+    /// they've always had, bigger counts are put on a square grid centered on the origin.
+    /// </summary>
+    void createInstances()
+    {
+        uint32_t count = options.instanceCount;
+        instanceOffsets.resize(count);
+
+        if (count == 2)
+        {
+            instanceOffsets[0] = glm::vec3(0.0f, 0.0f, 0.0f);
+            instanceOffsets[1] = glm::vec3(1.0f, 1.0f, 0.0f);
+        }
+        else
+        {
+            const float spacing = 2.5f;
+            uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+            float center = (side - 1) * spacing * 0.5f;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                instanceOffsets[i] = glm::vec3((i % side) * spacing - center, (i / side) * spacing - center, 0.0f);
+            }
+            farPlane = (std::max)(farPlane, side * spacing * 1.5f + 10.0f);
+        }
+
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            ensureInstanceCapacity(i, count);
+        }
+
+        if (options.frustumCulling)
+        {
+            instanceBounds.resize(count);
+            visibleInstances.resize(count);
+            frustumCuller.reserve(count);
+            cullPath = FrustumCuller::bestPath();
+            std::cout << "Frustum culling with " << FrustumCuller::pathName(cullPath) << std::endl;
+        }
+    }
+
+    /// <summary>
+    /// Grows the instance buffer of the given frame in flight to fit at least "count" instances.
+    /// The GPU has to be done with that frame.
+    /// </summary>
+    void ensureInstanceCapacity(uint32_t slot, uint32_t count)
+    {
+        if (count <= instanceBufferCapacities[slot] && instanceBuffers[slot].get() != VK_NULL_HANDLE)
+            return;
+
+        // the old buffer, if any, is retired by the assignment in createBuffer
+
+        uint32_t capacity = (std::max)({ count, instanceBufferCapacities[slot] * 2, 1u });
+        VkDeviceSize bufferSize = sizeof(InstanceData) * static_cast<VkDeviceSize>(capacity);
+        // the culling shader reads it as a storage buffer
+        createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            instanceBuffers[slot], instanceBuffersMemory[slot]);
+
+        void* data;
+        vkMapMemory(device, instanceBuffersMemory[slot].get(), 0, bufferSize, 0, &data);
+        instanceBuffersMapped[slot] = static_cast<InstanceData*>(data);
+        instanceBufferCapacities[slot] = capacity;
+
+        // recorded buffers still bind the old instance buffer
+        commandCacheDirty = true;
+    }
+
+    /// <summary>
+    /// Makes room for "count" instances in the current frame's instance buffer and returns where to write them.
+    /// This frame draws the mesh exactly that many times. Writing straight into the mapped buffer saves copying
+    /// the transforms, use "submitInstances" when they're already in an array.
+    /// </summary>
+    InstanceData* writeInstances(uint32_t count)
+    {
+        ensureInstanceCapacity(currentFrame, count);
+        instanceCounts[currentFrame] = count;
+        return instanceBuffersMapped[currentFrame];
+    }
+
+    /// <summary>
+    /// Draws the mesh once per transform this frame.
+    /// </summary>
+    void submitInstances(const InstanceData* instances, uint32_t count)
+    {
+        memcpy(writeInstances(count), instances, sizeof(InstanceData) * count);
+    }
+
+    /// <summary>
+    /// Creates a pool for "maxSets" sets. Every set is assumed to use at most a couple of descriptors of each type,
+    /// apart from the culling set's four storage buffers.
+    /// </summary>
+    VkDescriptorPool createDescriptorPool(uint32_t maxSets)
+    {
+        // this array describes DESCRIPTORS, not descriptor sets.
+        // it is an array that describes how many of each type of descriptor we'll be allocating
+        std::array<VkDescriptorPoolSize, 5> poolSizes{};
+        poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        poolSizes[0].descriptorCount = maxSets;
+        poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        poolSizes[1].descriptorCount = maxSets * 2;
+        poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        poolSizes[2].descriptorCount = maxSets * 2;
+        poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSizes[3].descriptorCount = maxSets * 4;
+        poolSizes[4].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        poolSizes[4].descriptorCount = maxSets;
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = maxSets;
+
+        VkDescriptorPool pool;
+        if (vkCreateDescriptorPool(device, &poolInfo, allocator, &pool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor pool!");
+        }
+        return pool;
+    }
+
+    /// <summary>
+    /// Makes the next pool of "descriptors" current, reusing a reset one if there is one.
+    /// </summary>
+    void nextDescriptorPool(DescriptorAllocator& descriptors)
+    {
+        if (!descriptors.freePools.empty())
+        {
+            descriptors.currentPool = descriptors.freePools.back();
+            descriptors.freePools.pop_back();
+        }
+        else
+        {
+            descriptors.currentPool = createDescriptorPool(descriptors.setsPerPool);
+            descriptors.setsPerPool = (std::min)(descriptors.setsPerPool * 2, 4096u);
+
+            size_t poolCount = descriptors.usedPools.size() + 1;
+            descriptors.usedPools.reserve(poolCount);
+            descriptors.freePools.reserve(poolCount);
+        }
+        descriptors.usedPools.push_back(descriptors.currentPool);
+    }
+
+    /// <summary>
+    /// Allocates a set from "descriptors", moving on to a new pool when the current one is full.
+    /// </summary>
+    VkDescriptorSet allocateDescriptorSet(DescriptorAllocator& descriptors, VkDescriptorSetLayout layout)
+    {
+        if (descriptors.currentPool == VK_NULL_HANDLE)
+        {
+            nextDescriptorPool(descriptors);
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptors.currentPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &layout;
+
+        VkDescriptorSet set;
+        VkResult result = vkAllocateDescriptorSets(device, &allocInfo, &set);
+        if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+        {
+            nextDescriptorPool(descriptors);
+            allocInfo.descriptorPool = descriptors.currentPool;
+            result = vkAllocateDescriptorSets(device, &allocInfo, &set);
+        }
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate descriptor set!");
+        }
+        return set;
+    }
+
+    /// <summary>
+    /// Frees every set allocated from "descriptors" in one go. The GPU can't be using any of them anymore.
+    /// </summary>
+    void resetDescriptorAllocator(DescriptorAllocator& descriptors)
+    {
+        for (VkDescriptorPool pool : descriptors.usedPools)
+        {
+            vkResetDescriptorPool(device, pool, 0);
+        }
+
+        // usually every pool was used and the lists just trade places. either way nothing is allocated,
+        // both lists have room for every pool
+        if (descriptors.freePools.empty())
+        {
+            std::swap(descriptors.usedPools, descriptors.freePools);
+        }
+        else
+        {
+            descriptors.freePools.insert(descriptors.freePools.end(), descriptors.usedPools.begin(), descriptors.usedPools.end());
+        }
+        descriptors.usedPools.clear();
+        descriptors.currentPool = VK_NULL_HANDLE;
+    }
+
+    void destroyDescriptorAllocator(DescriptorAllocator& descriptors)
+    {
+        resetDescriptorAllocator(descriptors);
+        for (VkDescriptorPool pool : descriptors.freePools)
+        {
+            vkDestroyDescriptorPool(device, pool, allocator);
+        }
+        descriptors.freePools.clear();
+    }
+
+    /// <summary>
+    /// Hands every pool of "descriptors" to the deletion queue, so they go once the frame being built right now is done
+    /// on the GPU, and leaves "descriptors" empty to start over.
+    /// </summary>
+    void retireDescriptorAllocator(DescriptorAllocator& descriptors)
+    {
+        std::vector<VkDescriptorPool> pools = std::move(descriptors.usedPools);
+        pools.insert(pools.end(), descriptors.freePools.begin(), descriptors.freePools.end());
+        if (!pools.empty())
+        {
+            deferDestruction(graphicsTimeline.lastSignaled + 1, [this, pools]() {
+                for (VkDescriptorPool pool : pools) {
+                    vkDestroyDescriptorPool(device, pool, allocator);
+                }
+            });
+        }
+        descriptors = DescriptorAllocator{};
+    }
+
+    /// <summary>
+    /// Points the bindings of "set" at what "bindings" describes, in one call through the layout's update template.
+    /// Every binding of the layout has to be given.
+    /// </summary>
+    void writeDescriptorSet(const DescriptorLayout& layout, VkDescriptorSet set, const DescriptorBinding* bindings, uint32_t bindingCount)
+    {
+        // fixed size so writing transient sets every frame doesn't allocate
+        const uint32_t MAX_BINDINGS = 8;
+        if (bindingCount != layout.bindings.size() || bindingCount > MAX_BINDINGS) {
+            throw std::runtime_error("descriptor set write doesn't match its layout!");
+        }
+
+        std::array<DescriptorInfo, MAX_BINDINGS> infos;
+        for (uint32_t i = 0; i < bindingCount; i++)
+        {
+            // put each binding's info where the template expects it
+            uint32_t entry = static_cast<uint32_t>(std::find(layout.bindings.begin(), layout.bindings.end(), bindings[i].binding) - layout.bindings.begin());
+            if (entry == bindingCount) {
+                throw std::runtime_error("descriptor set write names a binding its layout doesn't have!");
+            }
+
+            if (bindings[i].buffer != VK_NULL_HANDLE)
+                infos[entry].buffer = { bindings[i].buffer, bindings[i].offset, bindings[i].range };
+            else
+                infos[entry].image = { bindings[i].sampler, bindings[i].imageView, bindings[i].imageLayout };
+        }
+
+        vkUpdateDescriptorSetWithTemplate(device, set, layout.updateTemplate, infos.data());
+    }
+
+    /// <summary>
+    /// Writes a whole set from a packed struct of DescriptorInfos (or VkDescriptorBufferInfo/VkDescriptorImageInfo
+    /// padded to sizeof(DescriptorInfo)), one per binding in the layout's order.
+    /// </summary>
+    void writeDescriptorSet(const DescriptorLayout& layout, VkDescriptorSet set, const void* packedInfos)
+    {
+        vkUpdateDescriptorSetWithTemplate(device, set, layout.updateTemplate, packedInfos);
+    }
+
+    /// <summary>
+    /// Same as "writeDescriptorSet", but with one VkWriteDescriptorSet per binding and "vkUpdateDescriptorSets".
+    /// Only kept around to compare against in the descriptor update benchmark.
+    /// </summary>
+    void writeDescriptorSetWithoutTemplate(VkDescriptorSet set, const DescriptorBinding* bindings, uint32_t bindingCount)
+    {
+        // fixed size so writing transient sets every frame doesn't allocate
+        const uint32_t MAX_BINDINGS = 8;
+        if (bindingCount > MAX_BINDINGS) {
+            throw std::runtime_error("too many bindings in one descriptor set write!");
+        }
+
+        std::array<VkDescriptorBufferInfo, MAX_BINDINGS> bufferInfos{};
+        std::array<VkDescriptorImageInfo, MAX_BINDINGS> imageInfos{};
+        std::array<VkWriteDescriptorSet, MAX_BINDINGS> descriptorWrites{};
+        for (uint32_t i = 0; i < bindingCount; i++)
+        {
+            descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[i].dstSet = set;
+            descriptorWrites[i].dstBinding = bindings[i].binding;
+            descriptorWrites[i].dstArrayElement = 0;
+            descriptorWrites[i].descriptorType = bindings[i].type;
+            descriptorWrites[i].descriptorCount = 1;
+
+            if (bindings[i].buffer != VK_NULL_HANDLE)
+            {
+                bufferInfos[i].buffer = bindings[i].buffer;
+                bufferInfos[i].offset = bindings[i].offset;
+                bufferInfos[i].range = bindings[i].range;
+                descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+            }
+            else
+            {
+                imageInfos[i].imageView = bindings[i].imageView;
+                imageInfos[i].sampler = bindings[i].sampler;
+                imageInfos[i].imageLayout = bindings[i].imageLayout;
+                descriptorWrites[i].pImageInfo = &imageInfos[i];
+            }
+        }
+
+        vkUpdateDescriptorSets(device, bindingCount, descriptorWrites.data(), 0, nullptr);
+    }
+
+    /// <summary>
+    /// Returns a set with the given layout and contents that lives until shutdown. Asking for the same layout
+    /// and contents again returns the same set instead of allocating another one. Entries are never evicted, so
+    /// only for sets of resources that live until shutdown too, anything that gets recreated needs sets of its own.
+    /// </summary>
+    VkDescriptorSet getPersistentDescriptorSet(const DescriptorLayout& layout, std::initializer_list<DescriptorBinding> bindings)
+    {
+        DescriptorSetKey key{ layout.layout, bindings };
+        auto cached = descriptorSetCache.find(key);
+        if (cached != descriptorSetCache.end())
+            return cached->second;
+
+        VkDescriptorSet set = allocateDescriptorSet(persistentDescriptors, layout.layout);
+        writeDescriptorSet(layout, set, key.bindings.data(), static_cast<uint32_t>(key.bindings.size()));
+        descriptorSetCache.emplace(std::move(key), set);
+        return set;
+    }
+
+    /// <summary>
+    /// Returns a set that is only valid for the frame being recorded. It is freed with the rest of the frame's sets
+    /// once the GPU is done with the frame.
+    /// </summary>
+    VkDescriptorSet allocateFrameDescriptorSet(const DescriptorLayout& layout, std::initializer_list<DescriptorBinding> bindings)
+    {
+        VkDescriptorSet set = allocateDescriptorSet(frameDescriptors[currentFrame], layout.layout);
+        writeDescriptorSet(layout, set, bindings.begin(), static_cast<uint32_t>(bindings.size()));
+        return set;
+    }
+
+    /// <summary>
+    /// Writes the same per-frame sets over and over, once with one VkWriteDescriptorSet per binding and once through the
+    /// layout's update template from a packed struct, and prints the time per set for each.
+    /// </summary>
+    void descriptorUpdateBenchmark()
+    {
+        // the packed form of a frame set, laid out the way the template generated from frameSetLayout expects it
+        struct FrameSetInfos {
+            DescriptorInfo camera;
+            DescriptorInfo draw;
+        };
+
+        const std::array<uint32_t, 3> updateCounts = { 1000, 10000, 100000 };
+        const uint32_t setCount = updateCounts.back();
+
+        DescriptorAllocator benchmarkDescriptors;
+        std::vector<VkDescriptorSet> sets(setCount);
+        for (VkDescriptorSet& set : sets)
+        {
+            set = allocateDescriptorSet(benchmarkDescriptors, frameSetLayout.layout);
+        }
+
+        std::array<DescriptorBinding, 2> bindings = {
+            DescriptorBinding::forBuffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, uniformRing.buffer, 0, sizeof(CameraUniforms)),
+            DescriptorBinding::forBuffer(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, uniformRing.buffer, 0, sizeof(DrawUniforms)),
+        };
+        FrameSetInfos packed{};
+        packed.camera.buffer = { uniformRing.buffer, 0, sizeof(CameraUniforms) };
+        packed.draw.buffer = { uniformRing.buffer, 0, sizeof(DrawUniforms) };
+
+        // every set is written both ways once up front, so neither way is the first to touch the sets or its code
+        for (VkDescriptorSet set : sets)
+        {
+            writeDescriptorSetWithoutTemplate(set, bindings.data(), static_cast<uint32_t>(bindings.size()));
+            writeDescriptorSet(frameSetLayout, set, &packed);
+        }
+
+        const uint32_t ROUNDS = 4;
+        for (uint32_t updates : updateCounts)
+        {
+            // the two ways take turns going first, whichever goes second finds the sets a little warmer
+            double writesNs = 0.0;
+            double templateNs = 0.0;
+            for (uint32_t run = 0; run < ROUNDS * 2; run++)
+            {
+                bool useTemplate = (run + run / 2) % 2 == 1;
+                auto start = std::chrono::steady_clock::now();
+                for (uint32_t i = 0; i < updates; i++)
+                {
+                    if (useTemplate)
+                        writeDescriptorSet(frameSetLayout, sets[i], &packed);
+                    else
+                        writeDescriptorSetWithoutTemplate(sets[i], bindings.data(), static_cast<uint32_t>(bindings.size()));
+                }
+                (useTemplate ? templateNs : writesNs) += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            }
+
+            std::cout << updates << " updates: "
+                << writesNs / (ROUNDS * updates) << " ns per set with vkUpdateDescriptorSets, "
+                << templateNs / (ROUNDS * updates) << " ns per set with a template" << std::endl;
+        }
+
+        destroyDescriptorAllocator(benchmarkDescriptors);
+    }
+
+    void createDescriptorSets()
+    {
+        // both bindings point at the start of the ring, the dynamic offsets given at bind time pick the actual data
+        frameDescriptorSet = getPersistentDescriptorSet(frameSetLayout, {
+            DescriptorBinding::forBuffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, uniformRing.buffer, 0, sizeof(CameraUniforms)),
+            DescriptorBinding::forBuffer(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, uniformRing.buffer, 0, sizeof(DrawUniforms)),
+        });
+    }
+
+    void generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels)
+    {
+        PROFILE_SCOPE("generateMipmaps");
+
+        // Check if image format supports linear blitting
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, imageFormat, &formatProperties);
+
+        if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+            throw std::runtime_error("texture image format does not support linear blitting!");
+        }
+
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.image = image;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.subresourceRange.levelCount = 1;
+
+        int32_t mipWidth = texWidth;
+        int32_t mipHeight = texHeight;
+
+        for (uint32_t i = 1; i < mipLevels; i++)
+        {
+            barrier.subresourceRange.baseMipLevel = i - 1;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+            vkCmdPipelineBarrier(
+                commandBuffer,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                0, nullptr,
+                0, nullptr,
+                1, &barrier);
+
+            VkImageBlit blit{};
+            blit.srcOffsets[0] = { 0, 0, 0 };
+            blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+            blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.srcSubresource.mipLevel = i - 1;
+            blit.srcSubresource.baseArrayLayer = 0;
+            blit.srcSubresource.layerCount = 1;
+            blit.dstOffsets[0] = { 0, 0, 0 };
+            blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
+            blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.dstSubresource.mipLevel = i;
+            blit.dstSubresource.baseArrayLayer = 0;
+            blit.dstSubresource.layerCount = 1;
+
+            vkCmdBlitImage(commandBuffer,
+                image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                1, &blit,
+                VK_FILTER_LINEAR);
+
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+            vkCmdPipelineBarrier(commandBuffer,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                0, nullptr,
+                0, nullptr,
+                1, &barrier);
+
+            if (mipWidth > 1) mipWidth /= 2;
+            if (mipHeight > 1) mipHeight /= 2;
+        }
+
+        barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier);
+
+        endSingleTimeCommands();
+    }
+
+    void createTextureImage()
+    {
+        PROFILE_SCOPE("createTextureImage");
+
         int texWidth, texHeight, texChannels;
         stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+
+        if (!pixels) {
+            throw std::runtime_error("failed to load texture image!");
+        }
+
+        mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
+
+        createTextureImage(pixels, texWidth, texHeight, mipLevels, textureImage, textureImageMemory);
+        stbi_image_free(pixels);
+    }
+
+    /// <summary>
+    /// A 1x1 grey texture for the instances to sample while the model texture is streamed in.
+    /// </summary>
+    void createPlaceholderTexture()
+    {
+        const stbi_uc pixel[4] = { 128, 128, 128, 255 };
+        createTextureImage(pixel, 1, 1, 1, placeholderTexture, placeholderTextureMemory);
+        placeholderTextureView = own<vkDestroyImageView>(createImageView(placeholderTexture.get(), VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, 1));
+    }
+
+    /// <summary>
+    /// Uploads RGBA8 "pixels" into a new sampled image through the current upload batch and generates "levels" mip levels from them.
+    /// </summary>
+    void createTextureImage(const stbi_uc* pixels, int texWidth, int texHeight, uint32_t levels, VulkanHandle<VkImage, vkDestroyImage>& image, VulkanHandle<VkDeviceMemory, vkFreeMemory>& imageMemory)
+    {
         VkDeviceSize imageSize = texWidth * texHeight * 4;
 
-        mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
+        VkBuffer stagingBuffer;
+        VkDeviceMemory stagingBufferMemory;
+        createBuffer(imageSize, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+        
+        void* data;
+        vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
+        memcpy(data, pixels, static_cast<size_t>(imageSize));
+        vkUnmapMemory(device, stagingBufferMemory);
+
+        createImage(texWidth, texHeight, levels, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, imageMemory);
+
+        transitionImageLayout(image.get(), VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, levels);
+        copyBufferToImage(stagingBuffer, image.get(), static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
+        // the blits in "generateMipmaps" need a graphics queue
+        transferImageOwnership(image.get(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, levels, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+        generateMipmaps(image.get(), VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, levels);
+        // transitioning the image layout to shader ead only is done when generating mipmaps
+
+        releaseStagingBuffer(stagingBuffer, stagingBufferMemory);
+    }
+
+    /// <summary>
+    /// "createImage" for an image and memory owned by VulkanHandles.
+    /// </summary>
+    void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VulkanHandle<VkImage, vkDestroyImage>& image, VulkanHandle<VkDeviceMemory, vkFreeMemory>& imageMemory)
+    {
+        VkImage rawImage;
+        VkDeviceMemory rawMemory;
+        createImage(width, height, mipLevels, format, tiling, usage, properties, rawImage, rawMemory);
+        image = own<vkDestroyImage>(rawImage);
+        imageMemory = own<vkFreeMemory>(rawMemory);
+    }
+
+    void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent.width = width;
+        imageInfo.extent.height = height;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = mipLevels;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = format;
+        imageInfo.tiling = tiling;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = usage;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateImage(device, &imageInfo, allocator, &image) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create image!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(device, image, &memRequirements);
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+
+        if (vkAllocateMemory(device, &allocInfo, allocator, &imageMemory) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate image memory!");
+        }
+
+        vkBindImageMemory(device, image, imageMemory, 0);
+    }
+
+    /// <summary>
+    /// Allocates the command buffers, fence and semaphores used for batched uploads. Needs "commandPool" and "transferCommandPool".
+    /// </summary>
+    void createUploadContext()
+    {
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+        uploadContext.graphicsFamily = indices.graphicsFamily.value();
+        uploadContext.transferFamily = indices.transferFamily.value_or(uploadContext.graphicsFamily);
+        uploadContext.dedicatedTransferQueue = uploadContext.transferFamily != uploadContext.graphicsFamily;
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = commandPool;
+        allocInfo.commandBufferCount = 1;
+
+        if (vkAllocateCommandBuffers(device, &allocInfo, &uploadContext.commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate upload command buffer!");
+        }
+
+        // without a separate transfer family everything is recorded into the graphics command buffer
+        uploadContext.transferCommandBuffer = uploadContext.commandBuffer;
+        if (uploadContext.dedicatedTransferQueue)
+        {
+            allocInfo.commandPool = transferCommandPool;
+            if (vkAllocateCommandBuffers(device, &allocInfo, &uploadContext.transferCommandBuffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate transfer command buffer!");
+            }
+        }
+
+        std::cout << (uploadContext.dedicatedTransferQueue ? "Uploads use dedicated transfer queue family " : "Uploads use the graphics queue family ")
+            << uploadContext.transferFamily << std::endl;
+    }
+
+    /// <summary>
+    /// Starts recording an upload batch. Until "flushUploads" is called every helper that goes through
+    /// "beginSingleTimeCommands" or "beginTransferCommands" records into the batch instead of submitting on its own.
+    /// </summary>
+    void beginUploadBatch()
+    {
+        // the command buffers can't be reused while a previous batch is still executing
+        waitForUploads();
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        if (vkBeginCommandBuffer(uploadContext.commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording upload command buffer!");
+        }
+
+        if (uploadContext.dedicatedTransferQueue &&
+            vkBeginCommandBuffer(uploadContext.transferCommandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording transfer command buffer!");
+        }
+
+        uploadContext.recording = true;
+        uploadContext.transferRecorded = false;
+    }
+
+    /// <summary>
+    /// Submits everything recorded since "beginUploadBatch" in one go. With a dedicated transfer queue the copies go to
+    /// "transferQueue" and the graphics half (ownership acquires, mipmaps, depth transitions) waits on "transferTimeline".
+    /// The graphics half signals the next "graphicsTimeline" value, which frees the staging buffers once reached.
+    /// </summary>
+    /// <param name="waitForCompletion"> - if false the CPU doesn't block, instead the next frame's submit waits for the batch's timeline value</param>
+    void flushUploads(bool waitForCompletion)
+    {
+        if (!uploadContext.recording)
+            return;
+
+        PROFILE_SCOPE("flushUploads");
+
+        submitGraphicsUploads(submitTransferUploads());
+
+        if (waitForCompletion)
+        {
+            waitForUploads();
+            collectDeferredDeletions();
+        }
+        else
+        {
+            uploadContext.frameWaitValue = uploadContext.batchValue;
+        }
+    }
+
+    /// <summary>
+    /// "flushUploads" for uploads made while frames are rendering. Only the copies are submitted, the graphics half is held
+    /// back until "pollStreamedUploads" sees the transfer queue is done with them, so the frames submitted meanwhile never
+    /// queue up behind a semaphore wait on the graphics queue. Without a dedicated transfer queue this is "flushUploads(false)".
+    /// </summary>
+    void streamUploads()
+    {
+        if (!uploadContext.recording)
+            return;
+
+        PROFILE_SCOPE("streamUploads");
+
+        uploadContext.streamedTransferValue = submitTransferUploads();
+        uploadContext.streamPending = true;
+        pollStreamedUploads();
+    }
+
+    /// <summary>
+    /// Submits the graphics half of the streamed batch if its copies are done. The next frame's submit waits for it on the GPU.
+    /// </summary>
+    /// <returns>true once the whole batch is submitted, frames from then on can use what it uploaded</returns>
+    bool pollStreamedUploads()
+    {
+        if (!uploadContext.streamPending)
+            return true;
+
+        if (uploadContext.streamedTransferValue != 0 && !gpuPointReached(transferTimeline, uploadContext.streamedTransferValue))
+            return false;
+
+        uploadContext.streamPending = false;
+        submitGraphicsUploads(uploadContext.streamedTransferValue);
+        uploadContext.frameWaitValue = uploadContext.batchValue;
+        return true;
+    }
+
+    /// <summary>
+    /// Ends recording of the current batch and submits its transfer half to "transferQueue".
+    /// </summary>
+    /// <returns>the "transferTimeline" value the copies signal, 0 if nothing went to the transfer queue</returns>
+    uint64_t submitTransferUploads()
+    {
+        uploadContext.recording = false;
+        uploadContext.implicitBatch = false;
+
+        bool submitTransfer = uploadContext.dedicatedTransferQueue && uploadContext.transferRecorded;
+
+        if (uploadContext.dedicatedTransferQueue && vkEndCommandBuffer(uploadContext.transferCommandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record transfer command buffer!");
+        }
+        if (vkEndCommandBuffer(uploadContext.commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record upload command buffer!");
+        }
+
+        if (!submitTransfer)
+            return 0;
+
+        uint64_t transferValue = transferTimeline.lastSignaled + 1;
+
+        VkTimelineSemaphoreSubmitInfo transferTimelineInfo{};
+        transferTimelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        transferTimelineInfo.signalSemaphoreValueCount = 1;
+        transferTimelineInfo.pSignalSemaphoreValues = &transferValue;
+
+        VkSubmitInfo transferSubmitInfo{};
+        transferSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        transferSubmitInfo.pNext = &transferTimelineInfo;
+        transferSubmitInfo.commandBufferCount = 1;
+        transferSubmitInfo.pCommandBuffers = &uploadContext.transferCommandBuffer;
+        transferSubmitInfo.signalSemaphoreCount = 1;
+        transferSubmitInfo.pSignalSemaphores = &transferTimeline.semaphore;
+
+        if (vkQueueSubmit(transferQueue, 1, &transferSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit transfer command buffer!");
+        }
+        transferTimeline.lastSignaled = transferValue;
+        uploadContext.submitCount++;
+        return transferValue;
+    }
+
+    /// <summary>
+    /// Submits the graphics half of the batch "submitTransferUploads" ended and hands its staging buffers to the deferred deletions.
+    /// </summary>
+    /// <param name="transferValue"> - "transferTimeline" value to wait for first, 0 if the batch had no transfer half</param>
+    void submitGraphicsUploads(uint64_t transferValue)
+    {
+        // the acquire barriers at the start of the graphics half must not run before the releases on the transfer queue
+        VkPipelineStageFlags transferWaitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        uint64_t batchValue = graphicsTimeline.lastSignaled + 1;
+
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.waitSemaphoreValueCount = transferValue != 0 ? 1 : 0;
+        timelineInfo.pWaitSemaphoreValues = &transferValue;
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &batchValue;
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.waitSemaphoreCount = transferValue != 0 ? 1 : 0;
+        submitInfo.pWaitSemaphores = &transferTimeline.semaphore;
+        submitInfo.pWaitDstStageMask = &transferWaitStage;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &uploadContext.commandBuffer;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &graphicsTimeline.semaphore;
+
+        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit upload command buffer!");
+        }
+        graphicsTimeline.lastSignaled = batchValue;
+        uploadContext.batchValue = batchValue;
+        uploadContext.submitCount++;
+
+        for (auto& staging : uploadContext.stagingBuffers)
+        {
+            VkBuffer buffer = staging.first;
+            VkDeviceMemory memory = staging.second;
+            deferDestruction(batchValue, [this, buffer, memory]() {
+                vkDestroyBuffer(device, buffer, allocator);
+                vkFreeMemory(device, memory, allocator);
+            });
+        }
+        uploadContext.stagingBuffers.clear();
+    }
+
+    /// <summary>
+    /// Blocks until the last submitted upload batch has finished on the GPU.
+    /// </summary>
+    void waitForUploads()
+    {
+        PROFILE_SCOPE("waitForUploads");
+
+        // a streamed batch has to be submitted in full before it can be waited for
+        if (uploadContext.streamPending)
+        {
+            waitForGpuPoint(transferTimeline, uploadContext.streamedTransferValue);
+            pollStreamedUploads();
+        }
+
+        if (waitForGpuPoint(graphicsTimeline, uploadContext.batchValue))
+        {
+            uploadContext.waitCount++;
+        }
+    }
+
+    /// <summary>
+    /// Destroys a staging buffer, or hands it to the upload context if a batch still has to read from it.
+    /// </summary>
+    void releaseStagingBuffer(VkBuffer buffer, VkDeviceMemory memory)
+    {
+        if (uploadContext.recording)
+        {
+            uploadContext.stagingBuffers.push_back({ buffer, memory });
+            return;
+        }
+
+        vkDestroyBuffer(device, buffer, allocator);
+        vkFreeMemory(device, memory, allocator);
+    }
+
+    /// <summary>
+    /// Hands a buffer written on the transfer queue over to the graphics queue family. Records the release half into
+    /// the transfer command buffer and the acquire half into the graphics command buffer of the current batch.
+    /// Does nothing when uploads already run on the graphics family.
+    /// </summary>
+    /// <param name="dstStage"> - first stage that reads the buffer on the graphics queue</param>
+    /// <param name="dstAccess"> - how the graphics queue reads it</param>
+    void transferBufferOwnership(VkBuffer buffer, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+    {
+        if (!uploadContext.dedicatedTransferQueue)
+            return;
+
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = uploadContext.transferFamily;
+        barrier.dstQueueFamilyIndex = uploadContext.graphicsFamily;
+        barrier.buffer = buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+
+        // release: dstAccessMask is ignored for this half
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        vkCmdPipelineBarrier(beginTransferCommands(),
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+            0, nullptr,
+            1, &barrier,
+            0, nullptr);
+
+        // acquire: srcAccessMask is ignored for this half
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = dstAccess;
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage, 0,
+            0, nullptr,
+            1, &barrier,
+            0, nullptr);
+
+        endSingleTimeCommands();
+    }
+
+    /// <summary>
+    /// Same as "transferBufferOwnership" for all mip levels of a color image. The layout stays the same.
+    /// </summary>
+    void transferImageOwnership(VkImage image, VkImageLayout layout, uint32_t mipLevels, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+    {
+        if (!uploadContext.dedicatedTransferQueue)
+            return;
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = layout;
+        barrier.newLayout = layout;
+        barrier.srcQueueFamilyIndex = uploadContext.transferFamily;
+        barrier.dstQueueFamilyIndex = uploadContext.graphicsFamily;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = mipLevels;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        vkCmdPipelineBarrier(beginTransferCommands(),
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier);
+
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = dstAccess;
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage, 0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier);
+
+        endSingleTimeCommands();
+    }
+
+    /// <summary>
+    /// Returns the graphics command buffer of the current upload batch. If no batch is open, one is opened
+    /// that "endSingleTimeCommands" submits and waits on right away.
+    /// </summary>
+    VkCommandBuffer beginSingleTimeCommands() {
+        if (!uploadContext.recording)
+        {
+            beginUploadBatch();
+            uploadContext.implicitBatch = true;
+        }
+
+        return uploadContext.commandBuffer;
+    }
+
+    /// <summary>
+    /// Like "beginSingleTimeCommands", but returns the command buffer that executes on "transferQueue".
+    /// Only copies and barriers can go in here, a dedicated transfer family can't blit or draw.
+    /// </summary>
+    VkCommandBuffer beginTransferCommands() {
+        beginSingleTimeCommands();
+        uploadContext.transferRecorded = true;
+        return uploadContext.transferCommandBuffer;
+    }
+
+    /// <summary>
+    /// Closes what "beginSingleTimeCommands" or "beginTransferCommands" opened, submitting and waiting on it if it was a batch of its own.
+    /// </summary>
+    void endSingleTimeCommands() {
+        // commands recorded into an explicit batch get submitted by whoever opened it
+        if (uploadContext.implicitBatch)
+        {
+            flushUploads(true);
+        }
+    }
+
+    void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels) {
+        // getting an image ready to be copied into happens on the queue that does the copy
+        VkCommandBuffer commandBuffer = newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL ? beginTransferCommands() : beginSingleTimeCommands();
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
+            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+
+            if (hasStencilComponent(format)) {
+                barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+            }
+        }
+        else {
+            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        }
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = mipLevels;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+
+        VkPipelineStageFlags sourceStage;
+        VkPipelineStageFlags destinationStage;
+
+        if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+            sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+            destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        }
+        else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+            sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+            destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        }
+        else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+            sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+            destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        }
+        else {
+            throw std::invalid_argument("unsupported layout transition!");
+        }
+
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            sourceStage, destinationStage,
+            0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier
+        );
+
+        endSingleTimeCommands();
+    }
+
+    void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
+        PROFILE_SCOPE("copyBufferToImage");
+
+        VkCommandBuffer commandBuffer = beginTransferCommands();
+
+        VkBufferImageCopy region{};
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+
+        region.imageOffset = { 0, 0, 0 };
+        region.imageExtent =
+        {
+            width,
+            height,
+            1
+        };
+
+        vkCmdCopyBufferToImage(
+            commandBuffer,
+            buffer,
+            image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1,
+            &region
+        );
+
+        endSingleTimeCommands();
+    }
+
+    void createTextureImageView()
+    {
+        textureImageView = own<vkDestroyImageView>(createImageView(textureImage.get(), VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels));
+    }
+
+    VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlagBits aspectFlags, uint32_t mipLevels, uint32_t baseMipLevel = 0) {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = format;
+        viewInfo.subresourceRange.aspectMask = aspectFlags;
+        viewInfo.subresourceRange.baseMipLevel = baseMipLevel;
+        viewInfo.subresourceRange.levelCount = mipLevels;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        VkImageView imageView;
+        if (vkCreateImageView(device, &viewInfo, allocator, &imageView) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create texture image view!");
+        }
+
+        return imageView;
+    }
+
+    void createTextureSampler()
+    {
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.anisotropyEnable = VK_TRUE;
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        samplerInfo.maxAnisotropy = properties.limits.maxSamplerAnisotropy;
+        samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+        samplerInfo.unnormalizedCoordinates = VK_FALSE;
+        samplerInfo.compareEnable = VK_FALSE;
+        samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        // not tied to one texture's mip count, the streamed texture shares the placeholder's sampler
+        samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+        samplerInfo.minLod = 0.0f; // Optional
+        samplerInfo.mipLodBias = 0.0f; // Optional
+
+        VkSampler sampler;
+        if (vkCreateSampler(device, &samplerInfo, allocator, &sampler) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create texture sampler!");
+        }
+        textureSampler = own<vkDestroySampler>(sampler);
+    }
+
+    VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) {
+        for (VkFormat format : candidates) {
+            VkFormatProperties props;
+            vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
+
+            if (tiling == VK_IMAGE_TILING_LINEAR && (props.linearTilingFeatures & features) == features) {
+                return format;
+            }
+            else if (tiling == VK_IMAGE_TILING_OPTIMAL && (props.optimalTilingFeatures & features) == features) {
+                return format;
+            }
+        }
+
+        throw std::runtime_error("failed to find supported format!");
+    }
+
+    bool hasStencilComponent(VkFormat format) {
+        return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
+    }
+
+    VkFormat findDepthFormat()
+    {
+        return findSupportedFormat(
+            { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
+        );
+    }
+
+    /// <summary>
+    /// Reads the benchmark camera path. Every line that isn't empty or a # comment is one keyframe:
+    /// time eyeX eyeY eyeZ targetX targetY targetZ objectAngle, with times in seconds and increasing.
+    /// </summary>
+    void loadCameraPath()
+    {
+        if (options.benchmark.cameraPath.empty())
+            return;
 
-        if (!pixels) {
-            throw std::runtime_error("failed to load texture image!");
+        std::ifstream file(options.benchmark.cameraPath);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("Error opening camera path: " + options.benchmark.cameraPath);
         }
 
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        createBuffer(imageSize, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-        
-        void* data;
-        vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-        memcpy(data, pixels, static_cast<size_t>(imageSize));
-        vkUnmapMemory(device, stagingBufferMemory);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
 
-        stbi_image_free(pixels);
+            std::istringstream stream(line);
+            CameraKeyframe keyframe{};
+            if (!(stream >> keyframe.time >> keyframe.eye.x >> keyframe.eye.y >> keyframe.eye.z
+                >> keyframe.target.x >> keyframe.target.y >> keyframe.target.z >> keyframe.objectAngle))
+            {
+                throw std::runtime_error("Malformed camera path keyframe: " + line);
+            }
+            if (!cameraPath.empty() && keyframe.time <= cameraPath.back().time)
+            {
+                throw std::runtime_error("Camera path keyframe times have to increase: " + line);
+            }
+            cameraPath.push_back(keyframe);
+        }
 
-        createImage(texWidth, texHeight, mipLevels, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
+        if (cameraPath.empty())
+        {
+            throw std::runtime_error("Camera path has no keyframes: " + options.benchmark.cameraPath);
+        }
+    }
 
-        transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
-        copyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
-        generateMipmaps(textureImage, VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, mipLevels);
-        // transitioning the image layout to shader ead only is done when generating mipmaps
+    /// <summary>
+    /// Where the camera and model are at the given time. Without a path this is the slow spin around z the renderer
+    /// always had, with one the path is held at its first and last keyframe outside of its time range.
+    /// </summary>
+    CameraKeyframe sampleCameraPath(float time)
+    {
+        if (cameraPath.empty())
+        {
+            return { time, glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), 20.0f * time };
+        }
+
+        if (time <= cameraPath.front().time)
+            return cameraPath.front();
+        if (time >= cameraPath.back().time)
+            return cameraPath.back();
+
+        size_t next = 1;
+        while (cameraPath[next].time < time)
+            next++;
 
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
+        const CameraKeyframe& a = cameraPath[next - 1];
+        const CameraKeyframe& b = cameraPath[next];
+        float t = (time - a.time) / (b.time - a.time);
+        return { time, glm::mix(a.eye, b.eye, t), glm::mix(a.target, b.target, t), glm::mix(a.objectAngle, b.objectAngle, t) };
     }
 
-    void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) {
-        VkImageCreateInfo imageInfo{};
-        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-        imageInfo.imageType = VK_IMAGE_TYPE_2D;
-        imageInfo.extent.width = width;
-        imageInfo.extent.height = height;
-        imageInfo.extent.depth = 1;
-        imageInfo.mipLevels = mipLevels;
-        imageInfo.arrayLayers = 1;
-        imageInfo.format = format;
-        imageInfo.tiling = tiling;
-        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        imageInfo.usage = usage;
-        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    void loadModel() {
+        PROFILE_SCOPE("loadModel");
 
-        if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create image!");
+        tinyobj::attrib_t attrib;
+        std::vector<tinyobj::shape_t> shapes;
+        std::vector<tinyobj::material_t> materials;
+        std::string warn, err;
+
+        if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str())) {
+            throw std::runtime_error(warn + err);
         }
 
-        VkMemoryRequirements memRequirements;
-        vkGetImageMemoryRequirements(device, image, &memRequirements);
+        std::unordered_map<Vertex, uint32_t> uniqueVertices;
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+        for (const auto& shape : shapes) {
+            for (const auto& index : shape.mesh.indices) {
+                Vertex vertex{};
 
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate image memory!");
+                vertex.pos = {
+                    attrib.vertices[3 * index.vertex_index + 0],
+                    attrib.vertices[3 * index.vertex_index + 1],
+                    attrib.vertices[3 * index.vertex_index + 2]
+                };
+
+                vertex.texCoords = {
+                    attrib.texcoords[2 * index.texcoord_index + 0],
+                    1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
+                };
+
+                vertex.color = { 1.0f, 1.0f, 1.0f };
+
+                if (uniqueVertices.count(vertex) == 0) {
+                    uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
+                    vertices.push_back(vertex);
+                }
+
+                indices.push_back(uniqueVertices[vertex]);
+            }
         }
 
-        vkBindImageMemory(device, image, imageMemory, 0);
+        modelBox.min = glm::vec3(std::numeric_limits<float>::max());
+        modelBox.max = glm::vec3(std::numeric_limits<float>::lowest());
+        for (const Vertex& vertex : vertices)
+        {
+            modelBox.min = glm::min(modelBox.min, vertex.pos);
+            modelBox.max = glm::max(modelBox.max, vertex.pos);
+        }
+
+        // the GPU culling shaders test a sphere, centered on the box but only as big as the vertices need
+        glm::vec3 center = (modelBox.min + modelBox.max) * 0.5f;
+        float radius = 0.0f;
+        for (const Vertex& vertex : vertices)
+        {
+            radius = (std::max)(radius, glm::length(vertex.pos - center));
+        }
+        modelBounds = glm::vec4(center, radius);
     }
 
-    VkCommandBuffer beginSingleTimeCommands() {
-        VkCommandBufferAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandPool = commandPool;
-        allocInfo.commandBufferCount = 1;
+    /// <summary>
+    /// Initializes all of the vulkan resources required to work with the API.
+    /// </summary>
+    void initVulkan() {
+        jobs.start(options.jobThreads == 0 ? std::thread::hardware_concurrency() : options.jobThreads, options.pinJobThreads);
+        createInstance();
+        setupDebugMessenger();
+        createSurface();
+        pickPhysicalDevice();
+        createLogicalDevice();
+        createTimelines();
+        createSwapChain();
+        createImageViews();
+        createRenderGraph();
+        createDescriptorSetLayout();
+        createBindlessTextures();
+        createGraphicsPipeline();
+        createDepthPrepassPipeline();
+        createCommandPool();
+        createUploadContext();
 
-        VkCommandBuffer commandBuffer;
-        vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+        // everything from here to "flushUploads" is recorded into one command buffer, the first frame waits on it
+        beginUploadBatch();
+        createTextureSampler();
+        if (options.streamTextures)
+        {
+            createPlaceholderTexture();
+            modelTextureIndex = registerTexture(placeholderTextureView.get(), textureSampler.get());
+            textureStream = TextureStreamState::Pending;
+        }
+        else
+        {
+            createTextureImage();
+            createTextureImageView();
+            modelTextureIndex = registerTexture(textureImageView.get(), textureSampler.get());
+        }
+        loadModel();
+        createVertexBuffer();
+        createIndexBuffer();
+        createPositionBuffer();
+        flushUploads(false);
 
-        VkCommandBufferBeginInfo beginInfo{};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        createUniformRing();
+        createInstances();
+        createDescriptorSets();
+        createOcclusionCulling();
+        createGpuDrivenRendering();
+        createCommandBuffers();
+        createRecordSlices();
+        createCommandCache();
+#if ENABLE_PROFILING
+        createProfiler();
+#endif
+        createTimestampQueries();
+        createPipelineStatisticsQueries();
+        createReadbackBuffers();
+        createSyncObjects();
+        loadCameraPath();
+        animationStartTime = std::chrono::steady_clock::now();
 
-        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        std::cout << "Startup uploads: " << uploadContext.submitCount << " submit(s), " << uploadContext.waitCount << " wait(s)" << std::endl;
+    }
 
-        return commandBuffer;
+    /// <summary>
+    /// If necessary, sets up debug messenger so you can see validation messages.
+    /// </summary>
+    void setupDebugMessenger()
+    {
+        if (!enableValidationLayers) return;
+
+        VkDebugUtilsMessengerCreateInfoEXT createInfo{};
+        populateDebugMessengerCreateInfo(createInfo);
+
+        if (CreateDebugUtilsMessengerEXT(instance, &createInfo, allocator, &debugMessenger) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to set up debug messenger.");
+        }
+    }
+
+    void updateUniformBuffer()
+    {
+        PROFILE_SCOPE("updateUniformBuffer");
+
+        // benchmark runs step "simulationTime" themselves so every run renders the same frames
+        if (!options.benchmark.enabled)
+        {
+            simulationTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - animationStartTime).count();
+        }
+        CameraKeyframe pose = sampleCameraPath(static_cast<float>(simulationTime));
+
+        glm::mat4 view = glm::lookAt(pose.eye, pose.target, glm::vec3(0.0f, 0.0f, 1.0f));
+        glm::mat4 proj = glm::perspective(glm::radians(45.0f), swapChainExtent.width / (float)swapChainExtent.height, 0.1f, farPlane);
+        proj[1][1] *= -1; // this is to flip the clip space y component
+
+        CameraUniforms camera{};
+        camera.viewProj = proj * view;
+        cameraUniformOffset = pushUniforms(camera);
+
+        // every copy spins with the model, each one is the shared rotation moved by its own offset.
+        // only the translation differs per instance, so that's all that gets computed in the loop
+        auto instancesStart = std::chrono::steady_clock::now();
+
+        glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), glm::radians(pose.objectAngle), glm::vec3(0.0f, 0.0f, 1.0f));
+        glm::mat3 rotation3(rotation);
+        uint32_t count = static_cast<uint32_t>(instanceOffsets.size());
+
+        // the draw generation shader builds the transforms itself, the CPU's work doesn't grow with the instances
+        if (options.gpuDriven)
+        {
+            InstanceUniforms instanceUniforms{};
+            instanceUniforms.rotation = rotation;
+            instanceUniformOffset = pushUniforms(instanceUniforms);
+            instanceCounts[currentFrame] = count;
+            return;
+        }
+
+        if (options.frustumCulling)
+        {
+            count = cullInstances(camera.viewProj, rotation3);
+        }
+
+        InstanceData* instances = writeInstances(count);
+        const uint32_t* visible = options.frustumCulling ? visibleInstances.data() : nullptr;
+        jobs.parallelFor(count, 1024, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++)
+            {
+                glm::mat4 model = rotation;
+                model[3] = glm::vec4(rotation3 * instanceOffsets[visible != nullptr ? visible[i] : i], 1.0f);
+                instances[i].model = model;
+                instances[i].textureIndex = modelTextureIndex;
+            }
+        });
+
+        latencyStats.instanceUpdateSumNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - instancesStart).count();
+        latencyStats.instanceUpdateCount += count;
+    }
+
+    /// <summary>
+    /// Puts every instance's box in world space and culls them against the camera's frustum. Fills "visibleInstances"
+    /// and returns how many are visible. Every instance shares the rotation, so the boxes' extents are the same too.
+    /// </summary>
+    uint32_t cullInstances(const glm::mat4& viewProj, const glm::mat3& rotation)
+    {
+        PROFILE_SCOPE("cullInstances");
+        auto start = std::chrono::steady_clock::now();
+
+        // a rotated box fits in the box whose extent is the rotated extent with every term made positive
+        glm::vec3 center = (modelBox.min + modelBox.max) * 0.5f;
+        glm::vec3 extent = (modelBox.max - modelBox.min) * 0.5f;
+        glm::mat3 absRotation;
+        for (int column = 0; column < 3; column++)
+        {
+            absRotation[column] = glm::abs(rotation[column]);
+        }
+        glm::vec3 worldExtent = absRotation * extent;
+
+        uint32_t count = static_cast<uint32_t>(instanceOffsets.size());
+        jobs.parallelFor(count, 1024, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++)
+            {
+                instanceBounds.set(i, rotation * (center + instanceOffsets[i]), worldExtent);
+            }
+        });
+        uint32_t visibleCount = frustumCuller.cull(jobs, viewProj, instanceBounds, visibleInstances.data(), cullPath);
+
+        latencyStats.frustumCullSumNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        latencyStats.frustumTestedInstances += count;
+        latencyStats.frustumVisibleInstances += visibleCount;
+        return visibleCount;
+    }
+
+    /// <summary>
+    /// Moves the --stream-textures upload of the model texture along, called once per frame before recording. Once the startup
+    /// uploads are done it records the upload and puts the copies on the transfer queue, where they run alongside the frames.
+    /// When the copies are done the graphics half (ownership acquire, mipmaps) is submitted, and from that frame on the instances
+    /// sample the model texture instead of the placeholder. The frame waits for the upload on the GPU, never on the CPU.
+    /// </summary>
+    void streamModelTexture()
+    {
+        if (textureStream == TextureStreamState::Pending)
+        {
+            // the startup uploads go first
+            if (!gpuPointReached(graphicsTimeline, uploadContext.batchValue))
+                return;
+
+            PROFILE_SCOPE("streamModelTexture");
+
+            beginUploadBatch();
+            createTextureImage();
+            createTextureImageView();
+            streamedTextureIndex = registerTexture(textureImageView.get(), textureSampler.get());
+            streamUploads();
+            textureStream = TextureStreamState::Copying;
+        }
+
+        if (textureStream != TextureStreamState::Copying)
+            return;
+
+        if (!pollStreamedUploads())
+        {
+            textureStreamFrames++;
+            return;
+        }
+
+        modelTextureIndex = streamedTextureIndex;
+        textureStream = TextureStreamState::Done;
+        // the GPU-driven path records the texture index into the command buffer
+        commandCacheDirty = true;
+        // frames that sampled the placeholder have all been submitted, so it goes once they're done
+        placeholderTextureView.reset();
+        placeholderTexture.reset();
+        placeholderTextureMemory.reset();
+        std::cout << "Model texture streamed in, " << textureStreamFrames << " frame(s) rendered while it was copied" << std::endl;
+    }
+
+    /// <summary>
+    /// Draws a frame. With allocation tracking on, also counts the heap allocations it made once the warm-up is over.
+    /// </summary>
+    void drawFrame()
+    {
+#if ENABLE_ALLOCATION_TRACKING
+        if (!options.allocations.enabled || drawnFrames++ < options.allocations.warmupFrames)
+        {
+            renderFrame();
+            return;
+        }
+
+        AllocationTracker& tracker = AllocationTracker::get();
+        uint64_t recreationsBefore = swapChainRecreations;
+        tracker.beginFrame();
+        renderFrame();
+        uint64_t count = 0, bytes = 0;
+        tracker.endFrame(count, bytes);
+
+        trackedFrames++;
+        trackedFrameAllocations += count;
+        trackedFrameBytes += bytes;
+        maxFrameAllocations = (std::max)(maxFrameAllocations, count);
+        if (count == 0)
+            return;
+
+        framesWithAllocations++;
+        if (options.allocations.assertNoFrameAllocations && swapChainRecreations == recreationsBefore)
+        {
+            std::ostringstream message;
+            message << "drawFrame made " << count << " heap allocation(s), " << bytes << " bytes, in frame " << drawnFrames - 1 << ". Sites so far:\n";
+            tracker.printSites(message);
+            throw std::runtime_error(message.str());
+        }
+#else
+        renderFrame();
+#endif
+    }
+
+#if ENABLE_ALLOCATION_TRACKING
+    /// <summary>
+    /// Prints how many heap allocations the tracked frames made and where.
+    /// </summary>
+    void reportAllocations()
+    {
+        if (!options.allocations.enabled)
+            return;
+
+        AllocationTracker& tracker = AllocationTracker::get();
+        std::cout << "Allocations: " << tracker.totalAllocations() << " (" << tracker.totalAllocatedBytes() << " bytes) over the whole run. "
+            << trackedFrames << " frame(s) tracked after " << options.allocations.warmupFrames << " warm-up frame(s), "
+            << framesWithAllocations << " of them allocated, " << trackedFrameAllocations << " allocation(s) / " << trackedFrameBytes
+            << " bytes in total, at most " << maxFrameAllocations << " in one frame" << std::endl;
+        tracker.printSites(std::cout);
     }
+#endif
+
+    void renderFrame()
+    {
+        PROFILE_SCOPE("drawFrame");
+
+        // wait until the GPU is done with the last frame that used this slot
+        {
+            PROFILE_SCOPE("wait for frame slot");
+            waitForGpuPoint(graphicsTimeline, frameTimelineValues[currentFrame]);
+        }
+
+        auto cpuStart = std::chrono::steady_clock::now();
+
+        // free whatever the GPU has finished using by now, staging buffers of finished uploads for example
+        collectDeferredDeletions();
+        recordGpuLatencies();
+        readGpuTimestamps(currentFrame);
+        readPipelineStatistics(currentFrame);
+        readCullingStats(currentFrame);
+        readDrawCount(currentFrame);
+#if ENABLE_PROFILING
+        collectGpuScopes(currentFrame);
+#endif
+        resetDescriptorAllocator(frameDescriptors[currentFrame]);
+
+        uint32_t imageIndex = currentFrame;
+        VkResult result = VK_SUCCESS;
+        if (options.headless.enabled)
+        {
+            // the copy of the last frame rendered into this slot's target is done now too
+            writeReadback(currentFrame);
+        }
+        else
+        {
+            PROFILE_SCOPE("acquire");
+            result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+            if (result == VK_ERROR_OUT_OF_DATE_KHR)
+            {
+                recreateSwapChain();
+                return;
+            }
+            else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+            {
+                throw std::runtime_error("Failed to acquire swapchain image.");
+            }
+        }
+
+        streamModelTexture();
+
+        // the instance count and buffer have to be known before recording
+        resetUniformRing();
+        frameSampleTimes[currentFrame] = std::chrono::steady_clock::now();
+        updateUniformBuffer();
+
+        prepareRecordJob(imageIndex);
+        VkCommandBuffer frameCommandBuffer = getFrameCommandBuffer(imageIndex);
+
+        uint64_t frameValue = graphicsTimeline.lastSignaled + 1;
+
+        VkSubmitInfo submitInfos[2] = {};
+        submitInfos[0].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+        // first submit info waits for image available semaphore (not in headless mode, there's no swapchain)
+        // and for the last upload batch if nobody has waited on it yet
+        // the values for binary semaphores are ignored
+        std::array<VkSemaphore, 2> waitSemaphores{};
+        std::array<VkPipelineStageFlags, 2> waitStages{};
+        std::array<uint64_t, 2> waitValues{};
+        uint32_t waitCount = 0;
+        if (!options.headless.enabled)
+        {
+            waitSemaphores[waitCount] = imageAvailableSemaphores[currentFrame];
+            waitStages[waitCount] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            waitCount++;
+        }
+        if (uploadContext.frameWaitValue != 0)
+        {
+            waitSemaphores[waitCount] = graphicsTimeline.semaphore;
+            waitStages[waitCount] = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+            waitValues[waitCount] = uploadContext.frameWaitValue;
+            waitCount++;
+            uploadContext.frameWaitValue = 0;
+        }
+        submitInfos[0].waitSemaphoreCount = waitCount;
+        submitInfos[0].pWaitSemaphores = waitSemaphores.data();
+        submitInfos[0].pWaitDstStageMask = waitStages.data();
+        submitInfos[0].commandBufferCount = 1;
+        submitInfos[0].pCommandBuffers = &frameCommandBuffer;
+        // and then signals the frame's timeline value for us and draw finished for the presentation engine
+        VkSemaphore signalSemaphores[] = { graphicsTimeline.semaphore, renderFinishedSemaphores[currentFrame] };
+        uint64_t signalValues[] = { frameValue, 0 };
+        submitInfos[0].signalSemaphoreCount = options.headless.enabled ? 1 : 2;
+        submitInfos[0].pSignalSemaphores = signalSemaphores;
+
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.waitSemaphoreValueCount = submitInfos[0].waitSemaphoreCount;
+        timelineInfo.pWaitSemaphoreValues = waitValues.data();
+        timelineInfo.signalSemaphoreValueCount = submitInfos[0].signalSemaphoreCount;
+        timelineInfo.pSignalSemaphoreValues = signalValues;
+        submitInfos[0].pNext = &timelineInfo;
+
+        {
+            PROFILE_SCOPE("submit");
+            if (vkQueueSubmit(graphicsQueue, 1, submitInfos, VK_NULL_HANDLE) != VK_SUCCESS) {
+                throw std::runtime_error("failed to submit draw command buffer!");
+            }
+        }
+        graphicsTimeline.lastSignaled = frameValue;
+        frameTimelineValues[currentFrame] = frameValue;
+        frameLatencyPending[currentFrame] = true;
+        // noted at submit rather than while recording, cached command buffers copy the frame out too
+        if (!readbackBuffers.empty())
+        {
+            pendingReadbackFrames[currentFrame] = renderedFrameCount;
+        }
+        pipelineStatisticsPending[currentFrame] = pipelineStatisticsPool != VK_NULL_HANDLE;
+        cullingStatsPending[currentFrame] = options.occlusionCulling;
+        drawCountReadbackPending[currentFrame] = options.gpuDriven;
+        if (timestampQueryPool != VK_NULL_HANDLE)
+        {
+            timestampSamples[currentFrame] = benchmarkSampleIndex;
+        }
 
-    void endSingleTimeCommands(VkCommandBuffer commandBuffer) {
-        vkEndCommandBuffer(commandBuffer);
+        if (!options.headless.enabled)
+        {
+            VkPresentInfoKHR presentInfo{};
+            presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+            presentInfo.waitSemaphoreCount = 1;
+            presentInfo.pWaitSemaphores = &renderFinishedSemaphores[currentFrame];
+            VkSwapchainKHR swapChains[] = { swapChain };
+            presentInfo.swapchainCount = 1;
+            presentInfo.pSwapchains = swapChains;
+            presentInfo.pImageIndices = &imageIndex;
+            presentInfo.pResults = nullptr;
+
+            PROFILE_SCOPE("present");
+            result = vkQueuePresentKHR(presentationQueue, &presentInfo);
+        }
 
-        VkSubmitInfo submitInfo{};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffer;
+        // in headless mode this is sample->submit
+        double presentLatencyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameSampleTimes[currentFrame]).count();
+        latencyStats.frameCount++;
+        latencyStats.presentSumMs += presentLatencyMs;
+        latencyStats.presentMaxMs = (std::max)(latencyStats.presentMaxMs, presentLatencyMs);
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized)
+        {
+            framebufferResized = false;
+            recreateSwapChain();
+        }
+        else if (result != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to present swap chain image.");
+        }
 
-        vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-        vkQueueWaitIdle(graphicsQueue);
+        lastCpuFrameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cpuStart).count();
+        currentFrame = (currentFrame + 1) % options.pacing.framesInFlight;
+    }
 
-        vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+    /// <summary>
+    /// Adds a sample-to-GPU-done latency for every frame whose timeline value has been reached since the last call.
+    /// The completion time is when we notice, so samples can be late by up to a frame when we didn't have to wait.
+    /// </summary>
+    void recordGpuLatencies()
+    {
+        auto now = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            if (!frameLatencyPending[i] || !gpuPointReached(graphicsTimeline, frameTimelineValues[i]))
+                continue;
+
+            frameLatencyPending[i] = false;
+            double gpuLatencyMs = std::chrono::duration<double, std::milli>(now - frameSampleTimes[i]).count();
+            latencyStats.gpuFrameCount++;
+            latencyStats.gpuSumMs += gpuLatencyMs;
+            latencyStats.gpuMaxMs = (std::max)(latencyStats.gpuMaxMs, gpuLatencyMs);
+        }
     }
 
-    void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels) {
-        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    /// <summary>
+    /// Prints the average and worst latencies since the last report.
+    /// </summary>
+    void reportLatency()
+    {
+        uint64_t frames = latencyStats.frameCount - reportedLatencyStats.frameCount;
+        uint64_t gpuFrames = latencyStats.gpuFrameCount - reportedLatencyStats.gpuFrameCount;
+        if (frames == 0)
+            return;
 
-        VkImageMemoryBarrier barrier{};
-        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        barrier.oldLayout = oldLayout;
-        barrier.newLayout = newLayout;
-        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.image = image;
-        if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+        double gpuAverageMs = gpuFrames > 0 ? (latencyStats.gpuSumMs - reportedLatencyStats.gpuSumMs) / gpuFrames : 0.0;
+        std::cout << "Latency over " << frames << " frames: sample->present avg "
+            << (latencyStats.presentSumMs - reportedLatencyStats.presentSumMs) / frames << " ms, max " << latencyStats.presentMaxMs
+            << " ms | sample->GPU done avg " << gpuAverageMs << " ms, max " << latencyStats.gpuMaxMs << " ms" << std::endl;
 
-            if (hasStencilComponent(format)) {
-                barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-            }
-        }
-        else {
-            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        uint64_t instances = latencyStats.instanceUpdateCount - reportedLatencyStats.instanceUpdateCount;
+        if (instances > 0)
+        {
+            std::cout << "Instance transforms: " << instances / frames << " per frame, "
+                << (latencyStats.instanceUpdateSumNs - reportedLatencyStats.instanceUpdateSumNs) / instances << " ns per instance" << std::endl;
         }
-        barrier.subresourceRange.baseMipLevel = 0;
-        barrier.subresourceRange.levelCount = mipLevels;
-        barrier.subresourceRange.baseArrayLayer = 0;
-        barrier.subresourceRange.layerCount = 1;
-
-        VkPipelineStageFlags sourceStage;
-        VkPipelineStageFlags destinationStage;
 
-        if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-            barrier.srcAccessMask = 0;
-            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        uint64_t records = latencyStats.commandRecordCount - reportedLatencyStats.commandRecordCount;
+        uint64_t cacheHits = latencyStats.commandCacheHits - reportedLatencyStats.commandCacheHits;
+        std::cout << "Command buffers: " << records << " recorded";
+        if (records > 0)
+            std::cout << " (avg " << (latencyStats.commandRecordSumNs - reportedLatencyStats.commandRecordSumNs) / records / 1000.0 << " us)";
+        std::cout << ", " << cacheHits << " reused from the cache" << std::endl;
 
-            sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-            destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        // overdraw is invocations per pixel, a depth pre-pass brings it down towards one per sample
+        uint64_t statisticsFrames = latencyStats.statisticsFrameCount - reportedLatencyStats.statisticsFrameCount;
+        if (statisticsFrames > 0)
+        {
+            uint64_t invocations = (latencyStats.fragmentInvocations - reportedLatencyStats.fragmentInvocations) / statisticsFrames;
+            std::cout << "Fragment shader invocations: " << invocations << " per frame, "
+                << static_cast<double>(invocations) / (static_cast<uint64_t>(swapChainExtent.width) * swapChainExtent.height) << " per pixel"
+                << (options.depthPrepass ? " (after the depth pre-pass)" : "") << std::endl;
         }
-        else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
-            sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-            destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        uint64_t frustumTested = latencyStats.frustumTestedInstances - reportedLatencyStats.frustumTestedInstances;
+        if (frustumTested > 0)
+        {
+            std::cout << "Frustum culling: " << (latencyStats.frustumVisibleInstances - reportedLatencyStats.frustumVisibleInstances) / frames
+                << " of " << frustumTested / frames << " instances visible per frame, "
+                << (latencyStats.frustumCullSumNs - reportedLatencyStats.frustumCullSumNs) / frames / 1000.0 << " us per frame" << std::endl;
         }
-        else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-            barrier.srcAccessMask = 0;
-            barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
-            sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-            destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-        }
-        else {
-            throw std::invalid_argument("unsupported layout transition!");
+        uint64_t cullingFrames = latencyStats.cullingFrameCount - reportedLatencyStats.cullingFrameCount;
+        if (cullingFrames > 0)
+        {
+            uint64_t early = (latencyStats.earlyDrawnInstances - reportedLatencyStats.earlyDrawnInstances) / cullingFrames;
+            uint64_t late = (latencyStats.lateDrawnInstances - reportedLatencyStats.lateDrawnInstances) / cullingFrames;
+            std::cout << "Occlusion culling: " << early + late << " of "
+                << (latencyStats.culledTestedInstances - reportedLatencyStats.culledTestedInstances) / cullingFrames
+                << " instances drawn per frame (" << early << " early, " << late << " late)" << std::endl;
         }
 
-        vkCmdPipelineBarrier(
-            commandBuffer,
-            sourceStage, destinationStage,
-            0,
-            0, nullptr,
-            0, nullptr,
-            1, &barrier
-        );
+        uint64_t generatedFrames = latencyStats.generatedDrawFrameCount - reportedLatencyStats.generatedDrawFrameCount;
+        if (generatedFrames > 0)
+        {
+            std::cout << "GPU-driven: " << (latencyStats.generatedDraws - reportedLatencyStats.generatedDraws) / generatedFrames << " of "
+                << instanceOffsets.size() << " instances drawn per frame" << std::endl;
+        }
 
-        endSingleTimeCommands(commandBuffer);
+        reportedLatencyStats = latencyStats;
+        // maxima are per report
+        latencyStats.presentMaxMs = 0.0;
+        latencyStats.gpuMaxMs = 0.0;
     }
 
-    void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-        VkBufferImageCopy region{};
-        region.bufferOffset = 0;
-        region.bufferRowLength = 0;
-        region.bufferImageHeight = 0;
+    /// <summary>
+    /// Sleeps until "nextFrameTime" if a frame rate limit is set, then moves it one frame period ahead.
+    /// </summary>
+    void limitFrameRate(std::chrono::steady_clock::time_point& nextFrameTime)
+    {
+        if (options.pacing.frameRateLimit <= 0.0)
+            return;
 
-        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        region.imageSubresource.mipLevel = 0;
-        region.imageSubresource.baseArrayLayer = 0;
-        region.imageSubresource.layerCount = 1;
+        auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / options.pacing.frameRateLimit));
+        auto now = std::chrono::steady_clock::now();
 
-        region.imageOffset = { 0, 0, 0 };
-        region.imageExtent =
+        // sleep is only accurate to about a millisecond, so sleep most of the way and spin the rest
+        if (nextFrameTime - now > std::chrono::milliseconds(2))
         {
-            width,
-            height,
-            1
-        };
-
-        vkCmdCopyBufferToImage(
-            commandBuffer,
-            buffer,
-            image,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            1,
-            &region
-        );
+            std::this_thread::sleep_until(nextFrameTime - std::chrono::milliseconds(1));
+        }
+        while (std::chrono::steady_clock::now() < nextFrameTime)
+        {
+            std::this_thread::yield();
+        }
 
-        endSingleTimeCommands(commandBuffer);
+        // if we fell more than a frame behind don't try to catch up with a burst of frames
+        nextFrameTime = (std::max)(nextFrameTime + period, std::chrono::steady_clock::now());
     }
 
-    void createTextureImageView()
+    void cleanupSwapChain()
     {
-        textureImageView = createImageView(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
-    }
-
-    VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlagBits aspectFlags, uint32_t mipLevels) {
-        VkImageViewCreateInfo viewInfo{};
-        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-        viewInfo.image = image;
-        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        viewInfo.format = format;
-        viewInfo.subresourceRange.aspectMask = aspectFlags;
-        viewInfo.subresourceRange.baseMipLevel = 0;
-        viewInfo.subresourceRange.levelCount = mipLevels;
-        viewInfo.subresourceRange.baseArrayLayer = 0;
-        viewInfo.subresourceRange.layerCount = 1;
+        for (size_t i = 0; i < swapChainImageViews.size(); i++) {
+            vkDestroyImageView(device, swapChainImageViews[i], allocator);
+        }
 
-        VkImageView imageView;
-        if (vkCreateImageView(device, &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create texture image view!");
+        if (options.headless.enabled)
+        {
+            for (size_t i = 0; i < swapChainImages.size(); i++) {
+                vkDestroyImage(device, swapChainImages[i], allocator);
+                vkFreeMemory(device, offscreenImagesMemory[i], allocator);
+            }
+            return;
         }
 
-        return imageView;
+        vkDestroySwapchainKHR(device, swapChain, allocator);
     }
 
-    void createTextureSampler()
+    /// <summary>
+    /// Hands the swapchain's image views, and the swapchain itself, to the deletion queue. They go once every frame
+    /// submitted so far is done on the GPU, which is also when the presents of those frames have been queued.
+    /// "swapChain" stays set so the next swapchain can be created from it.
+    /// </summary>
+    void retireSwapChain()
     {
-        VkSamplerCreateInfo samplerInfo{};
-        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-        samplerInfo.magFilter = VK_FILTER_LINEAR;
-        samplerInfo.minFilter = VK_FILTER_LINEAR;
-        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-        samplerInfo.anisotropyEnable = VK_TRUE;
-        VkPhysicalDeviceProperties properties{};
-        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
-        samplerInfo.maxAnisotropy = properties.limits.maxSamplerAnisotropy;
-        samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
-        samplerInfo.unnormalizedCoordinates = VK_FALSE;
-        samplerInfo.compareEnable = VK_FALSE;
-        samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
-        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-        samplerInfo.maxLod = static_cast<float>(mipLevels);
-        samplerInfo.minLod = 0.0f; // Optional
-        samplerInfo.mipLodBias = 0.0f; // Optional
+        uint64_t retireValue = graphicsTimeline.lastSignaled;
+        deferDestruction(retireValue, [this, imageViews = swapChainImageViews, oldSwapChain = swapChain]() {
+            for (VkImageView imageView : imageViews) {
+                vkDestroyImageView(device, imageView, allocator);
+            }
+            vkDestroySwapchainKHR(device, oldSwapChain, allocator);
+        });
 
-        if (vkCreateSampler(device, &samplerInfo, nullptr, &textureSampler) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create texture sampler!");
-        }
+        swapChainImageViews.clear();
     }
 
-    VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) {
-        for (VkFormat format : candidates) {
-            VkFormatProperties props;
-            vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
+    void recreateSwapChain()
+    {
+        PROFILE_SCOPE("recreateSwapChain");
+        swapChainRecreations++;
 
-            if (tiling == VK_IMAGE_TILING_LINEAR && (props.linearTilingFeatures & features) == features) {
-                return format;
-            }
-            else if (tiling == VK_IMAGE_TILING_OPTIMAL && (props.optimalTilingFeatures & features) == features) {
-                return format;
-            }
+        // if the buffer size is 0,0 (minimized) wait for it to not be.
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(window, &width, &height);
+        waitingForWindow = true;
+        while (width == 0 || height == 0)
+        {
+            glfwGetFramebufferSize(window, &width, &height);
+            glfwWaitEvents();
         }
+        waitingForWindow = false;
 
-        throw std::runtime_error("failed to find supported format!");
-    }
+        // no waiting for the device, frames in flight keep using the old resources until they're done with them
+        retireSwapChain();
 
-    bool hasStencilComponent(VkFormat format) {
-        return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
+        createSwapChain();
+        createImageViews();
+        // the old transient images are retired the same way
+        renderGraph.compile(swapChainExtent);
+        createHiZ();
+        createCommandCache();
     }
 
-    VkFormat findDepthFormat()
+    /// <summary>
+    /// Renders the configured number of frames as fast as the GPU allows and reports the throughput.
+    /// </summary>
+    void headlessLoop()
     {
-        return findSupportedFormat(
-            { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
-            VK_IMAGE_TILING_OPTIMAL,
-            VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
-        );
+        auto start = std::chrono::steady_clock::now();
+        lastLatencyReport = start;
+
+        for (uint32_t i = 0; i < options.headless.frameCount; i++)
+        {
+            drawFrame();
+            renderedFrameCount++;
+        }
+
+        vkDeviceWaitIdle(device);
+        for (uint32_t slot = 0; slot < MAX_FRAMES_IN_FLIGHT; slot++)
+        {
+            writeReadback(slot);
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Rendered " << options.headless.frameCount << " frames at " << swapChainExtent.width << "x" << swapChainExtent.height
+            << " in " << seconds << " s (" << options.headless.frameCount / seconds << " fps)" << std::endl;
+
+        recordGpuLatencies();
+        reportLatency();
     }
 
-    void createDepthResources()
+    /// <summary>
+    /// Renders the warm-up frames and then the measured frames with a fixed simulation timestep, in a window or headless,
+    /// and writes the frame time statistics out.
+    /// </summary>
+    void benchmarkLoop()
     {
-        VkFormat depthFormat = findDepthFormat();
+        const BenchmarkConfig& config = options.benchmark;
+        benchmarkSamples.reserve(config.frameCount);
 
-        createImage(swapChainExtent.width, swapChainExtent.height, 1, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
-        depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+        auto lastFrameStart = std::chrono::steady_clock::now();
+        lastLatencyReport = lastFrameStart;
 
-        transitionImageLayout(depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
-    }
+        for (uint32_t i = 0; i < config.warmupFrames + config.frameCount; i++)
+        {
+            if (!options.headless.enabled)
+            {
+                glfwPollEvents();
+                if (glfwWindowShouldClose(window))
+                    break;
+            }
 
-    void loadModel() {
-        tinyobj::attrib_t attrib;
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> materials;
-        std::string warn, err;
+            auto frameStart = std::chrono::steady_clock::now();
+            bool measured = i >= config.warmupFrames;
+            benchmarkSampleIndex = measured ? static_cast<int64_t>(benchmarkSamples.size()) : -1;
 
-        if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str())) {
-            throw std::runtime_error(warn + err);
+            drawFrame();
+            renderedFrameCount++;
+            simulationTime += config.timestep;
+
+            if (measured)
+            {
+                BenchmarkSample sample{};
+                sample.frameMs = std::chrono::duration<double, std::milli>(frameStart - lastFrameStart).count();
+                sample.cpuMs = lastCpuFrameMs;
+                benchmarkSamples.push_back(sample);
+            }
+            lastFrameStart = frameStart;
         }
 
-        std::unordered_map<Vertex, uint32_t> uniqueVertices;
+        vkDeviceWaitIdle(device);
+        for (uint32_t slot = 0; slot < MAX_FRAMES_IN_FLIGHT; slot++)
+        {
+            readGpuTimestamps(slot);
+            readPipelineStatistics(slot);
+            readCullingStats(slot);
+            readDrawCount(slot);
+            writeReadback(slot);
+        }
 
-        for (const auto& shape : shapes) {
-            for (const auto& index : shape.mesh.indices) {
-                Vertex vertex{};
+        writeBenchmarkResults();
+    }
 
-                vertex.pos = {
-                    attrib.vertices[3 * index.vertex_index + 0],
-                    attrib.vertices[3 * index.vertex_index + 1],
-                    attrib.vertices[3 * index.vertex_index + 2]
-                };
+    /// <summary>
+    /// Mean, percentiles and maximum of the given frame times.
+    /// </summary>
+    static FrameTimeSummary summarizeFrameTimes(std::vector<double> times)
+    {
+        FrameTimeSummary summary{};
+        if (times.empty())
+            return summary;
+
+        std::sort(times.begin(), times.end());
+        auto percentile = [&times](double p) {
+            size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * times.size()));
+            return times[(std::max)(rank, static_cast<size_t>(1)) - 1];
+        };
 
-                vertex.texCoords = {
-                    attrib.texcoords[2 * index.texcoord_index + 0],
-                    1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-                };
+        summary.count = times.size();
+        for (double time : times)
+            summary.mean += time;
+        summary.mean /= times.size();
+        summary.p50 = percentile(50.0);
+        summary.p95 = percentile(95.0);
+        summary.p99 = percentile(99.0);
+        summary.max = times.back();
+        return summary;
+    }
 
-                vertex.color = { 1.0f, 1.0f, 1.0f };
+    /// <summary>
+    /// Records the current frame's command buffer over and over and prints draws per millisecond for every pair of
+    /// job thread count and slice count, both going up in powers of two to the most there are. Nothing is submitted,
+    /// so only CPU recording time is measured.
+    /// </summary>
+    void recordBenchmark()
+    {
+        vkDeviceWaitIdle(device);
 
-                if (uniqueVertices.count(vertex) == 0) {
-                    uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-                    vertices.push_back(vertex);
-                }
+        uint32_t maxThreads = jobs.threadCount();
+        for (uint32_t threads = 1; ; threads = (std::min)(threads * 2, maxThreads))
+        {
+            // the job system is started over with just this many threads
+            jobs.stop();
+            jobs.start(threads, options.pinJobThreads);
 
-                indices.push_back(uniqueVertices[vertex]);
+            for (uint32_t slices = 1; ; slices = (std::min)(slices * 2, static_cast<uint32_t>(recordSlices.size())))
+            {
+                recordBenchmarkRun(threads, slices);
+                if (slices == recordSlices.size())
+                    break;
             }
+
+            if (threads == maxThreads)
+                break;
         }
-    }
 
-    /// <summary>
-    /// Initializes all of the vulkan resources required to work with the API.
-    /// </summary>
-    void initVulkan() {
-        createInstance();
-        setupDebugMessenger();
-        createSurface();
-        pickPhysicalDevice();
-        createLogicalDevice();
-        createSwapChain();
-        createImageViews();
-        createRenderPass();
-        createDescriptorSetLayout();
-        createGraphicsPipeline();
-        createCommandPool();
-        createDepthResources();
-        createFramebuffers();
-        createTextureImage();
-        createTextureImageView();
-        createTextureSampler();
-        loadModel();
-        createVertexBuffer();
-        createIndexBuffer();
-        createUniformBuffers();
-        createDescriptorPool();
-        createDescriptorSets();
-        createCommandBuffers();
-        createSyncObjects();
+#if ENABLE_PROFILING
+        // the queries were never submitted, there's nothing to collect
+        gpuScopes[currentFrame].clear();
+        gpuQueriesUsed[currentFrame] = 0;
+#endif
+        jobs.stop();
+        jobs.start(maxThreads, options.pinJobThreads);
+        activeRecordSlices = (std::min)(options.recordThreads, static_cast<uint32_t>(recordSlices.size()));
     }
 
     /// <summary>
-    /// If necessary, sets up debug messenger so you can see validation messages.
+    /// Times recording the frame split into "slices" secondary buffers on "threads" job threads and prints the result.
     /// </summary>
-    void setupDebugMessenger()
+    void recordBenchmarkRun(uint32_t threads, uint32_t slices)
     {
-        if (!enableValidationLayers) return;
+        const uint32_t ITERATIONS = 200;
 
-        VkDebugUtilsMessengerCreateInfoEXT createInfo{};
-        populateDebugMessengerCreateInfo(createInfo);
+        activeRecordSlices = slices;
 
-        if (CreateDebugUtilsMessengerEXT(instance, &createInfo, nullptr, &debugMessenger) != VK_SUCCESS)
+        double recordNs = 0.0;
+        uint64_t draws = 0;
+        for (uint32_t i = 0; i < ITERATIONS; i++)
         {
-            throw std::runtime_error("failed to set up debug messenger.");
+            resetUniformRing();
+            updateUniformBuffer();
+            prepareRecordJob(0);
+            vkResetCommandBuffer(commandBuffers[currentFrame], 0);
+
+            auto start = std::chrono::steady_clock::now();
+            recordCommandBuffer(commandBuffers[currentFrame], 0);
+            recordNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            draws += recordJob.drawCount;
         }
+
+        std::cout << threads << " job thread(s), " << slices << " record slice(s): " << draws / (recordNs / 1e6) << " draws/ms, "
+            << recordNs / ITERATIONS / 1000.0 << " us per frame (" << recordJob.drawCount << " draws)" << std::endl;
     }
 
-    void updateUniformBuffer(uint32_t currentImage)
+    /// <summary>
+    /// Runs the same transform update over a million instances on its own job system with 1 to N threads
+    /// and prints the time and the speedup over one thread for each.
+    /// </summary>
+    void jobBenchmark()
     {
-        // first UBO
+        const uint32_t INSTANCES = 1 << 20;
+        const uint32_t ITERATIONS = 20;
+
+        std::vector<glm::vec3> offsets(INSTANCES);
+        for (uint32_t i = 0; i < INSTANCES; i++)
+        {
+            offsets[i] = glm::vec3(static_cast<float>(i % 1024), static_cast<float>(i / 1024), 0.0f);
+        }
+        std::vector<glm::mat4> models(INSTANCES);
 
-        static auto startTime = std::chrono::high_resolution_clock::now();
-        auto currentTime = std::chrono::high_resolution_clock::now();
-        float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+        uint32_t maxThreads = (std::max)(std::thread::hardware_concurrency(), 1u);
+        double singleThreadMs = 0.0;
+        for (uint32_t threads = 1; threads <= maxThreads; threads++)
+        {
+            JobSystem benchmarkJobs;
+            benchmarkJobs.start(threads, options.pinJobThreads);
+
+            auto start = std::chrono::steady_clock::now();
+            for (uint32_t iteration = 0; iteration < ITERATIONS; iteration++)
+            {
+                glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), glm::radians(static_cast<float>(iteration)), glm::vec3(0.0f, 0.0f, 1.0f));
+                glm::mat3 rotation3(rotation);
+                benchmarkJobs.parallelFor(INSTANCES, 1024, [&](uint32_t begin, uint32_t end) {
+                    for (uint32_t i = begin; i < end; i++)
+                    {
+                        models[i] = rotation;
+                        models[i][3] = glm::vec4(rotation3 * offsets[i], 1.0f);
+                    }
+                });
+            }
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / ITERATIONS;
+            if (threads == 1)
+                singleThreadMs = ms;
 
-        UniformBufferObject ubo{};
-        ubo.model = glm::mat4(1.0f);
-        ubo.model = glm::rotate(ubo.model, glm::radians(20.0f) * time, glm::vec3(0.0f, 0.0f, 1.0f));
-        ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-        ubo.proj = glm::perspective(glm::radians(45.0f), swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 10.0f);
-        ubo.proj[1][1] *= -1; // this is to flip the clip space y component
+            std::cout << threads << " job thread(s): " << ms << " ms per update, " << singleThreadMs / ms << "x" << std::endl;
+        }
+    }
 
-        memcpy(firstUniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+    /// <summary>
+    /// Culls 10k, 100k and 1M boxes scattered around the camera with every code path the CPU has, on one job thread
+    /// and on all of them, and prints the time per cull.
+    /// </summary>
+    void cullBenchmark()
+    {
+        const std::array<uint32_t, 3> objectCounts = { 10000, 100000, 1000000 };
+        const uint32_t ITERATIONS = 20;
+
+        std::vector<FrustumCuller::Path> paths = { FrustumCuller::Path::Scalar };
+#if FRUSTUM_CULLING_SIMD
+        paths.push_back(FrustumCuller::Path::Sse);
+        if (FrustumCuller::bestPath() == FrustumCuller::Path::Avx2)
+            paths.push_back(FrustumCuller::Path::Avx2);
+#endif
 
-        // second UBO
+        // looking down +x from the middle of the boxes, about one in twenty is in view
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+        glm::mat4 proj = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 500.0f);
+        glm::mat4 viewProj = proj * view;
 
-        UniformBufferObject ubo2 = {};
-        ubo2.model = glm::mat4(1.0);
-        ubo2.model = glm::translate(ubo.model, glm::vec3(1.0, 1.0, 0.0));
-        ubo2.view = ubo.view;
-        ubo2.proj = glm::perspective(glm::radians(45.0f), swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 10.0f);
-        ubo2.proj[1][1] *= -1; // this is to flip the clip space y component
+        JobSystem singleThread;
+        singleThread.start(1, options.pinJobThreads);
 
-        memcpy(secondUniformBuffersMapped[currentImage], &ubo2, sizeof(ubo2));
+        for (uint32_t objectCount : objectCounts)
+        {
+            BoundsSoA bounds;
+            bounds.resize(objectCount);
+            uint32_t seed = 1;
+            auto random = [&seed]() {
+                seed = seed * 1664525u + 1013904223u;
+                return static_cast<float>(seed >> 8) / static_cast<float>(1u << 24);
+            };
+            for (uint32_t i = 0; i < objectCount; i++)
+            {
+                glm::vec3 center(random() * 1000.0f - 500.0f, random() * 1000.0f - 500.0f, random() * 1000.0f - 500.0f);
+                bounds.set(i, center, glm::vec3(0.5f + random() * 2.0f));
+            }
 
+            std::vector<uint32_t> visible(objectCount);
+            FrustumCuller culler;
+            for (FrustumCuller::Path path : paths)
+            {
+                for (JobSystem* system : { &singleThread, &jobs })
+                {
+                    uint32_t visibleCount = culler.cull(*system, viewProj, bounds, visible.data(), path);
+                    auto start = std::chrono::steady_clock::now();
+                    for (uint32_t iteration = 0; iteration < ITERATIONS; iteration++)
+                    {
+                        visibleCount = culler.cull(*system, viewProj, bounds, visible.data(), path);
+                    }
+                    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / ITERATIONS;
+
+                    std::cout << objectCount << " boxes, " << FrustumCuller::pathName(path) << ", " << system->threadCount() << " thread(s): "
+                        << ms << " ms per cull, " << visibleCount << " visible" << std::endl;
+                }
+            }
+        }
     }
 
-    void drawFrame()
+    /// <summary>
+    /// Prints the benchmark statistics and writes them to the output file, as a full JSON report or as one CSV row
+    /// per run so runs of different builds can be collected in one file.
+    /// </summary>
+    void writeBenchmarkResults()
     {
-        vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
-
-        uint32_t imageIndex;
-        VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
-        if (result == VK_ERROR_OUT_OF_DATE_KHR)
+        std::vector<double> frameTimes, cpuTimes, gpuTimes;
+        for (const BenchmarkSample& sample : benchmarkSamples)
         {
-            recreateSwapChain();
-            return;
+            frameTimes.push_back(sample.frameMs);
+            cpuTimes.push_back(sample.cpuMs);
+            if (sample.gpuMs >= 0.0)
+                gpuTimes.push_back(sample.gpuMs);
         }
-        else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+
+        const BenchmarkConfig& config = options.benchmark;
+        std::array<std::pair<const char*, FrameTimeSummary>, 3> summaries = { {
+            { "frame", summarizeFrameTimes(frameTimes) },
+            { "cpu", summarizeFrameTimes(cpuTimes) },
+            { "gpu", summarizeFrameTimes(gpuTimes) },
+        } };
+
+        std::cout << "Benchmark \"" << config.label << "\": " << benchmarkSamples.size() << " frames after " << config.warmupFrames << " warm-up frames" << std::endl;
+        for (const auto& [name, summary] : summaries)
         {
-            throw std::runtime_error("Failed to acquire swapchain image.");
+            std::cout << "  " << name << " ms: mean " << summary.mean << ", p50 " << summary.p50 << ", p95 " << summary.p95
+                << ", p99 " << summary.p99 << ", max " << summary.max << std::endl;
         }
 
-        // Only reset fence if we've acquired a swapchain image. otherwise it would never signal.
-        vkResetFences(device, 1, &inFlightFences[currentFrame]);
+        if (config.outputPath.empty())
+            return;
 
-        vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-        recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
 
-        updateUniformBuffer(currentFrame);
+        if (std::filesystem::path(config.outputPath).extension() == ".json")
+        {
+            std::ofstream file(config.outputPath);
+            if (!file.is_open())
+            {
+                throw std::runtime_error("Error writing benchmark results: " + config.outputPath);
+            }
 
-        VkSubmitInfo submitInfos[2] = {};
-        submitInfos[0].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            file << "{\n";
+            file << "  \"label\": \"" << config.label << "\",\n";
+            file << "  \"device\": \"" << properties.deviceName << "\",\n";
+            file << "  \"width\": " << swapChainExtent.width << ",\n";
+            file << "  \"height\": " << swapChainExtent.height << ",\n";
+            file << "  \"warmupFrames\": " << config.warmupFrames << ",\n";
+            file << "  \"frames\": " << benchmarkSamples.size() << ",\n";
+            file << "  \"timestep\": " << config.timestep << ",\n";
+            for (const auto& [name, summary] : summaries)
+            {
+                file << "  \"" << name << "Ms\": { \"count\": " << summary.count << ", \"mean\": " << summary.mean << ", \"p50\": " << summary.p50
+                    << ", \"p95\": " << summary.p95 << ", \"p99\": " << summary.p99 << ", \"max\": " << summary.max << " },\n";
+            }
+            file << "  \"samples\": [\n";
+            for (size_t i = 0; i < benchmarkSamples.size(); i++)
+            {
+                const BenchmarkSample& sample = benchmarkSamples[i];
+                file << "    { \"frameMs\": " << sample.frameMs << ", \"cpuMs\": " << sample.cpuMs << ", \"gpuMs\": " << sample.gpuMs << " }"
+                    << (i + 1 < benchmarkSamples.size() ? "," : "") << "\n";
+            }
+            file << "  ]\n";
+            file << "}\n";
+            return;
+        }
 
-        // first submit info waits for image available semaphore
-        VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
-        VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-        submitInfos[0].waitSemaphoreCount = 1;
-        submitInfos[0].pWaitSemaphores = waitSemaphores;
-        submitInfos[0].pWaitDstStageMask = waitStages;
-        submitInfos[0].commandBufferCount = 1;
-        submitInfos[0].pCommandBuffers = &commandBuffers[currentFrame];
-        submitInfos[0].signalSemaphoreCount = 1;
-        // and then signals draw finished when done
-        submitInfos[0].pSignalSemaphores = &renderFinishedSemaphores[currentFrame];
-
-        if (vkQueueSubmit(graphicsQueue, 1, submitInfos, inFlightFences[currentFrame]) != VK_SUCCESS) {
-            throw std::runtime_error("failed to submit draw command buffer!");
-        }
-
-        VkPresentInfoKHR presentInfo{};
-        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-        presentInfo.waitSemaphoreCount = 1;
-        presentInfo.pWaitSemaphores = &renderFinishedSemaphores[currentFrame];
-        VkSwapchainKHR swapChains[] = { swapChain };
-        presentInfo.swapchainCount = 1;
-        presentInfo.pSwapchains = swapChains;
-        presentInfo.pImageIndices = &imageIndex;
-        presentInfo.pResults = nullptr;
-
-        result = vkQueuePresentKHR(presentationQueue, &presentInfo);
-        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized)
+        bool writeHeader = !std::filesystem::exists(config.outputPath) || std::filesystem::file_size(config.outputPath) == 0;
+        std::ofstream file(config.outputPath, std::ios::app);
+        if (!file.is_open())
         {
-            framebufferResized = false;
-            recreateSwapChain();
+            throw std::runtime_error("Error writing benchmark results: " + config.outputPath);
         }
-        else if (result != VK_SUCCESS)
+
+        if (writeHeader)
         {
-            throw std::runtime_error("Failed to present swap chain image.");
+            file << "label,device,width,height,warmup_frames,frames,timestep";
+            for (const auto& [name, summary] : summaries)
+            {
+                file << "," << name << "_mean_ms," << name << "_p50_ms," << name << "_p95_ms," << name << "_p99_ms," << name << "_max_ms";
+            }
+            file << "\n";
         }
 
-        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        file << config.label << ",\"" << properties.deviceName << "\"," << swapChainExtent.width << "," << swapChainExtent.height << ","
+            << config.warmupFrames << "," << benchmarkSamples.size() << "," << config.timestep;
+        for (const auto& [name, summary] : summaries)
+        {
+            file << "," << summary.mean << "," << summary.p50 << "," << summary.p95 << "," << summary.p99 << "," << summary.max;
+        }
+        file << "\n";
     }
 
-    void cleanupSwapChain()
-    {
-        for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
-            vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
+    void mainLoop() {
+        if (options.descriptorBenchmark)
+        {
+            descriptorUpdateBenchmark();
+            return;
         }
 
-        for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-            vkDestroyImageView(device, swapChainImageViews[i], nullptr);
+        if (options.recordBenchmark)
+        {
+            recordBenchmark();
+            return;
         }
 
-        vkDestroySwapchainKHR(device, swapChain, nullptr);
-    }
+        if (options.jobBenchmark)
+        {
+            jobBenchmark();
+            return;
+        }
 
-    void recreateSwapChain()
-    {
-        // if the buffer size is 0,0 (minimized) wait for it to not be.
-        int width = 0, height = 0;
-        glfwGetFramebufferSize(window, &width, &height);
-        while (width == 0 || height == 0)
+        if (options.cullBenchmark)
         {
-            glfwGetFramebufferSize(window, &width, &height);
-            glfwWaitEvents();
+            cullBenchmark();
+            return;
         }
 
-        vkDeviceWaitIdle(device);
+        if (options.benchmark.enabled)
+        {
+            benchmarkLoop();
+            return;
+        }
 
-        cleanupSwapChain();
+        if (options.headless.enabled)
+        {
+            headlessLoop();
+            return;
+        }
 
-        createSwapChain();
-        createImageViews();
-        createDepthResources();
-        createFramebuffers();
-    }
+        auto nextFrameTime = std::chrono::steady_clock::now();
+        lastLatencyReport = nextFrameTime;
 
-    void mainLoop() {
         while (!glfwWindowShouldClose(window))
         {
+            limitFrameRate(nextFrameTime);
             glfwPollEvents();
             drawFrame();
+
+            if (std::chrono::steady_clock::now() - lastLatencyReport > std::chrono::seconds(5))
+            {
+                reportLatency();
+                lastLatencyReport = std::chrono::steady_clock::now();
+            }
         }
 
         vkDeviceWaitIdle(device);
+        recordGpuLatencies();
+        reportLatency();
     }
 
     void cleanup() {
+        jobs.stop();
+
+#if ENABLE_PROFILING
+        // every loop waits for the device before returning, so the last frames' GPU scopes are ready too
+        for (uint32_t slot = 0; slot < MAX_FRAMES_IN_FLIGHT; slot++)
+        {
+            collectGpuScopes(slot);
+        }
+        if (!options.tracePath.empty())
+        {
+            TraceRecorder::get().write(options.tracePath);
+        }
+#endif
+#if ENABLE_ALLOCATION_TRACKING
+        reportAllocations();
+#endif
 
         cleanupSwapChain();
 
-        vkDestroyImage(device, textureImage, nullptr);
-        vkDestroyImageView(device, textureImageView, nullptr);
-        vkDestroySampler(device, textureSampler, nullptr);
-        vkFreeMemory(device, textureImageMemory, nullptr);
-        vkDestroyImageView(device, depthImageView, nullptr);
-        vkDestroyImage(device, depthImage, nullptr);
-        vkFreeMemory(device, depthImageMemory, nullptr);
+        textureImage.reset();
+        textureImageView.reset();
+        textureSampler.reset();
+        textureImageMemory.reset();
+        placeholderTexture.reset();
+        placeholderTextureView.reset();
+        placeholderTextureMemory.reset();
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            vkDestroyBuffer(device, firstUniformBuffers[i], nullptr);
-            vkDestroyBuffer(device, secondUniformBuffers[i], nullptr);
+        // a streamed batch whose graphics half never got submitted still owns its staging buffers
+        for (auto& staging : uploadContext.stagingBuffers)
+        {
+            vkDestroyBuffer(device, staging.first, allocator);
+            vkFreeMemory(device, staging.second, allocator);
+        }
 
-            vkFreeMemory(device, firstUniformBuffersMemory[i], nullptr);
-            vkFreeMemory(device, secondUniformBuffersMemory[i], nullptr);
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            instanceBuffers[i].reset();
+            instanceBuffersMemory[i].reset();
         }
 
-        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+        vkDestroyBuffer(device, uniformRing.buffer, allocator);
+        vkFreeMemory(device, uniformRing.memory, allocator);
 
-        vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+        destroyDescriptorAllocator(persistentDescriptors);
+        destroyDescriptorAllocator(hiZDescriptors);
+        for (DescriptorAllocator& descriptors : frameDescriptors)
+        {
+            destroyDescriptorAllocator(descriptors);
+        }
 
-        vkDestroyBuffer(device, vertexBuffer, nullptr);
-        vkFreeMemory(device, vertexBufferMemory, nullptr);
-        vkDestroyBuffer(device, indexBuffer, nullptr);
-        vkFreeMemory(device, indexBufferMemory, nullptr);
+        destroyDescriptorLayout(frameSetLayout);
+        destroyDescriptorLayout(cullSetLayout);
+        destroyDescriptorLayout(hiZSetLayout);
+        destroyDescriptorLayout(drawGenerationSetLayout);
+        vkDestroyDescriptorPool(device, bindlessPool, allocator);
+        vkDestroyDescriptorSetLayout(device, bindlessSetLayout, allocator);
+
+        vertexBuffer.reset();
+        vertexBufferMemory.reset();
+        indexBuffer.reset();
+        indexBufferMemory.reset();
+        positionBuffer.reset();
+        positionBufferMemory.reset();
+        visibilityBuffer.reset();
+        visibilityBufferMemory.reset();
+        drawCommandBuffer.reset();
+        drawCommandBufferMemory.reset();
+        culledInstanceBuffer.reset();
+        culledInstanceBufferMemory.reset();
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            cullingStatsBuffers[i].reset();
+            cullingStatsBuffersMemory[i].reset();
+        }
+        instanceOffsetBuffer.reset();
+        instanceOffsetBufferMemory.reset();
+        generatedInstanceBuffer.reset();
+        generatedInstanceBufferMemory.reset();
+        generatedDrawBuffer.reset();
+        generatedDrawBufferMemory.reset();
+        drawCountBuffer.reset();
+        drawCountBufferMemory.reset();
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            drawCountReadbackBuffers[i].reset();
+            drawCountReadbackBuffersMemory[i].reset();
+        }
+        hiZLevelViews.clear();
+        hiZView.reset();
+        hiZImage.reset();
+        hiZImageMemory.reset();
+        hiZSampler.reset();
+
+        for (size_t i = 0; i < readbackBuffers.size(); i++) {
+            vkDestroyBuffer(device, readbackBuffers[i], allocator);
+            vkFreeMemory(device, readbackBuffersMemory[i], allocator);
+        }
 
         for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-            vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-            vkDestroyFence(device, inFlightFences[i], nullptr);
+            vkDestroySemaphore(device, renderFinishedSemaphores[i], allocator);
+            vkDestroySemaphore(device, imageAvailableSemaphores[i], allocator);
+        }
+
+        graphicsPipeline.reset();
+        depthPrepassPipeline.reset();
+        cullPipeline.reset();
+        hiZPipeline.reset();
+        drawGenerationPipeline.reset();
+        renderGraph.destroy();
+
+        // the device is idle by now, so everything still queued can go, including what was retired just now
+        deletionQueue.flush();
+        vkDestroySemaphore(device, graphicsTimeline.semaphore, allocator);
+        vkDestroySemaphore(device, transferTimeline.semaphore, allocator);
+
+        if (timestampQueryPool != VK_NULL_HANDLE)
+        {
+            vkDestroyQueryPool(device, timestampQueryPool, allocator);
         }
 
-        vkDestroyCommandPool(device, commandPool, nullptr);
+        if (pipelineStatisticsPool != VK_NULL_HANDLE)
+        {
+            vkDestroyQueryPool(device, pipelineStatisticsPool, allocator);
+        }
+
+#if ENABLE_PROFILING
+        if (profilerQueryPool != VK_NULL_HANDLE)
+        {
+            vkDestroyQueryPool(device, profilerQueryPool, allocator);
+        }
+#endif
 
-        vkDestroyPipeline(device, graphicsPipeline, nullptr);
-        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        if (transferCommandPool != VK_NULL_HANDLE)
+        {
+            vkDestroyCommandPool(device, transferCommandPool, allocator);
+        }
+        vkDestroyCommandPool(device, commandPool, allocator);
+        for (const RecordSlice& slice : recordSlices)
+        {
+            for (VkCommandPool pool : slice.commandPools)
+            {
+                vkDestroyCommandPool(device, pool, allocator);
+            }
+        }
 
-        vkDestroyRenderPass(device, renderPass, nullptr);
+        vkDestroyPipelineLayout(device, pipelineLayout, allocator);
+        vkDestroyPipelineLayout(device, cullPipelineLayout, allocator);
+        vkDestroyPipelineLayout(device, hiZPipelineLayout, allocator);
+        vkDestroyPipelineLayout(device, drawGenerationPipelineLayout, allocator);
 
-        vkDestroyDevice(device, nullptr);
+        vkDestroyDevice(device, allocator);
 
         if (enableValidationLayers)
         {
-            DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+            DestroyDebugUtilsMessengerEXT(instance, debugMessenger, allocator);
         }
 
-        vkDestroySurfaceKHR(instance, surface, nullptr);
+        if (!options.headless.enabled)
+        {
+            vkDestroySurfaceKHR(instance, surface, allocator);
+        }
 
-        vkDestroyInstance(instance, nullptr);
+        vkDestroyInstance(instance, allocator);
 
-        glfwDestroyWindow(window);
+        if (!options.headless.enabled)
+        {
+            glfwDestroyWindow(window);
 
-        glfwTerminate();    
+            glfwTerminate();
+        }
     }
 };
 
-int main() {
-    HelloTriangleApplication app;
+/// <summary>
+/// Parses "--name=value" style arguments into an "AppOptions".
+/// </summary>
+AppOptions parseCommandLine(int argc, char** argv)
+{
+    AppOptions options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        size_t separator = argument.find('=');
+        std::string name = argument.substr(0, separator);
+        std::string value = separator == std::string::npos ? "" : argument.substr(separator + 1);
+
+        if (name == "--pacing")
+        {
+            // presets, individual options given after this override them
+            if (value == "low-latency")
+            {
+                options.pacing.swapchainImageCount = 2;
+                options.pacing.framesInFlight = 1;
+                options.pacing.presentMode = PresentModePolicy::Mailbox;
+            }
+            else if (value == "throughput")
+            {
+                options.pacing.swapchainImageCount = 0;
+                options.pacing.framesInFlight = MAX_FRAMES_IN_FLIGHT;
+                options.pacing.presentMode = PresentModePolicy::Immediate;
+            }
+            else
+            {
+                throw std::invalid_argument("unknown pacing preset: " + value);
+            }
+        }
+        else if (name == "--present-mode")
+        {
+            if (value == "mailbox") options.pacing.presentMode = PresentModePolicy::Mailbox;
+            else if (value == "fifo") options.pacing.presentMode = PresentModePolicy::Fifo;
+            else if (value == "fifo-relaxed") options.pacing.presentMode = PresentModePolicy::FifoRelaxed;
+            else if (value == "immediate") options.pacing.presentMode = PresentModePolicy::Immediate;
+            else throw std::invalid_argument("unknown present mode: " + value);
+        }
+        else if (name == "--swapchain-images")
+        {
+            options.pacing.swapchainImageCount = static_cast<uint32_t>(std::stoul(value));
+        }
+        else if (name == "--frames-in-flight")
+        {
+            options.pacing.framesInFlight = std::clamp(static_cast<uint32_t>(std::stoul(value)), 1u, static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT));
+        }
+        else if (name == "--fps-limit")
+        {
+            options.pacing.frameRateLimit = std::stod(value);
+        }
+        else if (name == "--benchmark")
+        {
+            options.benchmark.enabled = true;
+        }
+        else if (name == "--benchmark-frames")
+        {
+            options.benchmark.frameCount = static_cast<uint32_t>(std::stoul(value));
+        }
+        else if (name == "--warmup-frames")
+        {
+            options.benchmark.warmupFrames = static_cast<uint32_t>(std::stoul(value));
+        }
+        else if (name == "--timestep-ms")
+        {
+            options.benchmark.timestep = std::stod(value) / 1000.0;
+        }
+        else if (name == "--camera-path")
+        {
+            options.benchmark.cameraPath = value;
+        }
+        else if (name == "--benchmark-out")
+        {
+            options.benchmark.outputPath = value;
+        }
+        else if (name == "--benchmark-label")
+        {
+            options.benchmark.label = value;
+        }
+        else if (name == "--track-allocations" || name == "--assert-no-frame-allocations")
+        {
+            options.allocations.enabled = true;
+            options.allocations.assertNoFrameAllocations |= name == "--assert-no-frame-allocations";
+#if !ENABLE_ALLOCATION_TRACKING
+            std::cout << "Allocation tracking is compiled out of this build, " << name << " does nothing." << std::endl;
+#endif
+        }
+        else if (name == "--allocation-warmup-frames")
+        {
+            options.allocations.warmupFrames = static_cast<uint32_t>(std::stoul(value));
+        }
+        else if (name == "--instances")
+        {
+            options.instanceCount = static_cast<uint32_t>(std::stoul(value));
+        }
+        else if (name == "--descriptor-benchmark")
+        {
+            options.descriptorBenchmark = true;
+        }
+        else if (name == "--instances-per-draw")
+        {
+            options.instancesPerDraw = static_cast<uint32_t>(std::stoul(value));
+        }
+        else if (name == "--record-threads")
+        {
+            options.recordThreads = static_cast<uint32_t>(std::stoul(value));
+        }
+        else if (name == "--record-benchmark")
+        {
+            options.recordBenchmark = true;
+        }
+        else if (name == "--job-threads")
+        {
+            options.jobThreads = static_cast<uint32_t>(std::stoul(value));
+        }
+        else if (name == "--pin-job-threads")
+        {
+            options.pinJobThreads = true;
+        }
+        else if (name == "--job-benchmark")
+        {
+            options.jobBenchmark = true;
+        }
+        else if (name == "--frustum-culling")
+        {
+            options.frustumCulling = true;
+        }
+        else if (name == "--cull-benchmark")
+        {
+            options.cullBenchmark = true;
+        }
+        else if (name == "--cache-commands")
+        {
+            options.cacheCommands = true;
+        }
+        else if (name == "--msaa")
+        {
+            options.msaaSamples = static_cast<uint32_t>(std::stoul(value));
+        }
+        else if (name == "--depth-prepass")
+        {
+            options.depthPrepass = true;
+        }
+        else if (name == "--occlusion-culling")
+        {
+            options.occlusionCulling = true;
+        }
+        else if (name == "--gpu-driven")
+        {
+            options.gpuDriven = true;
+        }
+        else if (name == "--trace")
+        {
+            options.tracePath = value.empty() ? "trace.json" : value;
+#if !ENABLE_PROFILING
+            std::cout << "Profiling is compiled out of this build, --trace does nothing." << std::endl;
+#endif
+        }
+        else if (name == "--headless")
+        {
+            options.headless.enabled = true;
+        }
+        else if (name == "--resolution")
+        {
+            size_t x = value.find('x');
+            if (x == std::string::npos)
+            {
+                throw std::invalid_argument("resolution has to look like 1920x1080: " + value);
+            }
+            options.headless.width = static_cast<uint32_t>(std::stoul(value.substr(0, x)));
+            options.headless.height = static_cast<uint32_t>(std::stoul(value.substr(x + 1)));
+        }
+        else if (name == "--frames")
+        {
+            options.headless.frameCount = static_cast<uint32_t>(std::stoul(value));
+        }
+        else if (name == "--dump-frames")
+        {
+            options.headless.dumpDirectory = value;
+        }
+        else if (name == "--stream-textures")
+        {
+            options.streamTextures = true;
+        }
+        else
+        {
+            throw std::invalid_argument("unknown argument: " + argument);
+        }
+    }
+
+    return options;
+}
 
+int main(int argc, char** argv) {
     try {
+        HelloTriangleApplication app(parseCommandLine(argc, argv));
         app.run();
     }
     catch (const std::exception& e) {
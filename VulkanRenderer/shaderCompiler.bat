@@ -1,3 +1,7 @@
 C:/VulkanSDK/1.3.246.0/Bin/glslc.exe shaders/shader.vert -o shaders/vert.spv
 C:/VulkanSDK/1.3.246.0/Bin/glslc.exe shaders/shader.frag -o shaders/frag.spv
+C:/VulkanSDK/1.3.246.0/Bin/glslc.exe shaders/depth.vert -o shaders/depth.spv
+C:/VulkanSDK/1.3.246.0/Bin/glslc.exe shaders/hiz.comp -o shaders/hiz.spv
+C:/VulkanSDK/1.3.246.0/Bin/glslc.exe shaders/cull.comp -o shaders/cull.spv
+C:/VulkanSDK/1.3.246.0/Bin/glslc.exe shaders/drawgen.comp -o shaders/drawgen.spv
 pause
\ No newline at end of file
@@ -1,3 +1,7 @@
 glslc.exe shader.vert -o vert.spv
 glslc.exe shader.frag -o frag.spv
+glslc.exe depth.vert -o depth.spv
+glslc.exe hiz.comp -o hiz.spv
+glslc.exe cull.comp -o cull.spv
+glslc.exe drawgen.comp -o drawgen.spv
 pause
\ No newline at end of file
@@ -0,0 +1,16 @@
+#version 450
+
+// depth pre-pass, positions only. The transform has to stay identical to shader.vert
+layout(set = 0, binding = 0) uniform CameraUniforms {
+    mat4 viewProj;
+} camera;
+
+layout(location = 0) in vec3 inPosition;
+// per instance, takes up locations 3 to 6
+layout(location = 3) in mat4 inModel;
+
+invariant gl_Position;
+
+void main() {
+    gl_Position = camera.viewProj * (inModel * vec4(inPosition, 1.0));
+}
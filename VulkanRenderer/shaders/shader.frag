@@ -1,13 +1,21 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
-layout(binding = 1) uniform sampler2D texSampler;
+// set 0 binding 1 changes per draw, dynamic offset into the uniform ring
+layout(set = 0, binding = 1) uniform DrawUniforms {
+    vec4 tint;
+} draw;
+
+// set 1 is the bindless texture table, bound once for the whole frame
+layout(set = 1, binding = 0) uniform sampler2D textures[];
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoords;
+layout(location = 2) flat in uint fragTextureIndex;
 
 layout(location = 0) out vec4 outColor;
 
 void main()
 {
-    outColor = texture(texSampler, fragTexCoords);
+    outColor = texture(textures[nonuniformEXT(fragTextureIndex)], fragTexCoords) * draw.tint;
 }
\ No newline at end of file
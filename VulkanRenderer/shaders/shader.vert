@@ -1,20 +1,28 @@
 #version 450
 
-layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
-    mat4 view;
-    mat4 proj;
-} ubo;
+// set 0 changes once per frame
+layout(set = 0, binding = 0) uniform CameraUniforms {
+    mat4 viewProj;
+} camera;
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoords;
+// per instance, takes up locations 3 to 6
+layout(location = 3) in mat4 inModel;
+layout(location = 7) in uint inTextureIndex;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoords;
+layout(location = 2) flat out uint fragTextureIndex;
+
+// the depth pre-pass (depth.vert) computes positions the same way, so the main pass can depth test with EQUAL
+invariant gl_Position;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    // two matrix-vector products instead of building a matrix per vertex
+    gl_Position = camera.viewProj * (inModel * vec4(inPosition, 1.0));
     fragColor = inColor;
     fragTexCoords = inTexCoords;
+    fragTextureIndex = inTextureIndex;
 }